@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef ENVIRONMENT_GLSL
+#define ENVIRONMENT_GLSL 1
+
+// Prefiltered lookups of the environment mip chain.
+// Paths carry the angular spread of their ray cone (HitPayload::coneSpread): it starts at the pixel
+// footprint and widens with the roughness of every surface the path scatters off. A missed ray
+// reads the mip level whose texels cover that spread, up to ENV_MAX_CONE_SPREAD, rough bounces
+// thus fetch from a few small levels instead of the whole full resolution map.
+// Requires 'frameInfo' and 'hdrTexture' to be declared.
+
+// Spread of a primary ray: the angle covered by one pixel of the viewport
+float primaryConeSpread()
+{
+  return 2.0 / (abs(frameInfo.proj[1][1]) * float(gl_LaunchSizeEXT.y));
+}
+
+// Spread added by scattering off a lobe of GGX roughness 'alpha', the diffuse lobe being alpha = 1
+float lobeConeSpread(float alpha)
+{
+  return 2.0 * atan(alpha);
+}
+
+// Widest spread the environment is filtered over, the footprint of a texel of a 64 texels wide
+// level: a diffuse lobe alone (lobeConeSpread(1.0), about 90 degrees) would read the coarsest
+// levels, a flat average of the environment.
+#define ENV_MAX_CONE_SPREAD (2.0 * M_PI / 64.0)
+
+// Radiance (rgb) and pdf (a) of the environment in the environment space direction 'dir'.
+// The radiance is filtered over the footprint of a ray cone of angular spread 'coneSpread'. The
+// pdf is read from the full resolution level, as sampleEnvironmentLight() does, so that both
+// strategies weigh their samples with the same pdf.
+vec4 environmentLookup(vec3 dir, float coneSpread)
+{
+  vec2 uv = getSphericalUv(dir);
+
+  // Texels at the equator cover 2*PI / width radians
+  float texelAngle = 2.0 * M_PI / float(textureSize(hdrTexture, 0).x);
+  float lod        = max(0.0, log2(min(coneSpread, ENV_MAX_CONE_SPREAD) / texelAngle));
+  return vec4(textureLod(hdrTexture, uv, lod).rgb, textureLod(hdrTexture, uv, 0.0).a);
+}
+
+#endif
@@ -17,13 +17,14 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 // This function returns the geometric information at hit point
-// Note: depends on the buffer layout PrimMeshInfo
+// Note: depends on the buffer layout PrimMeshInfo, and on the compressed attributes of quantized_vertex.glsl
 
 #ifndef GETHIT_GLSL
 #define GETHIT_GLSL
 
 #include "nvvkhl/shaders/vertex_accessor.h"
 #include "nvvkhl/shaders/func.h"
+#include "quantized_vertex.glsl"
 
 //-----------------------------------------------------------------------
 // Hit state information
@@ -36,6 +37,7 @@ struct HitState
   vec3  tangent;
   vec3  bitangent;
   float bitangentSign;
+  float uvDensity;  // texture coordinates per world unit, see texture_feedback.glsl
 };
 
 
@@ -59,7 +61,8 @@ vec3 adjustShadingNormalToRayDir(inout vec3 N, inout vec3 G)
 //-----------------------------------------------------------------------
 HitState GetHitState(RenderPrimitive renderPrim)
 {
-  HitState hit;
+  HitState                 hit;
+  const QuantizedPrimitive qprim = quantizedPrimitives[gl_InstanceCustomIndexEXT];
 
   // Barycentric coordinate on the triangle
   vec3 barycentrics = vec3(1.0 - attribs.x - attribs.y, attribs.x, attribs.y);
@@ -80,24 +83,37 @@ HitState GetHitState(RenderPrimitive renderPrim)
   hit.geonrm                = worldGeoNormal;
 
   hit.nrm = worldGeoNormal;
-  if(hasVertexNormal(renderPrim))
+  if(hasQuantizedNormal(renderPrim, qprim))
   {
-    const vec3 normal      = getInterpolatedVertexNormal(renderPrim, triangleIndex, barycentrics);
+    const vec3 normal      = getInterpolatedQuantizedNormal(renderPrim, qprim, triangleIndex, barycentrics);
     vec3       worldNormal = normalize(vec3(normal * gl_WorldToObjectEXT));
     adjustShadingNormalToRayDir(worldNormal, worldGeoNormal);
     hit.nrm = worldNormal;
   }
 
   // TexCoord
-  hit.uv = getInterpolatedVertexTexCoord0(renderPrim, triangleIndex, barycentrics);
+  hit.uv = getInterpolatedQuantizedTexCoord0(renderPrim, qprim, triangleIndex, barycentrics);
+
+  // Ratio of the texture coordinate area to the world area of the triangle
+  {
+    const vec2  uv0       = getQuantizedTexCoord0(renderPrim, qprim, triangleIndex.x);
+    const vec2  uv1       = getQuantizedTexCoord0(renderPrim, qprim, triangleIndex.y);
+    const vec2  uv2       = getQuantizedTexCoord0(renderPrim, qprim, triangleIndex.z);
+    const vec2  duv1      = uv1 - uv0;
+    const vec2  duv2      = uv2 - uv0;
+    const float uvArea    = abs(duv1.x * duv2.y - duv1.y * duv2.x);
+    const mat3  toWorld   = mat3(gl_ObjectToWorldEXT);
+    const float worldArea = length(cross(toWorld * (pos1 - pos0), toWorld * (pos2 - pos0)));
+    hit.uvDensity         = worldArea > 0.0 ? sqrt(uvArea / worldArea) : 0.0;
+  }
 
   // Tangent - Bitangent
   vec4 tng[3];
-  if(hasVertexTangent(renderPrim))
+  if(hasQuantizedTangent(renderPrim, qprim))
   {
-    tng[0] = getVertexTangent(renderPrim, triangleIndex.x);
-    tng[1] = getVertexTangent(renderPrim, triangleIndex.y);
-    tng[2] = getVertexTangent(renderPrim, triangleIndex.z);
+    tng[0] = getQuantizedTangent(renderPrim, qprim, triangleIndex.x);
+    tng[1] = getQuantizedTangent(renderPrim, qprim, triangleIndex.y);
+    tng[2] = getQuantizedTangent(renderPrim, qprim, triangleIndex.z);
   }
   else
   {
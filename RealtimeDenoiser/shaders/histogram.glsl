@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef HISTOGRAM_GLSL
+#define HISTOGRAM_GLSL 1
+
+// Helpers for the log2-luminance histograms built by the compute passes.
+// Bin 0 collects the (near) black pixels, bins 1..HISTOGRAM_BINS-1 cover [minLogLum, minLogLum + logLumRange].
+
+float histogramLuminance(vec3 color)
+{
+  return dot(color, vec3(0.212671f, 0.715160f, 0.072169f));
+}
+
+uint luminanceToBin(float lum, float minLogLum, float logLumRange)
+{
+  if(!(lum > 1e-6))  // also catches NaN
+    return 0;
+  float t = clamp((log2(lum) - minLogLum) / logLumRange, 0.0, 1.0);
+  return uint(t * float(HISTOGRAM_BINS - 2) + 1.0);
+}
+
+// log2-luminance at the center of a bin
+float binToLogLuminance(uint bin, float minLogLum, float logLumRange)
+{
+  return minLogLum + (float(bin) - 0.5) / float(HISTOGRAM_BINS - 2) * logLumRange;
+}
+
+#ifdef HISTOGRAM_WORKGROUP_OPS
+// Reductions over a workgroup of HISTOGRAM_BINS threads, for the resolve passes (one thread per bin).
+// Requires GL_KHR_shader_subgroup_arithmetic.
+
+// Per-subgroup partial results (subgroups have at least 4 invocations)
+shared float sPartial[HISTOGRAM_BINS / 4];
+shared float sWeight[HISTOGRAM_BINS / 4];
+
+// Exclusive prefix sum of 'value' over the workgroup
+float workgroupExclusiveAdd(float value)
+{
+  float inclusive = subgroupInclusiveAdd(value);
+  if(gl_SubgroupInvocationID == gl_SubgroupSize - 1)
+    sPartial[gl_SubgroupID] = inclusive;
+  barrier();
+
+  float offset = 0.0;
+  for(uint i = 0; i < gl_SubgroupID; ++i)
+    offset += sPartial[i];
+  barrier();
+
+  return offset + inclusive - value;
+}
+
+// Sum of 'value' and 'weight' over the workgroup
+vec2 workgroupAdd(float value, float weight)
+{
+  float subValue  = subgroupAdd(value);
+  float subWeight = subgroupAdd(weight);
+  if(subgroupElect())
+  {
+    sPartial[gl_SubgroupID] = subValue;
+    sWeight[gl_SubgroupID]  = subWeight;
+  }
+  barrier();
+
+  vec2 total = vec2(0.0);
+  for(uint i = 0; i < gl_NumSubgroups; ++i)
+    total += vec2(sPartial[i], sWeight[i]);
+  barrier();
+
+  return total;
+}
+#endif  // HISTOGRAM_WORKGROUP_OPS
+
+#endif  // HISTOGRAM_GLSL
@@ -21,6 +21,7 @@
 #define HOST_DEVICE_H
 
 #define GRID_SIZE 16  // Grid size used by compute shaders
+#define HISTOGRAM_BINS 256  // Bins of the luminance histograms, one per thread of a GRID_SIZE x GRID_SIZE workgroup
 
 // clang-format off
 #ifdef __cplusplus
@@ -49,6 +50,12 @@
 #define NRD_REBLUR 1
 #define NRD_REFERENCE 2
 
+// How thumbnail.comp interprets the G-Buffer it downsamples
+#define THUMBNAIL_HDR 0       // linear radiance
+#define THUMBNAIL_RADIANCE 1  // radiance packed for the active denoiser (see RtxPushConstant::method)
+#define THUMBNAIL_NORMAL 2    // NRD encoded normal/roughness
+#define THUMBNAIL_LDR 3       // already display referred
+
 // We have two sets of shaders compiled into the Shader Binding Table;
 // primary shaders, light-weight shaders used when finding the primary surface
 // (which doesn't require random sampling), and pathtrace shaders, which are
@@ -61,11 +68,18 @@
 #define MISSINDEX_PATHTRACE 0
 
 START_BINDING(SceneBindings)
-  eFrameInfo = 0,
-  eSceneDesc = 1,
-  eTextures  = 2
+  eFrameInfo           = 0,
+  eSceneDesc           = 1,
+  eTextures            = 2,
+  eTextureFeedback     = 3,  // finest mip level requested per texture, see TextureStreamer
+  eQuantizedPrimitives = 4,  // QuantizedPrimitive per render primitive, see VertexQuantizer
+  eQuantizedData       = 5   // their compressed attributes, in 32-bit words
 END_BINDING();
 
+// Texture streaming feedback, in 1/TEXTURE_FEEDBACK_SCALE steps of mip level
+#define TEXTURE_FEEDBACK_SCALE 256.0
+#define TEXTURE_FEEDBACK_NONE 0x7FFFFFFF
+
 START_BINDING(RtxBindings)
   eTlas     = 0
 END_BINDING();
@@ -83,7 +97,8 @@ START_BINDING(NrdBindings)
   eSpec                   = 5,
   eUnfiltered_Diff        = 6,
   eUnfiltered_Spec        = 7,
-  eBaseColor_Metalness    = 8
+  eBaseColor_Metalness    = 8,
+  eFireflyClamp           = 9   // FireflyData, read when RtxPushConstant::adaptiveFirefly is set
 END_BINDING();
 
 START_BINDING(CompositionBindings)
@@ -99,7 +114,31 @@ END_BINDING();
 
 START_BINDING(TaaBindings)
   eInImage = 0,
-  eOutImage  = 1
+  eOutImage  = 1,
+  eOutExposed = 2,  // eOutImage scaled by the auto-exposure, input of the tonemapper
+  eInExposure = 3
+END_BINDING();
+
+START_BINDING(ExposureBindings)
+  eExposureImage = 0,
+  eExposureData  = 1
+END_BINDING();
+
+START_BINDING(FireflyBindings)
+  eFireflyDiff      = 0,
+  eFireflySpec      = 1,
+  eFireflyBaseColor = 2,
+  eFireflyData      = 3
+END_BINDING();
+
+START_BINDING(ThumbnailBindings)
+  eThumbSource = 0,
+  eThumbAtlas  = 1
+END_BINDING();
+
+START_BINDING(MipmapBindings)
+  eMipSource = 0,
+  eMipLevels = 1
 END_BINDING();
 // clang-format on
 
@@ -121,6 +160,10 @@ struct FrameInfo
   vec2  jitter;
   float envRotation;
   float _pad;  // std430 layout requirements
+  vec3  sunDirection;    // in environment space, rotated by envRotation like the environment
+  float sunCosAngle;     // cosine of the angular radius of the sun disk
+  vec3  sunRadiance;     // already multiplied by the environment intensity
+  float sunProbability;  // chance of sampling the sun rather than the environment, 0 when there is no sun
 #if NB_LIGHTS > 0
   Light light[NB_LIGHTS];
 #endif
@@ -136,11 +179,91 @@ struct RtxPushConstant
   float overrideRoughness;
   float overrideMetallic;
   ivec2 mouseCoord;
+  int   adaptiveFirefly;  // clamp against FireflyData::maxLuminance instead of maxLuminance
+};
+
+// Compressed vertex attributes of a render primitive, see VertexQuantizer and quantized_vertex.glsl
+#define QUANTIZED_NORMAL 1    // octahedral snorm16x2
+#define QUANTIZED_TANGENT 2   // octahedral snorm16x2, the bitangent sign in the lowest bit
+#define QUANTIZED_TEXCOORD 4  // unorm16x2 over [uvOffset, uvOffset + uvScale]
+
+struct QuantizedPrimitive
+{
+  uint flags;           // QUANTIZED_*, the other attributes are read from nvvkhl::SceneVk
+  uint normalOffset;    // offsets in words of eQuantizedData
+  uint tangentOffset;   //
+  uint texCoordOffset;  //
+  vec2 uvOffset;
+  vec2 uvScale;
+};
+
+struct TaaPushConstant
+{
+  float alpha;
+  int   autoExposure;  // apply ExposureData::exposure to eOutExposed
+};
+
+struct ExposurePushConstant
+{
+  float minLogLum;    // log2 luminance range covered by the histogram
+  float logLumRange;  //
+  float lowPercentile;   // pixels below/above these fractions are ignored when averaging
+  float highPercentile;  //
+  float keyValue;        // middle gray the average luminance is mapped to
+  float adaptation;      // blend factor towards the new exposure, 1 snaps
+};
+
+struct ExposureData
+{
+  float exposure;          // multiplier applied before tonemapping, 0 until the first resolve
+  float averageLuminance;  // of the last resolve, for display
+  uint  _pad[2];
+  uint  histogram[HISTOGRAM_BINS];  // accumulated by exposure_histogram.comp, cleared by exposure_resolve.comp
+};
+
+struct FireflyPushConstant
+{
+  float minLogLum;    // log2 luminance range covered by the histogram
+  float logLumRange;  //
+  float percentile;   // fraction of the non-black samples that stay below the clamp
+  float headroom;     // multiplier on the percentile luminance, lets the clamp grow back
+  float minLuminance;  // lower bound of the clamp
+  float adaptation;    // blend factor towards the new clamp, 1 snaps
+  int   method;        // NRD_*, to decode the inputs
+};
+
+struct FireflyData
+{
+  float maxLuminance;  // clamp used by the raygen, 0 until the first resolve
+  uint  _pad[3];
+  uint  histogram[HISTOGRAM_BINS];  // accumulated by firefly_histogram.comp, cleared by firefly_resolve.comp
+};
+
+struct ThumbnailPushConstant
+{
+  ivec2 tileOffset;  // Top-left corner of the tile in the atlas
+  ivec2 tileSize;
+  int   decode;  // THUMBNAIL_*
+  int   method;  // NRD_*
+};
+
+// Levels written by a dispatch of mipmap.comp: a workgroup reduces a 64x64 tile down to 1x1
+#define MIPMAP_LEVELS_PER_PASS 6
+#define MIPMAP_TILE_SIZE 64
+
+struct MipmapPushConstant
+{
+  uint levels;  // written by this pass, the other eMipLevels are not used
+  uint srgb;    // averaged in linear space
 };
 
 #ifdef __cplusplus
 #include <vulkan/vulkan_core.h>
 
+static_assert(HISTOGRAM_BINS == GRID_SIZE * GRID_SIZE, "The histogram passes use one thread per bin");
+static_assert(MIPMAP_TILE_SIZE == GRID_SIZE * 4 && MIPMAP_TILE_SIZE == 1 << MIPMAP_LEVELS_PER_PASS,
+              "Each thread of mipmap.comp reduces 4x4 texels of the tile");
+
 inline VkExtent2D getGridSize(const VkExtent2D& size)
 {
   return VkExtent2D{(size.width + (GRID_SIZE - 1)) / GRID_SIZE, (size.height + (GRID_SIZE - 1)) / GRID_SIZE};
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef QUANTIZED_VERTEX_GLSL
+#define QUANTIZED_VERTEX_GLSL 1
+
+// Vertex attributes of the render primitives compressed at load (see VertexQuantizer). Each
+// accessor decodes the compressed attribute when the primitive has it, and otherwise reads the
+// fp32 one of nvvkhl::SceneVk, like the accessors of vertex_accessor.h.
+
+#include "nvvkhl/shaders/vertex_accessor.h"
+
+// clang-format off
+layout(set = 1, binding = eQuantizedPrimitives, scalar) readonly buffer QuantizedPrimitives_ { QuantizedPrimitive quantizedPrimitives[]; };
+layout(set = 1, binding = eQuantizedData) readonly buffer QuantizedData_ { uint quantizedData[]; };
+// clang-format on
+
+vec3 decodeOctahedral(uint word)
+{
+  const vec2 e = unpackSnorm2x16(word);
+  vec3       v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+  if(v.z < 0.0)
+  {
+    v.xy = (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+  }
+  return normalize(v);
+}
+
+bool hasQuantizedNormal(RenderPrimitive renderPrim, QuantizedPrimitive qprim)
+{
+  return (qprim.flags & QUANTIZED_NORMAL) != 0u || hasVertexNormal(renderPrim);
+}
+
+vec3 getInterpolatedQuantizedNormal(RenderPrimitive renderPrim, QuantizedPrimitive qprim, uvec3 idx, vec3 barycentrics)
+{
+  if((qprim.flags & QUANTIZED_NORMAL) == 0u)
+  {
+    return getInterpolatedVertexNormal(renderPrim, idx, barycentrics);
+  }
+  const vec3 n0 = decodeOctahedral(quantizedData[qprim.normalOffset + idx.x]);
+  const vec3 n1 = decodeOctahedral(quantizedData[qprim.normalOffset + idx.y]);
+  const vec3 n2 = decodeOctahedral(quantizedData[qprim.normalOffset + idx.z]);
+  return normalize(mixBary(n0, n1, n2, barycentrics));
+}
+
+bool hasQuantizedTangent(RenderPrimitive renderPrim, QuantizedPrimitive qprim)
+{
+  return (qprim.flags & QUANTIZED_TANGENT) != 0u || hasVertexTangent(renderPrim);
+}
+
+vec4 getQuantizedTangent(RenderPrimitive renderPrim, QuantizedPrimitive qprim, uint index)
+{
+  if((qprim.flags & QUANTIZED_TANGENT) == 0u)
+  {
+    return getVertexTangent(renderPrim, index);
+  }
+  const uint word = quantizedData[qprim.tangentOffset + index];
+  return vec4(decodeOctahedral(word), (word & 1u) != 0u ? -1.0 : 1.0);
+}
+
+vec2 getQuantizedTexCoord0(RenderPrimitive renderPrim, QuantizedPrimitive qprim, uint index)
+{
+  if((qprim.flags & QUANTIZED_TEXCOORD) == 0u)
+  {
+    return getVertexTexCoord0(renderPrim, index);
+  }
+  return qprim.uvOffset + unpackUnorm2x16(quantizedData[qprim.texCoordOffset + index]) * qprim.uvScale;
+}
+
+vec2 getInterpolatedQuantizedTexCoord0(RenderPrimitive renderPrim, QuantizedPrimitive qprim, uvec3 idx, vec3 barycentrics)
+{
+  if((qprim.flags & QUANTIZED_TEXCOORD) == 0u)
+  {
+    return getInterpolatedVertexTexCoord0(renderPrim, idx, barycentrics);
+  }
+  const vec2 uv0 = getQuantizedTexCoord0(renderPrim, qprim, idx.x);
+  const vec2 uv1 = getQuantizedTexCoord0(renderPrim, qprim, idx.y);
+  const vec2 uv2 = getQuantizedTexCoord0(renderPrim, qprim, idx.z);
+  return uv0 * barycentrics.x + uv1 * barycentrics.y + uv2 * barycentrics.z;
+}
+
+#endif
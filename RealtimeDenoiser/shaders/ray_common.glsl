@@ -36,6 +36,7 @@ struct HitPayload
   vec3  rayOrigin;     // Input and output.
   vec3  rayDirection;  // Input and output.
   float bsdfPDF;       // Input and output: Probability that the BSDF sampling generated rayDirection.
+  float coneSpread;    // Input and output: Angular spread of the path's ray cone, selects the environment mip level.
 };
 
 
@@ -48,6 +49,7 @@ struct HitPayloadNrd
   vec3  normal_envmapRadiance;  // when hitT == NRD_INF we hit the environment map and return its radiance here
   vec2  uv;
   float bitangentSign;
+  float uvDensity;  // texture coordinates per world unit, for the texture streaming feedback
 };
 
 
@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef SUN_GLSL
+#define SUN_GLSL 1
+
+// Analytic sun: a disk of constant radiance around frameInfo.sunDirection.
+// All directions are in environment space, i.e. before applying frameInfo.envRotation.
+// Requires 'frameInfo' to be declared.
+
+bool sunEnabled()
+{
+  return frameInfo.sunProbability > 0.0;
+}
+
+// Radiance of the sun seen in direction 'dir'
+vec3 sunRadiance(vec3 dir)
+{
+  return (sunEnabled() && dot(dir, frameInfo.sunDirection) >= frameInfo.sunCosAngle) ? frameInfo.sunRadiance : vec3(0);
+}
+
+// Solid angle pdf of sampling 'dir' uniformly within the sun cone
+float sunPdf(vec3 dir)
+{
+  if(!sunEnabled() || dot(dir, frameInfo.sunDirection) < frameInfo.sunCosAngle)
+    return 0.0;
+  return 1.0 / (2.0 * M_PI * (1.0 - frameInfo.sunCosAngle));
+}
+
+// Uniform direction within the sun cone
+vec3 sampleSunCone(vec2 randVal)
+{
+  float cosTheta = 1.0 - randVal.x * (1.0 - frameInfo.sunCosAngle);
+  float sinTheta = sqrt(max(0.0, 1.0 - cosTheta * cosTheta));
+  float phi      = 2.0 * M_PI * randVal.y;
+
+  vec3 axis = frameInfo.sunDirection;
+  vec3 t    = normalize(abs(axis.x) > 0.9 ? cross(axis, vec3(0, 1, 0)) : cross(axis, vec3(1, 0, 0)));
+  vec3 b    = cross(axis, t);
+  return normalize(t * (cos(phi) * sinTheta) + b * (sin(phi) * sinTheta) + axis * cosTheta);
+}
+
+// Pdf of the combined sun and environment light sampling for 'dir', 'envPdf' being the pdf stored in
+// the alpha channel of the environment. This is the light pdf to use in the MIS weights.
+float environmentLightPdf(vec3 dir, float envPdf)
+{
+  return mix(envPdf, sunPdf(dir), frameInfo.sunProbability);
+}
+
+#ifdef ENVIRONMENT_LIGHT_SAMPLING
+// Sample the sun or the environment, in proportion to frameInfo.sunProbability.
+// Requires 'hdrTexture' and nvvkhl/shaders/hdr_env_sampling.h.
+// Returns the radiance arriving from the world space 'dirToLight', and the combined pdf.
+vec4 sampleEnvironmentLight(vec3 randVal, out vec3 dirToLight)
+{
+  vec3 dir;
+  if(randVal.z < frameInfo.sunProbability)
+  {
+    dir = sampleSunCone(randVal.xy);
+  }
+  else
+  {
+    randVal.z = (randVal.z - frameInfo.sunProbability) / (1.0 - frameInfo.sunProbability);
+    environmentSample(hdrTexture, randVal, dir);
+  }
+
+  // Both strategies could have produced the direction, the radiance includes both lights
+  vec4 env      = textureLod(hdrTexture, getSphericalUv(dir), 0.0);
+  vec3 radiance = env.rgb * frameInfo.clearColor.xyz + sunRadiance(dir);
+  float pdf     = environmentLightPdf(dir, env.a);
+
+  dirToLight = rotate(dir, vec3(0, 1, 0), frameInfo.envRotation);
+  return vec4(radiance, pdf);
+}
+#endif
+
+#endif
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef TEXTURE_FEEDBACK_GLSL
+#define TEXTURE_FEEDBACK_GLSL 1
+
+// Feedback of the texture streaming (see TextureStreamer): the finest mip level each texture is
+// sampled at. The level is estimated from the width of the ray cone at the hit and the density of
+// the texture coordinates on the triangle, as the level a 1x1 texture would need: the host adds
+// log2 of the texture size. The smallest value of the frame is kept per texture.
+
+layout(set = 1, binding = eTextureFeedback) buffer TextureFeedback_ { int textureFeedback[]; };
+
+void requestTexture(int textureIndex, int level)
+{
+  // Reading first skips most atomics, as the same few textures cover most of the screen
+  if(textureIndex >= 0 && level < textureFeedback[textureIndex])
+  {
+    atomicMin(textureFeedback[textureIndex], level);
+  }
+}
+
+// Request the textures of 'mat' for a ray cone of width 'coneWidth' at a hit of 'uvDensity' (see HitState).
+// Only one pixel in 16 writes each frame, a different one each frame.
+void requestMaterialTextures(GltfShadeMaterial mat, float coneWidth, float uvDensity, int frame)
+{
+  const uvec2 pixel = gl_LaunchIDEXT.xy;
+  if(((pixel.x + pixel.y * 4u + uint(frame) * 5u) & 15u) != 0u || coneWidth <= 0.0 || uvDensity <= 0.0)
+  {
+    return;
+  }
+
+  const int level = int(floor(log2(coneWidth * uvDensity) * TEXTURE_FEEDBACK_SCALE));
+  requestTexture(mat.pbrBaseColorTexture.index, level);
+  requestTexture(mat.pbrMetallicRoughnessTexture.index, level);
+  requestTexture(mat.normalTexture.index, level);
+  requestTexture(mat.emissiveTexture.index, level);
+}
+
+#endif
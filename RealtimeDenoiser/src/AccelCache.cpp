@@ -0,0 +1,219 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "AccelCache.hpp"
+
+#include <nvh/nvprint.hpp>
+
+#include "tiny_gltf.h"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace {
+
+uint64_t hashFile(const std::string& path, uint64_t hash)
+{
+  MappedFile file;
+  if(!file.open(path))
+  {
+    return hash;
+  }
+  hash = AccelCache::hashData(file.data(), file.size(), hash);
+  return (hash ^ file.size()) * 0x100000001B3ull;
+}
+
+VkDeviceSize alignUp(VkDeviceSize value)
+{
+  return (value + AccelCache::kAlignment - 1) & ~(AccelCache::kAlignment - 1);
+}
+
+}  // namespace
+
+// Consumed a word at a time to keep up with large buffers
+uint64_t AccelCache::hashData(const uint8_t* data, size_t size, uint64_t hash)
+{
+  constexpr uint64_t kPrime = 0x100000001B3ull;
+  size_t             i      = 0;
+  for(; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+  {
+    uint64_t word;
+    memcpy(&word, data + i, sizeof(word));
+    hash = (hash ^ word) * kPrime;
+    hash ^= hash >> 29;
+  }
+  for(; i < size; ++i)
+  {
+    hash = (hash ^ data[i]) * kPrime;
+  }
+  return hash;
+}
+
+uint64_t AccelCache::computeKey(const std::string&                   filename,
+                                const tinygltf::Model&               model,
+                                VkBuildAccelerationStructureFlagsKHR flags,
+                                const uint8_t                        deviceUUID[VK_UUID_SIZE])
+{
+  uint64_t hash = 0xCBF29CE484222325ull;
+  hash          = hashData(reinterpret_cast<const uint8_t*>(&kVersion), sizeof(kVersion), hash);
+  hash          = hashData(reinterpret_cast<const uint8_t*>(&flags), sizeof(flags), hash);
+  hash          = hashData(deviceUUID, VK_UUID_SIZE, hash);
+  hash          = hashFile(filename, hash);
+
+  // The geometry of a .gltf is in its external buffers
+  const std::filesystem::path basedir = std::filesystem::path(filename).parent_path();
+  for(const tinygltf::Buffer& buffer : model.buffers)
+  {
+    if(!buffer.uri.empty() && buffer.uri.compare(0, 5, "data:") != 0)
+    {
+      std::string uri;
+      tinygltf::URIDecode(buffer.uri, &uri, nullptr);
+      hash = hashFile((basedir / uri).string(), hash);
+    }
+  }
+  return hash;
+}
+
+std::string AccelCache::getPath(uint64_t key, const char* extension)
+{
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx.%s", static_cast<unsigned long long>(key), extension);
+  return (std::filesystem::temp_directory_path() / "vk_denoise_nrd_cache" / name).string();
+}
+
+bool AccelCache::open(uint64_t key, size_t blasCount)
+{
+  close();
+  if(!m_file.open(getPath(key)))
+  {
+    return false;
+  }
+
+  Header header{};
+  if(m_file.size() < sizeof(Header))
+  {
+    close();
+    return false;
+  }
+  memcpy(&header, m_file.data(), sizeof(Header));
+  if(header.magic != kMagic || header.version != kVersion || header.key != key || header.blasCount != blasCount
+     || header.dataOffset + header.dataSize > m_file.size() || sizeof(Header) + blasCount * sizeof(Entry) > header.dataOffset)
+  {
+    LOGW("AccelCache: ignoring %s, made for another scene or version\n", getPath(key).c_str());
+    close();
+    return false;
+  }
+
+  const uint8_t* entries = m_file.data() + sizeof(Header);
+  m_offsets.resize(blasCount);
+  for(size_t b = 0; b < blasCount; ++b)
+  {
+    Entry entry;
+    memcpy(&entry, entries + b * sizeof(Entry), sizeof(Entry));
+    if(entry.offset + entry.size > header.dataSize || entry.size < 2 * VK_UUID_SIZE + 2 * sizeof(uint64_t))
+    {
+      close();
+      return false;
+    }
+    m_offsets[b] = entry.offset;
+  }
+
+  m_data     = m_file.data() + header.dataOffset;
+  m_dataSize = header.dataSize;
+  return true;
+}
+
+void AccelCache::close()
+{
+  m_file.close();
+  m_data     = nullptr;
+  m_dataSize = 0;
+  m_offsets.clear();
+}
+
+bool AccelCache::isCompatible(VkDevice device) const
+{
+  if(!isOpen())
+  {
+    return false;
+  }
+
+  // All BLAS come from the same driver: the version of the first one is representative
+  if(m_offsets.empty())
+  {
+    return true;
+  }
+  VkAccelerationStructureVersionInfoKHR version{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_VERSION_INFO_KHR};
+  version.pVersionData = m_data + m_offsets[0];  // driver UUID and compatibility UUID
+  VkAccelerationStructureCompatibilityKHR compatibility = VK_ACCELERATION_STRUCTURE_COMPATIBILITY_INCOMPATIBLE_KHR;
+  vkGetDeviceAccelerationStructureCompatibilityKHR(device, &version, &compatibility);
+  return compatibility == VK_ACCELERATION_STRUCTURE_COMPATIBILITY_COMPATIBLE_KHR;
+}
+
+bool AccelCache::write(uint64_t key, const std::vector<uint8_t>& data, const std::vector<VkDeviceSize>& offsets)
+{
+  namespace fs          = std::filesystem;
+  const std::string path = getPath(key);
+  std::error_code   ec;
+  fs::create_directories(fs::path(path).parent_path(), ec);
+
+  Header header{};
+  header.magic      = kMagic;
+  header.version    = kVersion;
+  header.key        = key;
+  header.blasCount  = offsets.size();
+  header.dataOffset = alignUp(sizeof(Header) + offsets.size() * sizeof(Entry));
+  header.dataSize   = data.size();
+
+  // Written next to the final file and renamed, so that a reader never maps a partial file
+  const std::string tmpPath = path + ".tmp";
+  {
+    std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+    if(!out)
+    {
+      fs::remove(tmpPath, ec);
+      return false;
+    }
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for(size_t b = 0; b < offsets.size(); ++b)
+    {
+      const VkDeviceSize end = b + 1 < offsets.size() ? offsets[b + 1] : data.size();
+      Entry              entry{offsets[b], end - offsets[b]};
+      out.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+    }
+    const std::vector<char> padding(header.dataOffset - sizeof(Header) - offsets.size() * sizeof(Entry), 0);
+    out.write(padding.data(), padding.size());
+    out.write(reinterpret_cast<const char*>(data.data()), data.size());
+    out.close();
+    if(!out)
+    {
+      fs::remove(tmpPath, ec);
+      return false;
+    }
+  }
+  fs::rename(tmpPath, path, ec);
+  if(ec)
+  {
+    fs::remove(tmpPath, ec);
+    return false;
+  }
+  return true;
+}
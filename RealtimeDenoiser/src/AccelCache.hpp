@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan_core.h>
+
+#include "MappedFile.hpp"
+
+namespace tinygltf {
+class Model;
+}
+
+/* On-disk cache of the serialized BLAS of a scene (vkCmdCopyAccelerationStructureToMemoryKHR).
+ *
+ * A cache file is identified by a key hashing the glTF file and its external buffers, the build
+ * flags and the device. It is memory mapped when opened, and the serialized BLAS are uploaded
+ * straight from the mapping. Whether the driver accepts the data is checked with
+ * vkGetDeviceAccelerationStructureCompatibilityKHR; otherwise the BLAS are rebuilt and the file
+ * is replaced.
+ *
+ * Layout: Header, then one Entry per BLAS, then the serialized BLAS at 256-byte aligned offsets
+ * (the alignment vkCmdCopyMemoryToAccelerationStructureKHR requires of its source).
+ */
+class AccelCache
+{
+public:
+  static constexpr VkDeviceSize kAlignment = 256;
+
+  /* 64-bit hash of a block of memory, chained through 'hash' */
+  static uint64_t hashData(const uint8_t* data, size_t size, uint64_t hash);
+
+  static uint64_t computeKey(const std::string&                   filename,
+                             const tinygltf::Model&               model,
+                             VkBuildAccelerationStructureFlagsKHR flags,
+                             const uint8_t                        deviceUUID[VK_UUID_SIZE]);
+
+  /* Map the cache file of 'key', if there is one holding 'blasCount' BLAS */
+  bool open(uint64_t key, size_t blasCount);
+  void close();
+  bool isOpen() const { return m_file.isOpen(); }
+
+  /* True if 'device' can deserialize the data of the cache */
+  bool isCompatible(VkDevice device) const;
+
+  /* The serialized BLAS, 'offsets' being relative to getData() */
+  const uint8_t*                   getData() const { return m_data; }
+  size_t                           getDataSize() const { return m_dataSize; }
+  const std::vector<VkDeviceSize>& getOffsets() const { return m_offsets; }
+
+  /* Write the cache file of 'key', from serialized BLAS packed as described by 'offsets' */
+  static bool write(uint64_t key, const std::vector<uint8_t>& data, const std::vector<VkDeviceSize>& offsets);
+
+  /* File of 'key' in the cache directory of the sample, also holding the caches of HdrEnvironment */
+  static std::string getPath(uint64_t key, const char* extension = "blas");
+
+private:
+  struct Header
+  {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+    uint64_t blasCount;
+    uint64_t dataOffset;  // from the start of the file, aligned to kAlignment
+    uint64_t dataSize;
+  };
+  struct Entry
+  {
+    uint64_t offset;  // from the start of the data
+    uint64_t size;
+  };
+  static constexpr uint32_t kMagic   = 0x41534E56;  // "VNSA"
+  static constexpr uint32_t kVersion = 2;  // 2: one BLAS per unique geometry
+
+  MappedFile                m_file;
+  const uint8_t*            m_data     = nullptr;
+  size_t                    m_dataSize = 0;
+  std::vector<VkDeviceSize> m_offsets;
+};
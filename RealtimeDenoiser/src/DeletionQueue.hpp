@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <stdint.h>
+
+/* Defers the destruction of GPU resources until the frames that may still use them are done.
+ *
+ * Each entry is tagged with the serial of the frame during which it was retired. The frames in
+ * flight at that point are the only ones that can reference it, so the entry can be destroyed once
+ * 'latency' more frames have started: starting a frame waits for the fence of the frame that
+ * previously used the same frame cycle slot.
+ * This replaces the vkDeviceWaitIdle calls that were otherwise needed before replacing a resource.
+ */
+class DeletionQueue
+{
+public:
+  /* 'latency' is the number of frames that can be in flight, typically the frame cycle size of the application */
+  explicit DeletionQueue(uint32_t latency = 3)
+      : m_latency(latency)
+  {
+  }
+
+  /* Everything still queued is destroyed. The caller must make sure the device is idle. */
+  ~DeletionQueue() { flush(); }
+
+  void setLatency(uint32_t latency) { m_latency = latency; }
+
+  /* Queue a function releasing resources that may still be in use by frames in flight */
+  void push(std::function<void()>&& deleter) { m_entries.push_back({m_serial, std::move(deleter)}); }
+
+  /* Take the ownership of 'object' (which is left empty), and destroy it once it is safe to do so */
+  template <typename T>
+  void retire(std::unique_ptr<T>& object)
+  {
+    if(object)
+    {
+      std::shared_ptr<T> retired(std::move(object));
+      push([retired]() mutable { retired.reset(); });
+    }
+  }
+
+  /* To be called once per frame, after the frame's fence was waited on and before recording it */
+  void nextFrame()
+  {
+    ++m_serial;
+    while(!m_entries.empty() && m_serial >= m_entries.front().serial + m_latency)
+    {
+      m_entries.front().deleter();
+      m_entries.pop_front();
+    }
+  }
+
+  /* Destroy everything immediately. The caller must make sure the device is idle. */
+  void flush()
+  {
+    for(auto& e : m_entries)
+    {
+      e.deleter();
+    }
+    m_entries.clear();
+  }
+
+private:
+  struct Entry
+  {
+    uint64_t              serial;
+    std::function<void()> deleter;
+  };
+
+  std::deque<Entry> m_entries;
+  uint64_t          m_serial  = 0;
+  uint32_t          m_latency = 3;
+};
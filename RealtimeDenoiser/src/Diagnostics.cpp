@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "Diagnostics.hpp"
+
+#include <nvvk/debug_util_vk.hpp>
+#include <nvh/nvprint.hpp>
+
+#include <NRD.h>
+
+#include <cassert>
+#include <vector>
+
+Diagnostics::Diagnostics(VkDevice device, nvvk::ResourceAllocator* alloc, DeletionQueue& deletionQueue)
+    : m_device(device)
+    , m_alloc(alloc)
+    , m_deletionQueue(deletionQueue)
+{
+}
+
+bool Diagnostics::setActive(bool active, VkExtent2D size)
+{
+  if(active == isActive())
+  {
+    return false;
+  }
+
+  if(!active)
+  {
+    m_deletionQueue.retire(m_buffers);
+    LOGI("Diagnostics: released debug images\n");
+    return true;
+  }
+
+  std::vector<VkFormat> color_buffers(eNumBuffers);
+  color_buffers[eNrdValidation] = VK_FORMAT_R8G8B8A8_UNORM;
+
+  m_buffers = std::make_unique<nvvkhl::GBuffer>(m_device, m_alloc, size, color_buffers, VK_FORMAT_UNDEFINED);
+
+  nvvk::DebugUtil dutil(m_device);
+  for(uint32_t b = 0; b < eNumBuffers; ++b)
+  {
+    dutil.setObjectName(m_buffers->getColorImage(b), getName(Buffer(b)));
+  }
+
+  LOGI("Diagnostics: allocated debug images (%dx%d)\n", size.width, size.height);
+  return true;
+}
+
+void Diagnostics::resize(VkExtent2D size)
+{
+  if(isActive())
+  {
+    setActive(false, size);
+    setActive(true, size);
+  }
+}
+
+VkImage Diagnostics::getImage(Buffer buffer) const
+{
+  assert(buffer < eNumBuffers);
+  return isActive() ? m_buffers->getColorImage(buffer) : VK_NULL_HANDLE;
+}
+
+VkDescriptorSet Diagnostics::getDescriptorSet(Buffer buffer) const
+{
+  assert(buffer < eNumBuffers);
+  return isActive() ? m_buffers->getDescriptorSet(buffer) : VK_NULL_HANDLE;
+}
+
+nvvk::Texture Diagnostics::getTexture(Buffer buffer) const
+{
+  assert(buffer < eNumBuffers);
+  if(!isActive())
+  {
+    return {};
+  }
+  return {m_buffers->getColorImage(buffer), nvvk::NullMemHandle, m_buffers->getDescriptorImageInfo(buffer)};
+}
+
+const char* Diagnostics::getName(Buffer buffer)
+{
+  switch(buffer)
+  {
+    case eNrdValidation:
+      return nrd::GetResourceTypeString(nrd::ResourceType::OUT_VALIDATION);
+    default:
+      return "Unknown";
+  }
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <memory>
+
+#include <nvvk/resourceallocator_vk.hpp>
+#include "nvvkhl/gbuffer.hpp"
+
+#include "DeletionQueue.hpp"
+
+class Diagnostics
+{
+public:
+  /* Images that are only of interest while debugging.
+   * Each entry maps to one color image of the diagnostics G-Buffer.
+   */
+  enum Buffer
+  {
+    eNrdValidation,  // NRD validation overlay (nrd::ResourceType::OUT_VALIDATION)
+
+    eNumBuffers,
+    eNone = eNumBuffers
+  };
+
+  /* The diagnostic images are not allocated up front. They get created when a diagnostic view
+   * is selected and released as soon as it is deselected, so that regular rendering neither pays
+   * for their memory nor for the passes writing them.
+   */
+  Diagnostics(VkDevice device, nvvk::ResourceAllocator* alloc, DeletionQueue& deletionQueue);
+
+  /* Allocate the diagnostic images with the given size, or release them.
+   * Returns true if the allocation state changed.
+   * Released images go through the deletion queue, as frames in flight may still be using them.
+   */
+  bool setActive(bool active, VkExtent2D size);
+  bool isActive() const { return m_buffers != nullptr; }
+
+  /* Recreate the images with the new size, if they are currently allocated */
+  void resize(VkExtent2D size);
+
+  /* Accessors, returning null handles while the images are not allocated */
+  VkImage         getImage(Buffer buffer) const;
+  VkDescriptorSet getDescriptorSet(Buffer buffer) const;
+  nvvk::Texture   getTexture(Buffer buffer) const;  // in the form NRD's user texture pool expects
+
+  static const char* getName(Buffer buffer);
+
+private:
+  VkDevice                         m_device = VK_NULL_HANDLE;
+  nvvk::ResourceAllocator*         m_alloc  = nullptr;
+  DeletionQueue&                   m_deletionQueue;
+  std::unique_ptr<nvvkhl::GBuffer> m_buffers;
+};
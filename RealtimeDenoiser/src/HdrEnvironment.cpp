@@ -0,0 +1,569 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "HdrEnvironment.hpp"
+
+#include <nvh/nvprint.hpp>
+#include <nvvk/commands_vk.hpp>
+#include <nvvk/debug_util_vk.hpp>
+#include <nvvk/images_vk.hpp>
+
+#include "AccelCache.hpp"
+#include "MappedFile.hpp"
+#include "stb_image.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdint.h>
+
+using nvvkhl_shaders::EnvAccel;
+
+namespace {
+
+constexpr float kPi = 3.14159265358979323846F;
+
+// The sun is the connected region around the brightest texel that is above this fraction of its luminance ...
+constexpr float kSunThreshold = 0.05F;
+// ... and it must stand out from the average of the environment, otherwise there is nothing to extract
+constexpr float kSunMinContrast = 100.F;
+// Larger regions are bright skies or windows rather than a sun, they are left in the importance map (~4 degrees radius)
+constexpr float kSunMaxSolidAngle = 0.015F;
+// The real sun has a radius of about 0.27 degrees, don't let tiny maps make it a point light
+constexpr float kSunMinAngularRadius = 0.0047F;
+
+float luminance(const float* rgb)
+{
+  return 0.2126F * rgb[0] + 0.7152F * rgb[1] + 0.0722F * rgb[2];
+}
+
+// Direction of the texel center (x,y), matching getSphericalUv() in the shaders
+glm::vec3 texelDirection(uint32_t x, uint32_t y, uint32_t width, uint32_t height)
+{
+  const float phi      = ((float(x) + 0.5F) / float(width) - 0.5F) * 2.F * kPi;
+  const float latitude = ((float(y) + 0.5F) / float(height) - 0.5F) * kPi;
+  return {cosf(latitude) * cosf(phi), -sinf(latitude), cosf(latitude) * sinf(phi)};
+}
+
+// Solid angle covered by each texel of row 'y'
+float rowSolidAngle(uint32_t y, uint32_t width, uint32_t height)
+{
+  const float lat0 = (float(y) / float(height) - 0.5F) * kPi;
+  const float lat1 = (float(y + 1) / float(height) - 0.5F) * kPi;
+  return (sinf(lat1) - sinf(lat0)) * 2.F * kPi / float(width);
+}
+
+float maxComponent(const float* rgb)
+{
+  return std::max(rgb[0], std::max(rgb[1], rgb[2]));
+}
+
+// Vose's alias method: entry i is picked with probability q, or its alias otherwise.
+// The entries are set up by rows of 'rowSize' on the workers, only the pairing is sequential.
+// Returns the sum of the importance values.
+float buildAliasMap(const std::vector<float>& importance, std::vector<EnvAccel>& accel, uint32_t rowSize, ThreadPool& threads)
+{
+  const uint32_t size = static_cast<uint32_t>(importance.size());
+  const uint32_t rows = size / rowSize;
+
+  // Summed per row, then over the rows in order, so that the result does not depend on the scheduling
+  std::vector<double> rowSums(rows, 0.0);
+  threads.parallelFor(rows, [&](uint32_t r) {
+    double sum = 0.0;
+    for(uint32_t i = r * rowSize; i < (r + 1) * rowSize; ++i)
+    {
+      sum += importance[i];
+    }
+    rowSums[r] = sum;
+  });
+  double sum = 0.0;
+  for(double rowSum : rowSums)
+  {
+    sum += rowSum;
+  }
+
+  const float scale = sum > 0.0 ? float(double(size) / sum) : 0.F;
+  threads.parallelFor(rows, [&](uint32_t r) {
+    for(uint32_t i = r * rowSize; i < (r + 1) * rowSize; ++i)
+    {
+      accel[i].alias = i;
+      accel[i].q     = sum > 0.0 ? importance[i] * scale : 1.F;
+    }
+  });
+
+  std::vector<uint32_t> small;
+  std::vector<uint32_t> large;
+  for(uint32_t i = 0; i < size; ++i)
+  {
+    (accel[i].q < 1.F ? small : large).push_back(i);
+  }
+
+  while(!small.empty() && !large.empty())
+  {
+    const uint32_t s = small.back();
+    small.pop_back();
+    const uint32_t l = large.back();
+
+    accel[s].alias = l;
+    accel[l].q     = (accel[l].q + accel[s].q) - 1.F;
+    if(accel[l].q < 1.F)
+    {
+      large.pop_back();
+      small.push_back(l);
+    }
+  }
+
+  // Remaining entries only differ from 1 by rounding errors
+  for(uint32_t i : small)
+  {
+    accel[i].q = 1.F;
+  }
+  for(uint32_t i : large)
+  {
+    accel[i].q = 1.F;
+  }
+
+  return float(sum);
+}
+
+/* Cache file: CacheHeader, the indices of the sun texels, then the alias table */
+constexpr uint32_t kCacheMagic   = 0x56454E56;  // "VNEV"
+constexpr uint32_t kCacheVersion = 1;
+
+struct CacheHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t key;
+  uint32_t width;
+  uint32_t height;
+  float    integral;
+  uint32_t sunValid;
+  float    sunDirection[3];
+  float    sunAngularRadius;
+  float    sunRadiance[3];
+  float    sunFill[3];
+  uint32_t sunTexels;
+};
+
+// Content of the .hdr file, and the options changing the tables
+uint64_t computeCacheKey(const MappedFile& file, bool extractSun)
+{
+  const uint64_t options[] = {kCacheVersion, extractSun ? 1u : 0u, file.size()};
+  uint64_t       hash      = 0xCBF29CE484222325ull;
+  hash = AccelCache::hashData(reinterpret_cast<const uint8_t*>(options), sizeof(options), hash);
+  return AccelCache::hashData(file.data(), file.size(), hash);
+}
+
+}  // namespace
+
+HdrEnvironment::HdrEnvironment(VkDevice device, nvvk::ResourceAllocator* alloc, ThreadPool& threads, uint32_t queueFamilyIndex)
+    : m_device(device)
+    , m_alloc(alloc)
+    , m_threads(threads)
+    , m_queueFamilyIndex(queueFamilyIndex)
+    , m_descSet(device)
+{
+}
+
+HdrEnvironment::~HdrEnvironment()
+{
+  destroy();
+}
+
+void HdrEnvironment::loadEnvironment(const std::string& filename, bool extractSun)
+{
+  destroy();
+
+  // The file is decoded from the same mapping it is hashed from
+  MappedFile file;
+  int        width    = 0;
+  int        height   = 0;
+  int        channels = 0;
+  float*     data     = nullptr;
+  if(!filename.empty() && file.open(filename))
+  {
+    data = stbi_loadf_from_memory(file.data(), static_cast<int>(file.size()), &width, &height, &channels, STBI_rgb_alpha);
+  }
+
+  std::vector<float> pixels;
+  uint64_t           cacheKey = 0;
+  if(data != nullptr)
+  {
+    pixels.assign(data, data + size_t(width) * size_t(height) * 4);
+    stbi_image_free(data);
+    cacheKey = computeCacheKey(file, extractSun);
+    LOGI("HdrEnvironment: loaded %s (%dx%d)\n", filename.c_str(), width, height);
+  }
+  else
+  {
+    if(!filename.empty())
+    {
+      LOGE("HdrEnvironment: failed to load %s\n", filename.c_str());
+    }
+    width  = 1;
+    height = 1;
+    pixels = {1.F, 1.F, 1.F, 1.F};
+  }
+  m_size = {uint32_t(width), uint32_t(height)};
+  file.close();
+
+  const auto            start = std::chrono::steady_clock::now();
+  std::vector<EnvAccel> accel;
+  if(cacheKey != 0 && readCache(cacheKey, pixels, accel))
+  {
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    LOGI("HdrEnvironment: importance sampling tables read from the cache in %.1f ms\n", ms);
+  }
+  else
+  {
+    SunRemoval removal;
+    m_sun = extractSun ? this->extractSun(pixels, removal) : Sun{};
+    buildEnvironmentAccel(pixels, accel);
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    LOGI("HdrEnvironment: importance sampling tables built in %.1f ms\n", ms);
+    if(cacheKey != 0)
+    {
+      writeCache(cacheKey, removal, accel);
+    }
+  }
+  upload(pixels, accel);
+  createDescriptorSet();
+}
+
+HdrEnvironment::Sun HdrEnvironment::extractSun(std::vector<float>& pixels, SunRemoval& removal) const
+{
+  const uint32_t width  = m_size.width;
+  const uint32_t height = m_size.height;
+  const uint32_t count  = width * height;
+
+  // Brightest texel and average luminance, per row on the workers and then over the rows
+  struct RowStats
+  {
+    uint32_t brightest{0};
+    float    maxLum{0.F};
+    double   sumLum{0.0};
+  };
+  std::vector<RowStats> rows(height);
+  m_threads.parallelFor(height, [&](uint32_t y) {
+    RowStats& row = rows[y];
+    for(uint32_t x = 0; x < width; ++x)
+    {
+      const uint32_t i   = y * width + x;
+      const float    lum = luminance(&pixels[i * 4]);
+      row.sumLum += lum;
+      if(lum > row.maxLum)
+      {
+        row.maxLum    = lum;
+        row.brightest = i;
+      }
+    }
+  });
+
+  uint32_t brightest = 0;
+  float    maxLum    = 0.F;
+  double   sumLum    = 0.0;
+  double   sumSolid  = 0.0;
+  for(uint32_t y = 0; y < height; ++y)
+  {
+    const float solidAngle = rowSolidAngle(y, width, height);
+    sumLum += rows[y].sumLum * solidAngle;
+    sumSolid += double(solidAngle) * width;
+    if(rows[y].maxLum > maxLum)
+    {
+      maxLum    = rows[y].maxLum;
+      brightest = rows[y].brightest;
+    }
+  }
+  const float avgLum = float(sumLum / sumSolid);
+  if(maxLum <= 0.F || maxLum < avgLum * kSunMinContrast)
+  {
+    return {};
+  }
+
+  // Flood fill the region around the brightest texel, wrapping around horizontally
+  const float           threshold = maxLum * kSunThreshold;
+  std::vector<uint8_t>  inSun(count, 0);
+  std::vector<uint32_t> region;
+  std::vector<uint32_t> border;
+  std::vector<uint32_t> stack{brightest};
+  inSun[brightest] = 1;
+  float solidAngle = 0.F;
+  while(!stack.empty())
+  {
+    const uint32_t i = stack.back();
+    stack.pop_back();
+    region.push_back(i);
+
+    const uint32_t x = i % width;
+    const uint32_t y = i / width;
+    solidAngle += rowSolidAngle(y, width, height);
+    if(solidAngle > kSunMaxSolidAngle)
+    {
+      return {};
+    }
+
+    for(int dy = -1; dy <= 1; ++dy)
+    {
+      const int ny = int(y) + dy;
+      if(ny < 0 || ny >= int(height))
+        continue;
+      for(int dx = -1; dx <= 1; ++dx)
+      {
+        const uint32_t nx = (x + width + dx) % width;
+        const uint32_t n  = uint32_t(ny) * width + nx;
+        if(inSun[n] != 0)
+          continue;
+        if(luminance(&pixels[n * 4]) > threshold)
+        {
+          inSun[n] = 1;
+          stack.push_back(n);
+        }
+        else
+        {
+          inSun[n] = 2;  // visited, not part of the sun
+          border.push_back(n);
+        }
+      }
+    }
+  }
+
+  // The sun texels get replaced by the sky surrounding them
+  glm::vec3 fill(0.F);
+  for(uint32_t n : border)
+  {
+    fill += glm::vec3(pixels[n * 4 + 0], pixels[n * 4 + 1], pixels[n * 4 + 2]);
+  }
+  fill /= float(std::max<size_t>(border.size(), 1));
+  removal.fill = fill;
+
+  // Power removed from the map, and its luminance weighted direction
+  glm::vec3 power(0.F);
+  glm::vec3 direction(0.F);
+  for(uint32_t i : region)
+  {
+    const uint32_t  x     = i % width;
+    const uint32_t  y     = i / width;
+    float*          rgb   = &pixels[i * 4];
+    const glm::vec3 delta = glm::max(glm::vec3(rgb[0], rgb[1], rgb[2]) - fill, glm::vec3(0.F));
+    const float     area  = rowSolidAngle(y, width, height);
+
+    power += delta * area;
+    direction += texelDirection(x, y, width, height) * luminance(&delta.x) * area;
+    rgb[0] = fill.x;
+    rgb[1] = fill.y;
+    rgb[2] = fill.z;
+  }
+  removal.texels = std::move(region);
+
+  // A disk of the same solid angle, emitting the same power
+  Sun sun;
+  sun.direction     = glm::normalize(direction);
+  sun.angularRadius = std::max(acosf(std::max(1.F - solidAngle / (2.F * kPi), -1.F)), kSunMinAngularRadius);
+  sun.radiance      = power / (2.F * kPi * (1.F - cosf(sun.angularRadius)));
+  sun.valid         = true;
+
+  LOGI("HdrEnvironment: extracted sun of %.2f degrees from %zu texels\n", glm::degrees(sun.angularRadius), removal.texels.size());
+  return sun;
+}
+
+void HdrEnvironment::buildEnvironmentAccel(std::vector<float>& pixels, std::vector<EnvAccel>& accel)
+{
+  const uint32_t width  = m_size.width;
+  const uint32_t height = m_size.height;
+  const uint32_t count  = width * height;
+
+  // Importance of each texel is its radiance weighted by the solid angle it covers
+  std::vector<float> importance(count);
+  m_threads.parallelFor(height, [&](uint32_t y) {
+    const float solidAngle = rowSolidAngle(y, width, height);
+    for(uint32_t i = y * width; i < (y + 1) * width; ++i)
+    {
+      importance[i] = solidAngle * maxComponent(&pixels[i * 4]);
+    }
+  });
+
+  accel.resize(count);
+  m_integral = buildAliasMap(importance, accel, width, m_threads);
+
+  // Pdf of sampling a direction within each texel, also stored in the alpha channel for the MIS weights
+  const float invIntegral = m_integral > 0.F ? 1.F / m_integral : 0.F;
+  m_threads.parallelFor(height, [&](uint32_t y) {
+    for(uint32_t i = y * width; i < (y + 1) * width; ++i)
+    {
+      accel[i].pdf      = maxComponent(&pixels[i * 4]) * invIntegral;
+      pixels[i * 4 + 3] = accel[i].pdf;
+    }
+  });
+  m_threads.parallelFor(height, [&](uint32_t y) {
+    for(uint32_t i = y * width; i < (y + 1) * width; ++i)
+    {
+      accel[i].aliasPdf = accel[accel[i].alias].pdf;
+    }
+  });
+}
+
+bool HdrEnvironment::readCache(uint64_t key, std::vector<float>& pixels, std::vector<EnvAccel>& accel)
+{
+  MappedFile file;
+  if(!file.open(AccelCache::getPath(key, "env")) || file.size() < sizeof(CacheHeader))
+  {
+    return false;
+  }
+
+  CacheHeader header{};
+  memcpy(&header, file.data(), sizeof(header));
+  const size_t count = size_t(m_size.width) * m_size.height;
+  if(header.magic != kCacheMagic || header.version != kCacheVersion || header.key != key || header.width != m_size.width
+     || header.height != m_size.height
+     || file.size() != sizeof(CacheHeader) + header.sunTexels * sizeof(uint32_t) + count * sizeof(EnvAccel))
+  {
+    LOGW("HdrEnvironment: ignoring %s, made for another file or version\n", AccelCache::getPath(key, "env").c_str());
+    return false;
+  }
+
+  const uint8_t* texels = file.data() + sizeof(CacheHeader);
+  accel.resize(count);
+  memcpy(accel.data(), texels + header.sunTexels * sizeof(uint32_t), count * sizeof(EnvAccel));
+
+  // The sun is removed from the pixels again, as when the tables were built
+  for(uint32_t t = 0; t < header.sunTexels; ++t)
+  {
+    uint32_t i;
+    memcpy(&i, texels + t * sizeof(uint32_t), sizeof(i));
+    if(i < count)
+    {
+      memcpy(&pixels[size_t(i) * 4], header.sunFill, sizeof(header.sunFill));
+    }
+  }
+  m_threads.parallelFor(m_size.height, [&](uint32_t y) {
+    for(size_t i = size_t(y) * m_size.width; i < size_t(y + 1) * m_size.width; ++i)
+    {
+      pixels[i * 4 + 3] = accel[i].pdf;
+    }
+  });
+
+  m_integral          = header.integral;
+  m_sun.valid         = header.sunValid != 0;
+  m_sun.direction     = glm::vec3(header.sunDirection[0], header.sunDirection[1], header.sunDirection[2]);
+  m_sun.angularRadius = header.sunAngularRadius;
+  m_sun.radiance      = glm::vec3(header.sunRadiance[0], header.sunRadiance[1], header.sunRadiance[2]);
+  return true;
+}
+
+void HdrEnvironment::writeCache(uint64_t key, const SunRemoval& removal, const std::vector<EnvAccel>& accel) const
+{
+  namespace fs           = std::filesystem;
+  const std::string path = AccelCache::getPath(key, "env");
+  std::error_code   ec;
+  fs::create_directories(fs::path(path).parent_path(), ec);
+
+  CacheHeader header{};
+  header.magic            = kCacheMagic;
+  header.version          = kCacheVersion;
+  header.key              = key;
+  header.width            = m_size.width;
+  header.height           = m_size.height;
+  header.integral         = m_integral;
+  header.sunValid         = m_sun.valid ? 1 : 0;
+  header.sunAngularRadius = m_sun.angularRadius;
+  header.sunTexels        = static_cast<uint32_t>(removal.texels.size());
+  memcpy(header.sunDirection, &m_sun.direction.x, sizeof(header.sunDirection));
+  memcpy(header.sunRadiance, &m_sun.radiance.x, sizeof(header.sunRadiance));
+  memcpy(header.sunFill, &removal.fill.x, sizeof(header.sunFill));
+
+  // Written next to the final file and renamed, so that a reader never maps a partial file
+  const std::string tmpPath = path + ".tmp";
+  {
+    std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(removal.texels.data()), removal.texels.size() * sizeof(uint32_t));
+    out.write(reinterpret_cast<const char*>(accel.data()), accel.size() * sizeof(EnvAccel));
+    if(!out)
+    {
+      LOGW("HdrEnvironment: could not write %s\n", path.c_str());
+      fs::remove(tmpPath, ec);
+      return;
+    }
+  }
+  fs::rename(tmpPath, path, ec);
+  if(ec)
+  {
+    fs::remove(tmpPath, ec);
+  }
+}
+
+// Not staged in the StagingRing: a 32-bit float environment is often larger than the whole ring, and
+// its mip chain is generated with blits, which the transfer queue cannot do.
+void HdrEnvironment::upload(const std::vector<float>& pixels, const std::vector<EnvAccel>& accel)
+{
+  nvvk::CommandPool cpool(m_device, m_queueFamilyIndex);
+  VkCommandBuffer   cmd = cpool.createCommandBuffer();
+  {
+    // The mip chain holds prefiltered versions of the environment for the rays with a wide footprint
+    VkImageCreateInfo imageInfo = nvvk::makeImage2DCreateInfo(m_size, VK_FORMAT_R32G32B32A32_SFLOAT, VK_IMAGE_USAGE_SAMPLED_BIT, true);
+    nvvk::Image       image     = m_alloc->createImage(cmd, pixels.size() * sizeof(float), pixels.data(), imageInfo);
+    nvvk::cmdGenerateMipmaps(cmd, image.image, imageInfo.format, m_size, imageInfo.mipLevels);
+
+    VkSamplerCreateInfo samplerInfo{VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
+    samplerInfo.minFilter    = VK_FILTER_LINEAR;
+    samplerInfo.magFilter    = VK_FILTER_LINEAR;
+    samplerInfo.mipmapMode   = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.maxLod       = VK_LOD_CLAMP_NONE;
+
+    VkImageViewCreateInfo viewInfo = nvvk::makeImageViewCreateInfo(image.image, imageInfo);
+    m_texture                      = m_alloc->createTexture(image, viewInfo, samplerInfo);
+
+    m_accel = m_alloc->createBuffer(cmd, accel, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+  }
+  cpool.submitAndWait(cmd);
+  m_alloc->finalizeAndReleaseStaging();
+
+  nvvk::DebugUtil dutil(m_device);
+  dutil.setObjectName(m_texture.image, "HdrEnvironment");
+  dutil.setObjectName(m_accel.buffer, "HdrEnvironmentAccel");
+}
+
+void HdrEnvironment::createDescriptorSet()
+{
+  m_descSet.deinit();
+  m_descSet.addBinding(nvvkhl_shaders::EnvBindings::eHdr, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_ALL);
+  m_descSet.addBinding(nvvkhl_shaders::EnvBindings::eImpSamples, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_ALL);
+  m_descSet.initLayout();
+  m_descSet.initPool(1);
+
+  VkDescriptorBufferInfo           accelInfo{m_accel.buffer, 0, VK_WHOLE_SIZE};
+  std::vector<VkWriteDescriptorSet> writes;
+  writes.emplace_back(m_descSet.makeWrite(0, nvvkhl_shaders::EnvBindings::eHdr, &m_texture.descriptor));
+  writes.emplace_back(m_descSet.makeWrite(0, nvvkhl_shaders::EnvBindings::eImpSamples, &accelInfo));
+  vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+}
+
+void HdrEnvironment::destroy()
+{
+  m_descSet.deinit();
+  m_alloc->destroy(m_texture);
+  m_alloc->destroy(m_accel);
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <nvvk/descriptorsets_vk.hpp>
+#include <nvvk/resourceallocator_vk.hpp>
+
+#include "nvvkhl/shaders/dh_hdr.h"
+
+#include "ThreadPool.hpp"
+
+/* HDR environment light, with the same descriptor set layout as nvvkhl::HdrEnv
+ * (EnvBindings::eHdr with the pdf in alpha, EnvBindings::eImpSamples with the alias table),
+ * so that the nvvkhl environment sampling shaders can be used unchanged.
+ * The texture has a full mip chain, used by the miss shaders to filter the environment over the
+ * footprint of wide ray cones (see shaders/environment.glsl).
+ *
+ * In addition, the sun can be extracted from the map when loading: the brightest compact region
+ * is replaced by its surroundings before the importance map is built, and returned as an analytic
+ * disk light. A sun covering a few texels is poorly sampled through the importance map, while
+ * sampling its cone directly is noise-free for unoccluded points.
+ *
+ * The per-texel work is split by rows over the workers of a ThreadPool. The resulting tables (alias
+ * table, integral and extracted sun) are also cached on disk, keyed by a hash of the .hdr file, so
+ * that loading an environment again only decodes it and uploads the cached tables.
+ */
+class HdrEnvironment
+{
+public:
+  struct Sun
+  {
+    glm::vec3 direction{0.F, 1.F, 0.F};  // in environment space, before the environment rotation
+    float     angularRadius{0.F};         // in radians
+    glm::vec3 radiance{0.F};              // radiance of the disk, before the environment intensity
+    bool      valid{false};
+  };
+
+  HdrEnvironment(VkDevice device, nvvk::ResourceAllocator* alloc, ThreadPool& threads, uint32_t queueFamilyIndex = 0);
+  ~HdrEnvironment();
+
+  /* Load an equirectangular .hdr file. An empty filename, or a file that cannot be loaded,
+   * results in a uniform white environment.
+   * With 'extractSun', the sun found in the map is removed from it and reported by getSun().
+   */
+  void loadEnvironment(const std::string& filename, bool extractSun = true);
+
+  VkDescriptorSetLayout getDescriptorSetLayout() const { return m_descSet.getLayout(); }
+  VkDescriptorSet       getDescriptorSet() const { return m_descSet.getSet(0); }
+
+  /* Radiance integrated over the sphere (of the maximum color component), after the sun removal */
+  float             getIntegral() const { return m_integral; }
+  const Sun&        getSun() const { return m_sun; }
+  const VkExtent2D& getSize() const { return m_size; }
+
+private:
+  // Texels of the sun and the color replacing them, to remove the sun again from the cached tables
+  struct SunRemoval
+  {
+    std::vector<uint32_t> texels;
+    glm::vec3             fill{0.F};
+  };
+
+  // Find the sun in the RGBA32F 'pixels', remove it from there and return its description
+  Sun extractSun(std::vector<float>& pixels, SunRemoval& removal) const;
+  // Build the alias table and store the per-texel pdf in the alpha channel of 'pixels'
+  void buildEnvironmentAccel(std::vector<float>& pixels, std::vector<nvvkhl_shaders::EnvAccel>& accel);
+  void upload(const std::vector<float>& pixels, const std::vector<nvvkhl_shaders::EnvAccel>& accel);
+  void createDescriptorSet();
+  void destroy();
+
+  // Cache of the tables of a .hdr file, see loadEnvironment()
+  bool readCache(uint64_t key, std::vector<float>& pixels, std::vector<nvvkhl_shaders::EnvAccel>& accel);
+  void writeCache(uint64_t key, const SunRemoval& removal, const std::vector<nvvkhl_shaders::EnvAccel>& accel) const;
+
+  VkDevice                 m_device = VK_NULL_HANDLE;
+  nvvk::ResourceAllocator* m_alloc  = nullptr;
+  ThreadPool&              m_threads;
+  uint32_t                 m_queueFamilyIndex{0};
+
+  VkExtent2D                   m_size{0, 0};
+  float                        m_integral{1.F};
+  Sun                          m_sun;
+  nvvk::Texture                m_texture;
+  nvvk::Buffer                 m_accel;
+  nvvk::DescriptorSetContainer m_descSet;
+};
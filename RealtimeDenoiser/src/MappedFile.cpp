@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "MappedFile.hpp"
+
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+  if(this != &other)
+  {
+    close();
+    std::swap(m_data, other.m_data);
+    std::swap(m_size, other.m_size);
+    std::swap(m_open, other.m_open);
+#ifdef _WIN32
+    std::swap(m_file, other.m_file);
+    std::swap(m_mapping, other.m_mapping);
+#endif
+  }
+  return *this;
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string& path)
+{
+  close();
+
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if(file == INVALID_HANDLE_VALUE)
+  {
+    return false;
+  }
+
+  LARGE_INTEGER size{};
+  if(!GetFileSizeEx(file, &size))
+  {
+    CloseHandle(file);
+    return false;
+  }
+
+  m_file = file;
+  m_size = static_cast<size_t>(size.QuadPart);
+  m_open = true;
+  if(m_size == 0)
+  {
+    return true;  // cannot map an empty file
+  }
+
+  m_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  m_data    = m_mapping ? MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+  if(m_data == nullptr)
+  {
+    close();
+    return false;
+  }
+  return true;
+}
+
+void MappedFile::close()
+{
+  if(m_data)
+  {
+    UnmapViewOfFile(m_data);
+  }
+  if(m_mapping)
+  {
+    CloseHandle(m_mapping);
+  }
+  if(m_file)
+  {
+    CloseHandle(m_file);
+  }
+  m_data    = nullptr;
+  m_mapping = nullptr;
+  m_file    = nullptr;
+  m_size    = 0;
+  m_open    = false;
+}
+
+#else
+
+bool MappedFile::open(const std::string& path)
+{
+  close();
+
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if(fd < 0)
+  {
+    return false;
+  }
+
+  struct stat st = {};
+  if(fstat(fd, &st) != 0)
+  {
+    ::close(fd);
+    return false;
+  }
+
+  m_size = static_cast<size_t>(st.st_size);
+  m_open = true;
+  if(m_size > 0)
+  {
+    void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(data == MAP_FAILED)
+    {
+      ::close(fd);
+      m_size = 0;
+      m_open = false;
+      return false;
+    }
+    madvise(data, m_size, MADV_SEQUENTIAL);
+    m_data = data;
+  }
+  ::close(fd);  // the mapping keeps the file referenced
+  return true;
+}
+
+void MappedFile::close()
+{
+  if(m_data)
+  {
+    munmap(const_cast<void*>(m_data), m_size);
+  }
+  m_data = nullptr;
+  m_size = 0;
+  m_open = false;
+}
+
+#endif
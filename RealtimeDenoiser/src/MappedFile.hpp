@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <utility>
+
+/* Read-only memory mapping of a whole file.
+ * The pages are only read from disk when accessed, and shared with the file system cache, so that
+ * large files can be consumed in place instead of being copied to the heap first.
+ */
+class MappedFile
+{
+public:
+  MappedFile() = default;
+  ~MappedFile() { close(); }
+
+  MappedFile(const MappedFile&)            = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  MappedFile(MappedFile&& other) noexcept { *this = std::move(other); }
+  MappedFile& operator=(MappedFile&& other) noexcept;
+
+  /* Map 'path', returns false if it cannot be opened. Empty files are valid and have no data. */
+  bool open(const std::string& path);
+  void close();
+
+  bool           isOpen() const { return m_open; }
+  const uint8_t* data() const { return static_cast<const uint8_t*>(m_data); }
+  size_t         size() const { return m_size; }
+
+private:
+  const void* m_data = nullptr;
+  size_t      m_size = 0;
+  bool        m_open = false;
+#ifdef _WIN32
+  void* m_file    = nullptr;  // HANDLE
+  void* m_mapping = nullptr;  // HANDLE
+#endif
+};
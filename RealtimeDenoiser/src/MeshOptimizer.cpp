@@ -0,0 +1,553 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "MeshOptimizer.hpp"
+
+#include "AccelCache.hpp"
+#include "tiny_gltf.h"
+
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <cstring>
+#include <map>
+#include <numeric>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Elements of a vertex attribute, in place in their buffer
+struct Attribute
+{
+  std::string    name;
+  int            accessor{-1};
+  const uint8_t* data{nullptr};
+  size_t         elementSize{0};
+  size_t         stride{0};
+};
+
+// Primitives with the same accessors, and the result of their optimization
+struct Geometry
+{
+  std::vector<Attribute>            attributes;
+  int                               indices{-1};
+  std::vector<tinygltf::Primitive*> primitives;
+
+  bool                              optimized{false};
+  std::vector<std::vector<uint8_t>> vertexData;  // per attribute, packed
+  std::vector<uint32_t>             indexData;
+  uint32_t                          vertexCount{0};
+  MeshOptimizer::Statistics         stats;
+};
+
+struct TriangleHash
+{
+  size_t operator()(const std::array<uint32_t, 3>& t) const
+  {
+    const uint64_t hash = (uint64_t(t[0]) * 0x9E3779B97F4A7C15ull) ^ (uint64_t(t[1]) * 0xC2B2AE3D27D4EB4Full)
+                          ^ (uint64_t(t[2]) * 0x165667B19E3779F9ull);
+    return size_t(hash ^ (hash >> 32));
+  }
+};
+
+bool isTriangleList(const tinygltf::Primitive& primitive)
+{
+  return primitive.mode == TINYGLTF_MODE_TRIANGLES || primitive.mode == -1;
+}
+
+// False for the accessors that cannot be read in place: sparse, without buffer view, or invalid
+bool getAttribute(const tinygltf::Model& model, int accessorIndex, size_t count, Attribute& attribute)
+{
+  if(accessorIndex < 0 || accessorIndex >= static_cast<int>(model.accessors.size()))
+  {
+    return false;
+  }
+  const tinygltf::Accessor& accessor      = model.accessors[accessorIndex];
+  const int                 componentSize = tinygltf::GetComponentSizeInBytes(accessor.componentType);
+  const int                 components    = tinygltf::GetNumComponentsInType(accessor.type);
+  if(accessor.sparse.isSparse || accessor.bufferView < 0 || componentSize <= 0 || components <= 0
+     || accessor.count != count || count == 0)
+  {
+    return false;
+  }
+
+  const tinygltf::BufferView& view   = model.bufferViews[accessor.bufferView];
+  const tinygltf::Buffer&     buffer = model.buffers[view.buffer];
+  attribute.accessor                 = accessorIndex;
+  attribute.elementSize              = size_t(componentSize) * size_t(components);
+  attribute.stride                   = view.byteStride > 0 ? view.byteStride : attribute.elementSize;
+
+  const size_t offset = view.byteOffset + accessor.byteOffset;
+  if(offset + attribute.stride * (count - 1) + attribute.elementSize > buffer.data.size())
+  {
+    return false;
+  }
+  attribute.data = buffer.data.data() + offset;
+  return true;
+}
+
+// The triangle list of a primitive, 0..vertexCount-1 if it has no indices
+bool getIndices(const tinygltf::Model& model, int accessorIndex, uint32_t vertexCount, std::vector<uint32_t>& indices)
+{
+  if(accessorIndex < 0)
+  {
+    indices.resize(vertexCount - vertexCount % 3);
+    std::iota(indices.begin(), indices.end(), 0u);
+    return true;
+  }
+
+  const tinygltf::Accessor& accessor = model.accessors[accessorIndex];
+  Attribute                 attribute;
+  if(accessor.type != TINYGLTF_TYPE_SCALAR || !getAttribute(model, accessorIndex, accessor.count, attribute))
+  {
+    return false;
+  }
+  indices.resize(accessor.count - accessor.count % 3);
+  for(size_t i = 0; i < indices.size(); ++i)
+  {
+    const uint8_t* element = attribute.data + i * attribute.stride;
+    switch(accessor.componentType)
+    {
+      case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+        indices[i] = *element;
+        break;
+      case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+        uint16_t index;
+        memcpy(&index, element, sizeof(index));
+        indices[i] = index;
+        break;
+      }
+      case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+        memcpy(&indices[i], element, sizeof(uint32_t));
+        break;
+      default:
+        return false;
+    }
+    if(indices[i] >= vertexCount)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Vertices transformed by a FIFO cache of kCacheSize entries
+uint64_t countCacheMisses(const std::vector<uint32_t>& indices, uint32_t vertexCount)
+{
+  constexpr int64_t    kCacheSize = MeshOptimizer::kCacheSize;
+  std::vector<int64_t> insertedAt(vertexCount, -kCacheSize - 1);  // miss counter when the vertex entered the cache
+  int64_t              misses = 0;
+  for(uint32_t v : indices)
+  {
+    if(misses - insertedAt[v] > kCacheSize - 1)
+    {
+      insertedAt[v] = misses++;
+    }
+  }
+  return uint64_t(misses);
+}
+
+// Tipsify: fans around the vertices likely in the cache, with the dead-end stack to restart nearby
+std::vector<uint32_t> orderForVertexCache(const std::vector<uint32_t>& indices, uint32_t vertexCount)
+{
+  constexpr int64_t kCacheSize    = MeshOptimizer::kCacheSize;
+  const uint32_t    triangleCount = static_cast<uint32_t>(indices.size() / 3);
+
+  // Triangles of each vertex
+  std::vector<uint32_t> liveTriangles(vertexCount, 0);
+  for(uint32_t v : indices)
+  {
+    liveTriangles[v]++;
+  }
+  std::vector<uint32_t> offsets(vertexCount + 1, 0);
+  for(uint32_t v = 0; v < vertexCount; ++v)
+  {
+    offsets[v + 1] = offsets[v] + liveTriangles[v];
+  }
+  std::vector<uint32_t> adjacency(indices.size());
+  {
+    std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+    for(uint32_t t = 0; t < triangleCount; ++t)
+    {
+      for(uint32_t c = 0; c < 3; ++c)
+      {
+        adjacency[cursor[indices[t * 3 + c]]++] = t;
+      }
+    }
+  }
+
+  std::vector<int64_t>  cacheTime(vertexCount, 0);
+  int64_t               time = kCacheSize + 1;
+  std::vector<uint32_t> deadEnds;
+  std::vector<uint32_t> candidates;
+  std::vector<bool>     emitted(triangleCount, false);
+  uint32_t              scan = 0;
+
+  auto skipDeadEnd = [&]() -> int64_t {
+    while(!deadEnds.empty())
+    {
+      const uint32_t v = deadEnds.back();
+      deadEnds.pop_back();
+      if(liveTriangles[v] > 0)
+      {
+        return v;
+      }
+    }
+    for(; scan < vertexCount; ++scan)
+    {
+      if(liveTriangles[scan] > 0)
+      {
+        return scan;
+      }
+    }
+    return -1;
+  };
+
+  std::vector<uint32_t> result;
+  result.reserve(indices.size());
+  int64_t fanning = skipDeadEnd();
+  while(fanning >= 0)
+  {
+    candidates.clear();
+    for(uint32_t a = offsets[fanning]; a < offsets[fanning + 1]; ++a)
+    {
+      const uint32_t t = adjacency[a];
+      if(emitted[t])
+      {
+        continue;
+      }
+      emitted[t] = true;
+      for(uint32_t c = 0; c < 3; ++c)
+      {
+        const uint32_t v = indices[t * 3 + c];
+        result.push_back(v);
+        deadEnds.push_back(v);
+        candidates.push_back(v);
+        liveTriangles[v]--;
+        if(time - cacheTime[v] > kCacheSize)
+        {
+          cacheTime[v] = time++;
+        }
+      }
+    }
+
+    // The candidate that stays in the cache while its remaining triangles are emitted, the oldest first
+    int64_t next     = -1;
+    int64_t priority = -1;
+    for(uint32_t v : candidates)
+    {
+      if(liveTriangles[v] == 0)
+      {
+        continue;
+      }
+      int64_t p = 0;
+      if(time - cacheTime[v] + 2 * int64_t(liveTriangles[v]) <= kCacheSize)
+      {
+        p = time - cacheTime[v];
+      }
+      if(p > priority)
+      {
+        priority = p;
+        next     = v;
+      }
+    }
+    fanning = next >= 0 ? next : skipDeadEnd();
+  }
+  return result;
+}
+
+void optimizeGeometry(const tinygltf::Model& model, Geometry& geometry)
+{
+  const uint32_t        vertexCount = static_cast<uint32_t>(model.accessors[geometry.attributes[0].accessor].count);
+  std::vector<uint32_t> indices;
+  if(!getIndices(model, geometry.indices, vertexCount, indices) || indices.empty())
+  {
+    return;
+  }
+  MeshOptimizer::Statistics& stats = geometry.stats;
+  stats.meshes                     = 1;
+  stats.trianglesBefore            = indices.size() / 3;
+  stats.verticesBefore             = vertexCount;
+  stats.cacheMissesBefore          = countCacheMisses(indices, vertexCount);
+
+  // Weld the vertices with the same bytes in all attributes
+  size_t vertexSize = 0;
+  for(const Attribute& attribute : geometry.attributes)
+  {
+    vertexSize += attribute.elementSize;
+  }
+  std::vector<uint8_t> vertices(size_t(vertexCount) * vertexSize);
+  for(uint32_t v = 0; v < vertexCount; ++v)
+  {
+    uint8_t* vertex = vertices.data() + size_t(v) * vertexSize;
+    for(const Attribute& attribute : geometry.attributes)
+    {
+      memcpy(vertex, attribute.data + size_t(v) * attribute.stride, attribute.elementSize);
+      vertex += attribute.elementSize;
+    }
+  }
+  std::vector<uint32_t>                       weld(vertexCount);
+  std::unordered_multimap<uint64_t, uint32_t> firstOfHash;
+  firstOfHash.reserve(vertexCount);
+  for(uint32_t v = 0; v < vertexCount; ++v)
+  {
+    const uint8_t* vertex = vertices.data() + size_t(v) * vertexSize;
+    const uint64_t hash   = AccelCache::hashData(vertex, vertexSize, 0xCBF29CE484222325ull);
+    weld[v]               = v;
+    auto range            = firstOfHash.equal_range(hash);
+    for(auto it = range.first; it != range.second; ++it)
+    {
+      if(memcmp(vertex, vertices.data() + size_t(it->second) * vertexSize, vertexSize) == 0)
+      {
+        weld[v] = it->second;
+        break;
+      }
+    }
+    if(weld[v] == v)
+    {
+      firstOfHash.emplace(hash, v);
+    }
+  }
+
+  // Drop the degenerate triangles and the duplicates, with the same winding
+  std::vector<uint32_t>                                     kept;
+  std::unordered_set<std::array<uint32_t, 3>, TriangleHash> triangles;
+  kept.reserve(indices.size());
+  triangles.reserve(indices.size() / 3);
+  for(size_t t = 0; t < indices.size(); t += 3)
+  {
+    std::array<uint32_t, 3> triangle{weld[indices[t]], weld[indices[t + 1]], weld[indices[t + 2]]};
+    if(triangle[0] == triangle[1] || triangle[1] == triangle[2] || triangle[2] == triangle[0])
+    {
+      stats.degenerateTriangles++;
+      continue;
+    }
+    std::array<uint32_t, 3> key = triangle;
+    std::rotate(key.begin(), std::min_element(key.begin(), key.end()), key.end());
+    if(!triangles.insert(key).second)
+    {
+      stats.duplicateTriangles++;
+      continue;
+    }
+    kept.insert(kept.end(), triangle.begin(), triangle.end());
+  }
+  if(kept.empty())
+  {
+    return;  // left as it is rather than emptied
+  }
+
+  // Triangles in cache order, then vertices in the order of their first use
+  indices = orderForVertexCache(kept, vertexCount);
+  std::vector<uint32_t> remap(vertexCount, ~0u);
+  uint32_t              used = 0;
+  for(uint32_t& index : indices)
+  {
+    if(remap[index] == ~0u)
+    {
+      remap[index] = used++;
+    }
+    index = remap[index];
+  }
+
+  geometry.vertexData.resize(geometry.attributes.size());
+  for(size_t a = 0; a < geometry.attributes.size(); ++a)
+  {
+    const Attribute&      attribute = geometry.attributes[a];
+    std::vector<uint8_t>& data      = geometry.vertexData[a];
+    data.resize(size_t(used) * attribute.elementSize);
+    for(uint32_t v = 0; v < vertexCount; ++v)
+    {
+      if(remap[v] != ~0u)
+      {
+        memcpy(data.data() + size_t(remap[v]) * attribute.elementSize, attribute.data + size_t(v) * attribute.stride,
+               attribute.elementSize);
+      }
+    }
+  }
+  geometry.indexData   = std::move(indices);
+  geometry.vertexCount = used;
+  geometry.optimized   = true;
+
+  stats.trianglesAfter   = geometry.indexData.size() / 3;
+  stats.verticesAfter    = used;
+  stats.cacheMissesAfter = countCacheMisses(geometry.indexData, used);
+}
+
+// Append 'data' to 'buffer' as a new buffer view, 4-byte aligned
+int addBufferView(tinygltf::Model& model, int buffer, const std::vector<uint8_t>& data, int target)
+{
+  std::vector<unsigned char>& bytes = model.buffers[buffer].data;
+  bytes.resize((bytes.size() + 3) & ~size_t(3));
+
+  tinygltf::BufferView view;
+  view.buffer     = buffer;
+  view.byteOffset = bytes.size();
+  view.byteLength = data.size();
+  view.target     = target;
+  bytes.insert(bytes.end(), data.begin(), data.end());
+  model.bufferViews.push_back(view);
+  return static_cast<int>(model.bufferViews.size()) - 1;
+}
+
+}  // namespace
+
+bool MeshOptimizer::optimize(tinygltf::Model& model, ThreadPool& threads, Statistics& stats)
+{
+  // The distinct geometries, each optimized once for all the primitives using it
+  std::vector<Geometry>      geometries;
+  std::map<std::string, int> geometryOfKey;
+  for(tinygltf::Mesh& mesh : model.meshes)
+  {
+    for(tinygltf::Primitive& primitive : mesh.primitives)
+    {
+      if(!isTriangleList(primitive) || !primitive.targets.empty() || primitive.attributes.count("POSITION") == 0)
+      {
+        continue;
+      }
+      std::string key = std::to_string(primitive.indices);
+      for(const auto& [name, accessor] : primitive.attributes)
+      {
+        key += ";" + name + "=" + std::to_string(accessor);
+      }
+      auto [it, inserted] = geometryOfKey.emplace(key, static_cast<int>(geometries.size()));
+      if(inserted)
+      {
+        // POSITION first: its count is the vertex count of the geometry
+        Geometry geometry;
+        geometry.indices = primitive.indices;
+        geometry.attributes.push_back({"POSITION", primitive.attributes.at("POSITION")});
+        for(const auto& [name, accessor] : primitive.attributes)
+        {
+          if(name != "POSITION")
+          {
+            geometry.attributes.push_back({name, accessor});
+          }
+        }
+        geometries.push_back(std::move(geometry));
+      }
+      geometries[it->second].primitives.push_back(&primitive);
+    }
+  }
+
+  threads.parallelFor(
+      static_cast<uint32_t>(geometries.size()),
+      [&](uint32_t g) {
+        Geometry&    geometry = geometries[g];
+        const size_t count    = model.accessors[geometry.attributes[0].accessor].count;
+        for(Attribute& attribute : geometry.attributes)
+        {
+          if(!getAttribute(model, attribute.accessor, count, attribute))
+          {
+            return;
+          }
+        }
+        optimizeGeometry(model, geometry);
+      });
+
+  // The results go to a new buffer: the accessors of the original data may be used elsewhere, and
+  // SceneLoader releases those which are not
+  int buffer = -1;
+  for(Geometry& geometry : geometries)
+  {
+    if(!geometry.optimized)
+    {
+      continue;
+    }
+    if(buffer < 0)
+    {
+      tinygltf::Buffer optimized;
+      optimized.name = "MeshOptimizer";
+      model.buffers.push_back(std::move(optimized));
+      buffer = static_cast<int>(model.buffers.size()) - 1;
+    }
+
+    std::map<std::string, int> accessors;
+    for(size_t a = 0; a < geometry.attributes.size(); ++a)
+    {
+      const Attribute&   attribute = geometry.attributes[a];
+      tinygltf::Accessor accessor  = model.accessors[attribute.accessor];
+      accessor.bufferView          = addBufferView(model, buffer, geometry.vertexData[a], TINYGLTF_TARGET_ARRAY_BUFFER);
+      accessor.byteOffset          = 0;
+      accessor.count               = geometry.vertexCount;
+      accessor.minValues.clear();
+      accessor.maxValues.clear();
+      if(attribute.name == "POSITION" && accessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT && accessor.type == TINYGLTF_TYPE_VEC3)
+      {
+        // Required for positions, and some vertices may have been dropped
+        std::array<float, 3> lo{FLT_MAX, FLT_MAX, FLT_MAX}, hi{-FLT_MAX, -FLT_MAX, -FLT_MAX};
+        for(uint32_t v = 0; v < geometry.vertexCount; ++v)
+        {
+          float p[3];
+          memcpy(p, geometry.vertexData[a].data() + size_t(v) * sizeof(p), sizeof(p));
+          for(int c = 0; c < 3; ++c)
+          {
+            lo[c] = std::min(lo[c], p[c]);
+            hi[c] = std::max(hi[c], p[c]);
+          }
+        }
+        accessor.minValues = {lo[0], lo[1], lo[2]};
+        accessor.maxValues = {hi[0], hi[1], hi[2]};
+      }
+      model.accessors.push_back(std::move(accessor));
+      accessors[attribute.name] = static_cast<int>(model.accessors.size()) - 1;
+    }
+
+    std::vector<uint8_t> indexBytes(geometry.indexData.size() * sizeof(uint32_t));
+    memcpy(indexBytes.data(), geometry.indexData.data(), indexBytes.size());
+    tinygltf::Accessor indexAccessor;
+    indexAccessor.bufferView    = addBufferView(model, buffer, indexBytes, TINYGLTF_TARGET_ELEMENT_ARRAY_BUFFER);
+    indexAccessor.componentType = TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT;
+    indexAccessor.type          = TINYGLTF_TYPE_SCALAR;
+    indexAccessor.count         = geometry.indexData.size();
+    model.accessors.push_back(std::move(indexAccessor));
+    const int indices = static_cast<int>(model.accessors.size()) - 1;
+
+    for(tinygltf::Primitive* primitive : geometry.primitives)
+    {
+      primitive->attributes = accessors;
+      primitive->indices    = indices;
+      primitive->mode       = TINYGLTF_MODE_TRIANGLES;
+    }
+  }
+
+  for(const Geometry& geometry : geometries)
+  {
+    if(geometry.optimized)
+    {
+      stats.meshes += geometry.stats.meshes;
+      stats.trianglesBefore += geometry.stats.trianglesBefore;
+      stats.trianglesAfter += geometry.stats.trianglesAfter;
+      stats.verticesBefore += geometry.stats.verticesBefore;
+      stats.verticesAfter += geometry.stats.verticesAfter;
+      stats.degenerateTriangles += geometry.stats.degenerateTriangles;
+      stats.duplicateTriangles += geometry.stats.duplicateTriangles;
+      stats.cacheMissesBefore += geometry.stats.cacheMissesBefore;
+      stats.cacheMissesAfter += geometry.stats.cacheMissesAfter;
+    }
+  }
+  if(buffer >= 0)
+  {
+    model.buffers[buffer].data.shrink_to_fit();
+  }
+  return buffer >= 0;
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "ThreadPool.hpp"
+
+namespace tinygltf {
+class Model;
+}
+
+/* Load-time optimization of the triangle meshes of a glTF model, for the locality of the vertex
+ * fetches of the hit shaders (three vertices per hit, see shaders/get_hit.glsl).
+ *
+ * Each distinct geometry (set of attribute and index accessors) is optimized once, on the workers
+ * of a ThreadPool:
+ * - the vertices with identical attributes are welded,
+ * - the degenerate triangles, and the duplicates of a triangle with the same winding, are removed,
+ * - the triangles are reordered for the vertex cache (Tipsify, Sander et al. 2007),
+ * - the vertices are reordered by first use, dropping those no triangle references.
+ * The results are written to a new buffer of the model, and the primitives are pointed to the new
+ * accessors. Primitives with morph targets, sparse accessors or another mode than triangles are
+ * left unchanged.
+ */
+class MeshOptimizer
+{
+public:
+  static constexpr uint32_t kCacheSize = 16;  // FIFO vertex cache of the optimization and of the statistics
+
+  struct Statistics
+  {
+    uint64_t meshes{0};  // distinct geometries optimized
+    uint64_t trianglesBefore{0};
+    uint64_t trianglesAfter{0};
+    uint64_t verticesBefore{0};
+    uint64_t verticesAfter{0};
+    uint64_t degenerateTriangles{0};
+    uint64_t duplicateTriangles{0};
+    uint64_t cacheMissesBefore{0};  // vertex cache misses of all triangles
+    uint64_t cacheMissesAfter{0};
+
+    // Average cache miss ratio: vertices transformed per triangle
+    double getAcmrBefore() const { return trianglesBefore ? double(cacheMissesBefore) / double(trianglesBefore) : 0.0; }
+    double getAcmrAfter() const { return trianglesAfter ? double(cacheMissesAfter) / double(trianglesAfter) : 0.0; }
+  };
+
+  /* Returns true if any primitive was changed */
+  static bool optimize(tinygltf::Model& model, ThreadPool& threads, Statistics& stats);
+};
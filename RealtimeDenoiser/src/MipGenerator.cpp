@@ -0,0 +1,212 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "MipGenerator.hpp"
+
+#include <nvvk/debug_util_vk.hpp>
+#include <nvvk/error_vk.hpp>
+#include <nvvk/images_vk.hpp>
+
+#include "shaders/host_device.h"
+#include "_autogen/mipmap.comp.h"
+
+#include <algorithm>
+#include <array>
+
+MipGenerator::MipGenerator(VkDevice device, nvvk::ResourceAllocator* alloc)
+    : m_device(device)
+    , m_alloc(alloc)
+{
+  std::vector<VkDescriptorSetLayoutBinding> layoutBindings;
+  layoutBindings.push_back({uint32_t(MipmapBindings::eMipSource), VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT});
+  layoutBindings.push_back({uint32_t(MipmapBindings::eMipLevels), VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                            MIPMAP_LEVELS_PER_PASS, VK_SHADER_STAGE_COMPUTE_BIT});
+  VkDescriptorSetLayoutCreateInfo layoutInfo{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
+  layoutInfo.flags        = VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR;
+  layoutInfo.bindingCount = static_cast<uint32_t>(layoutBindings.size());
+  layoutInfo.pBindings    = layoutBindings.data();
+  NVVK_CHECK(vkCreateDescriptorSetLayout(m_device, &layoutInfo, nullptr, &m_descriptorSetLayout));
+
+  VkPushConstantRange        pushConstant{VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(MipmapPushConstant)};
+  VkPipelineLayoutCreateInfo pipelineLayoutInfo{VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
+  pipelineLayoutInfo.setLayoutCount         = 1;
+  pipelineLayoutInfo.pSetLayouts            = &m_descriptorSetLayout;
+  pipelineLayoutInfo.pushConstantRangeCount = 1;
+  pipelineLayoutInfo.pPushConstantRanges    = &pushConstant;
+  NVVK_CHECK(vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, nullptr, &m_pipelineLayout));
+
+  VkShaderModuleCreateInfo shaderInfo{VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO};
+  shaderInfo.codeSize = sizeof(mipmap_comp);
+  shaderInfo.pCode    = mipmap_comp;
+
+  VkShaderModule shader = VK_NULL_HANDLE;
+  NVVK_CHECK(vkCreateShaderModule(m_device, &shaderInfo, nullptr, &shader));
+
+  VkComputePipelineCreateInfo pipelineInfo{VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO};
+  pipelineInfo.stage        = {VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO};
+  pipelineInfo.stage.stage  = VK_SHADER_STAGE_COMPUTE_BIT;
+  pipelineInfo.stage.module = shader;
+  pipelineInfo.stage.pName  = "main";
+  pipelineInfo.layout       = m_pipelineLayout;
+  NVVK_CHECK(vkCreateComputePipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_pipeline));
+  vkDestroyShaderModule(m_device, shader, nullptr);
+
+  nvvk::DebugUtil dutil(m_device);
+  dutil.setObjectName(m_pipeline, "MipGenerator");
+}
+
+MipGenerator::~MipGenerator()
+{
+  releaseViews();
+  vkDestroyPipeline(m_device, m_pipeline, nullptr);
+  vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
+  vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, nullptr);
+}
+
+nvvk::Texture MipGenerator::createTexture(VkCommandBuffer cmd, const TextureStreamer::SourceImage& image)
+{
+  Target target;
+  target.extent = {image.width, image.height};
+  target.srgb   = image.format == VK_FORMAT_R8G8B8A8_SRGB;
+
+  // The levels are written as UNORM, which storage images support, and the texture samples them as sRGB
+  VkImageCreateInfo imageInfo = nvvk::makeImage2DCreateInfo(target.extent, VK_FORMAT_R8G8B8A8_UNORM,
+                                                            VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT
+                                                                | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+                                                            true);
+  imageInfo.flags |= VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT;
+
+  const std::vector<uint8_t>& pixels  = image.mips.front();
+  nvvk::Image                 vkImage = m_alloc->createImage(cmd, pixels.size(), pixels.data(), imageInfo, VK_IMAGE_LAYOUT_GENERAL);
+  target.image                        = vkImage.image;
+
+  for(uint32_t level = 0; level < imageInfo.mipLevels; ++level)
+  {
+    VkImageViewCreateInfo viewInfo         = nvvk::makeImageViewCreateInfo(vkImage.image, imageInfo);
+    viewInfo.subresourceRange.baseMipLevel = level;
+    viewInfo.subresourceRange.levelCount   = 1;
+    VkImageView view                       = VK_NULL_HANDLE;
+    NVVK_CHECK(vkCreateImageView(m_device, &viewInfo, nullptr, &view));
+    target.levels.push_back(view);
+  }
+  m_targets.push_back(std::move(target));
+
+  // sRGB formats do not support storage: the sampled view does without that usage of the image
+  VkImageViewUsageCreateInfo usageInfo{VK_STRUCTURE_TYPE_IMAGE_VIEW_USAGE_CREATE_INFO};
+  usageInfo.usage                = VK_IMAGE_USAGE_SAMPLED_BIT;
+  VkImageViewCreateInfo viewInfo = nvvk::makeImageViewCreateInfo(vkImage.image, imageInfo);
+  viewInfo.pNext                 = &usageInfo;
+  viewInfo.format                = image.format;
+  return m_alloc->createTexture(vkImage, viewInfo);
+}
+
+uint32_t MipGenerator::cmdGenerate(VkCommandBuffer cmd)
+{
+  uint32_t passes = 0;
+  for(const Target& target : m_targets)
+  {
+    const uint32_t levels = static_cast<uint32_t>(target.levels.size());
+    passes = std::max(passes, (levels + MIPMAP_LEVELS_PER_PASS - 2) / MIPMAP_LEVELS_PER_PASS);
+  }
+
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+  uint32_t dispatches = 0;
+  for(uint32_t pass = 0; pass < passes; ++pass)
+  {
+    // The first pass reads the uploaded levels, the next ones the last level of the previous pass
+    VkMemoryBarrier barrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr,
+                            VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT};
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    const uint32_t source = pass * MIPMAP_LEVELS_PER_PASS;
+    for(const Target& target : m_targets)
+    {
+      const uint32_t levels = static_cast<uint32_t>(target.levels.size());
+      if(source + 1 >= levels)
+      {
+        continue;
+      }
+      MipmapPushConstant pushConstant{std::min<uint32_t>(MIPMAP_LEVELS_PER_PASS, levels - 1 - source), target.srgb ? 1u : 0u};
+
+      // The levels the pass does not write are bound to the last one it does
+      VkDescriptorImageInfo sourceInfo{VK_NULL_HANDLE, target.levels[source], VK_IMAGE_LAYOUT_GENERAL};
+      std::array<VkDescriptorImageInfo, MIPMAP_LEVELS_PER_PASS> levelInfos;
+      for(uint32_t l = 0; l < MIPMAP_LEVELS_PER_PASS; ++l)
+      {
+        const uint32_t level = source + 1 + std::min(l, pushConstant.levels - 1);
+        levelInfos[l]        = {VK_NULL_HANDLE, target.levels[level], VK_IMAGE_LAYOUT_GENERAL};
+      }
+      std::array<VkWriteDescriptorSet, 2> writes{};
+      writes[0]                 = {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+      writes[0].dstBinding      = uint32_t(MipmapBindings::eMipSource);
+      writes[0].descriptorCount = 1;
+      writes[0].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+      writes[0].pImageInfo      = &sourceInfo;
+      writes[1]                 = {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+      writes[1].dstBinding      = uint32_t(MipmapBindings::eMipLevels);
+      writes[1].descriptorCount = MIPMAP_LEVELS_PER_PASS;
+      writes[1].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+      writes[1].pImageInfo      = levelInfos.data();
+      vkCmdPushDescriptorSetKHR(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0,
+                                static_cast<uint32_t>(writes.size()), writes.data());
+      vkCmdPushConstants(cmd, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstant), &pushConstant);
+
+      const uint32_t width  = std::max(target.extent.width >> source, 1u);
+      const uint32_t height = std::max(target.extent.height >> source, 1u);
+      vkCmdDispatch(cmd, (width + MIPMAP_TILE_SIZE - 1) / MIPMAP_TILE_SIZE, (height + MIPMAP_TILE_SIZE - 1) / MIPMAP_TILE_SIZE, 1);
+      ++dispatches;
+    }
+  }
+
+  // All levels, including those of the textures without passes, go to the layout they are sampled in
+  std::vector<VkImageMemoryBarrier> barriers;
+  for(const Target& target : m_targets)
+  {
+    VkImageMemoryBarrier barrier{VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
+    barrier.srcAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask       = VK_ACCESS_SHADER_READ_BIT;
+    barrier.oldLayout           = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.newLayout           = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image               = target.image;
+    barrier.subresourceRange    = {VK_IMAGE_ASPECT_COLOR_BIT, 0, VK_REMAINING_MIP_LEVELS, 0, 1};
+    barriers.push_back(barrier);
+  }
+  if(!barriers.empty())
+  {
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, 0, 0, nullptr, 0, nullptr,
+                         static_cast<uint32_t>(barriers.size()), barriers.data());
+  }
+  return dispatches;
+}
+
+void MipGenerator::releaseViews()
+{
+  for(Target& target : m_targets)
+  {
+    for(VkImageView view : target.levels)
+    {
+      vkDestroyImageView(m_device, view, nullptr);
+    }
+  }
+  m_targets.clear();
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include <vulkan/vulkan_core.h>
+
+#include <nvvk/resourceallocator_vk.hpp>
+
+#include "TextureStreamer.hpp"
+
+/* Generates the mip chains of RGBA8 textures on the GPU, with shaders/mipmap.comp.
+ *
+ * A workgroup reduces a 64x64 tile of a level down to 1x1 in shared memory, so that a dispatch
+ * writes MIPMAP_LEVELS_PER_PASS levels: two passes cover a 4K texture, where a chain of blits
+ * takes a barrier per level of each texture. The passes of all the textures are recorded
+ * together, with a single barrier between consecutive passes.
+ * The textures sampled as sRGB are averaged in linear space: their image is UNORM, written
+ * through UNORM storage views, and sampled through an sRGB view.
+ */
+class MipGenerator
+{
+public:
+  MipGenerator(VkDevice device, nvvk::ResourceAllocator* alloc);
+  ~MipGenerator();  // the submission of the last cmdGenerate() must have completed
+
+  /* Create the texture of the first level of 'image', R8G8B8A8_UNORM or _SRGB, with room for its
+   * whole mip chain, and record the upload of that level. The staging buffer is released with the
+   * other uploads of the submission.
+   */
+  nvvk::Texture createTexture(VkCommandBuffer cmd, const TextureStreamer::SourceImage& image);
+
+  /* Record the generation of the levels of the textures created since the last releaseViews(),
+   * leaving them ready to be sampled. Returns the number of dispatches.
+   */
+  uint32_t cmdGenerate(VkCommandBuffer cmd);
+
+  /* Destroy the level views used by the last cmdGenerate(), once its submission completed */
+  void releaseViews();
+
+private:
+  struct Target
+  {
+    VkImage                  image{VK_NULL_HANDLE};
+    VkExtent2D               extent{};
+    bool                     srgb{false};
+    std::vector<VkImageView> levels;  // UNORM storage view of each level
+  };
+
+  VkDevice                 m_device = VK_NULL_HANDLE;
+  nvvk::ResourceAllocator* m_alloc  = nullptr;
+
+  VkDescriptorSetLayout m_descriptorSetLayout = VK_NULL_HANDLE;  // pushed
+  VkPipelineLayout      m_pipelineLayout      = VK_NULL_HANDLE;
+  VkPipeline            m_pipeline            = VK_NULL_HANDLE;
+
+  std::vector<Target> m_targets;
+};
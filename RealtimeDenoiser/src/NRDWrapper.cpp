@@ -220,6 +220,8 @@ NRDWrapper::NRDWrapper(nvvk::ResourceAllocator& alloc,
       transitionTexture(t.image);
     }
 
+    // Nothing is uploaded: the clears need no staging, and the constants are written by
+    // vkCmdUpdateBuffer in the frame command buffers
     cpool.submitAndWait(cmd);
   }
 
@@ -235,17 +237,18 @@ NRDWrapper::NRDWrapper(nvvk::ResourceAllocator& alloc,
     m_samplers.push_back(sampler);
   }
 
-  // Create the constant buffer
-  m_constantBuffer = m_resAlloc.createBuffer(VkDeviceSize(iDesc.constantBufferMaxDataSize),
-                                             VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+  // Create the constant buffer, with one slot per dispatch for prepare()/recordDispatches().
+  // 256 bytes is the largest minUniformBufferOffsetAlignment allowed by the specification.
+  m_constantSlotSize = (VkDeviceSize(iDesc.constantBufferMaxDataSize) + 255) & ~VkDeviceSize(255);
+  m_constantSlotsNum = std::max(iDesc.descriptorPoolDesc.setsMaxNum, 1u);
+  m_constantBuffer   = m_resAlloc.createBuffer(m_constantSlotSize * m_constantSlotsNum,
+                                               VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
 
   createPipelines();
 }
 
 NRDWrapper::~NRDWrapper()
 {
-  vkDeviceWaitIdle(m_device);
-
   m_resAlloc.destroy(m_constantBuffer);
   for(auto s : m_samplers)
   {
@@ -536,13 +539,100 @@ void NRDWrapper::denoise(const nrd::Identifier* denoisers, uint32_t denoisersNum
 
     nvvk::DebugUtil::ScopedCmdLabel cmdBufLabel(commandBuffer, dDesc.name);
 
-    dispatch(commandBuffer, dDesc);
+    dispatch(commandBuffer, dDesc, 0, true);
+  }
+}
+
+// Hash of what recordDispatches() records, FNV-1a
+void NRDWrapper::hashValue(uint64_t& hash, uint64_t value)
+{
+  for(uint32_t b = 0; b < 8; ++b)
+  {
+    hash = (hash ^ ((value >> (b * 8)) & 0xFF)) * 0x100000001b3ull;
+  }
+}
+
+bool NRDWrapper::prepare(const nrd::Identifier* denoisers, uint32_t denoisersNum, VkCommandBuffer commandBuffer, uint64_t& key)
+{
+  nrd::GetComputeDispatches(*m_instance, reinterpret_cast<const nrd::Identifier*>(denoisers), denoisersNum,
+                            m_preparedDispatches, m_preparedDispatchesNum);
+  if(m_preparedDispatchesNum > m_constantSlotsNum)
+  {
+    LOGE("NRDWrapper: %u dispatches do not fit in the %u constant slots, they cannot be prepared\n",
+         m_preparedDispatchesNum, m_constantSlotsNum);
+    m_preparedDispatchesNum = 0;
+    return false;
+  }
+  m_preparedSlots.resize(m_preparedDispatchesNum);
+
+  VkBufferMemoryBarrier barrier = {VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+                                   nullptr,
+                                   VK_ACCESS_SHADER_READ_BIT,
+                                   VK_ACCESS_TRANSFER_WRITE_BIT,
+                                   VK_QUEUE_FAMILY_IGNORED,
+                                   VK_QUEUE_FAMILY_IGNORED,
+                                   m_constantBuffer.buffer,
+                                   0,
+                                   VK_WHOLE_SIZE};
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0,
+                       nullptr, 1, &barrier, 0, nullptr);
+
+  uint64_t hash = 0xcbf29ce484222325ull;
+  uint32_t slot = 0;
+  for(uint32_t d = 0; d < m_preparedDispatchesNum; ++d)
+  {
+    const nrd::DispatchDesc& dDesc = m_preparedDispatches[d];
+
+    // Constants matching the previous dispatch are read from the same slot
+    if(d > 0 && !dDesc.constantBufferDataMatchesPreviousDispatch)
+    {
+      ++slot;
+    }
+    m_preparedSlots[d] = slot;
+    if(dDesc.constantBufferDataSize > 0 && (d == 0 || !dDesc.constantBufferDataMatchesPreviousDispatch))
+    {
+      vkCmdUpdateBuffer(commandBuffer, m_constantBuffer.buffer, slot * m_constantSlotSize,
+                        dDesc.constantBufferDataSize, dDesc.constantBufferData);
+    }
+
+    hashValue(hash, dDesc.pipelineIndex);
+    hashValue(hash, (uint64_t(dDesc.gridWidth) << 32) | dDesc.gridHeight);
+    hashValue(hash, slot);
+    for(uint32_t r = 0; r < dDesc.resourcesNum; ++r)
+    {
+      const nrd::ResourceDesc& res = dDesc.resources[r];
+      hashValue(hash, (uint64_t(res.type) << 32) | (uint64_t(res.indexInPool) << 8) | uint64_t(res.descriptorType));
+      if(res.type != nrd::ResourceType::TRANSIENT_POOL && res.type != nrd::ResourceType::PERMANENT_POOL)
+      {
+        hashValue(hash, uint64_t(m_userTexturePool[uint32_t(res.type)].descriptor.imageView));
+      }
+    }
+  }
+
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0,
+                       nullptr, 1, &barrier, 0, nullptr);
+
+  key = hash;
+  return true;
+}
+
+void NRDWrapper::recordDispatches(VkCommandBuffer commandBuffer)
+{
+  for(uint32_t d = 0; d < m_preparedDispatchesNum; ++d)
+  {
+    const nrd::DispatchDesc& dDesc = m_preparedDispatches[d];
+
+    nvvk::DebugUtil::ScopedCmdLabel cmdBufLabel(commandBuffer, dDesc.name);
+
+    dispatch(commandBuffer, dDesc, m_preparedSlots[d], false);
   }
 }
 
 // NRD provides us with a description of which image it wants to bind to which
 // descriptor binding index.
-void NRDWrapper::dispatch(VkCommandBuffer commandBuffer, const nrd::DispatchDesc& dispatchDesc)
+void NRDWrapper::dispatch(VkCommandBuffer commandBuffer, const nrd::DispatchDesc& dispatchDesc, uint32_t constantSlot, bool uploadConstants)
 {
   const nrd::LibraryDesc&  lDesc = nrd::GetLibraryDesc();
   const nrd::InstanceDesc& iDesc = nrd::GetInstanceDesc(*m_instance);
@@ -643,8 +733,8 @@ void NRDWrapper::dispatch(VkCommandBuffer commandBuffer, const nrd::DispatchDesc
 
   VkDescriptorBufferInfo bufferInfo{};
   bufferInfo.buffer = m_constantBuffer.buffer;
-  bufferInfo.offset = 0;
-  bufferInfo.range  = VK_WHOLE_SIZE;
+  bufferInfo.offset = constantSlot * m_constantSlotSize;
+  bufferInfo.range  = m_constantSlotSize;
 
   if(pDesc.hasConstantData)
   {
@@ -656,7 +746,7 @@ void NRDWrapper::dispatch(VkCommandBuffer commandBuffer, const nrd::DispatchDesc
 
     descriptorUpdates[numResourceUpdates++] = constantBufferUpdate;
 
-    if(!dispatchDesc.constantBufferDataMatchesPreviousDispatch)
+    if(uploadConstants && !dispatchDesc.constantBufferDataMatchesPreviousDispatch)
     {
       {
         VkBufferMemoryBarrier barrier = {VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
@@ -673,7 +763,8 @@ void NRDWrapper::dispatch(VkCommandBuffer commandBuffer, const nrd::DispatchDesc
                              nullptr, 1, &barrier, 0, nullptr);
       }
 
-      vkCmdUpdateBuffer(commandBuffer, m_constantBuffer.buffer, 0, dispatchDesc.constantBufferDataSize, dispatchDesc.constantBufferData);
+      vkCmdUpdateBuffer(commandBuffer, m_constantBuffer.buffer, bufferInfo.offset, dispatchDesc.constantBufferDataSize,
+                        dispatchDesc.constantBufferData);
 
       {
         VkBufferMemoryBarrier barrier = {VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
@@ -51,6 +51,9 @@ public:
    * reused as (or aliased with) other application specific textures. Albeit, this wrapper
    * does not expose the transient pool to the application and thus makes no use of reusing
    * transient textures for other purposes.
+   *
+   * The destructor does not synchronize with the GPU: the wrapper must not be destroyed
+   * before the command buffers using it have completed.
    */
   NRDWrapper(nvvk::ResourceAllocator& alloc,
              uint16_t                 width,
@@ -73,6 +76,23 @@ public:
  */
   void denoise(const nrd::Identifier* denoisers, uint32_t denoisersNum, VkCommandBuffer& commandBuffer);
 
+  /* Two-step alternative to denoise(), for recording the dispatches once into a reusable command buffer.
+   * prepare() retrieves this frame's dispatches from NRD and records the upload of their constants into
+   * 'commandBuffer', the frame's own command buffer. Every dispatch reads its constants from its own
+   * slot of the constant buffer, so the dispatches themselves don't contain any per-frame data.
+   * It sets 'key' to a key of what recordDispatches() would record: as long as prepare() returns the same
+   * key, a command buffer recorded earlier by recordDispatches() can be executed again instead.
+   * NRD alternates some of its history resources from one frame to the next, hence expect a couple of
+   * keys to come back in turn.
+   * Returns false, recording nothing, when the dispatches need more constant slots than the instance
+   * announced: the frame must then be denoised with denoise().
+   */
+  bool prepare(const nrd::Identifier* denoisers, uint32_t denoisersNum, VkCommandBuffer commandBuffer, uint64_t& key);
+  /* Record the dispatches retrieved by the last call to prepare() */
+  void recordDispatches(VkCommandBuffer commandBuffer);
+  /* Mix 'value' into 'hash' as prepare() builds its key, to extend it with what the caller records */
+  static void hashValue(uint64_t& hash, uint64_t value);
+
   /* When the NRD library is compiled, it is hardcoded to a specific Normal/Roughness encoding.
    * It requires to use a specific image format to store the encoded values.
    */
@@ -93,7 +113,9 @@ private:
   nvvk::Texture createTexture(const nrd::TextureDesc& tDesc, uint16_t width, uint16_t height);
   void          createPipelines();
   void          setDenoiserSettings(nrd::Identifier identifier, const void* settings);
-  void          dispatch(VkCommandBuffer commandBuffer, const nrd::DispatchDesc& dispatchDesc);
+  // Constants are read from 'constantSlot' of the constant buffer. With 'uploadConstants', they are
+  // first updated there, unless they match the previous dispatch.
+  void dispatch(VkCommandBuffer commandBuffer, const nrd::DispatchDesc& dispatchDesc, uint32_t constantSlot, bool uploadConstants);
 
   nrd::Instance*           m_instance = nullptr;
   VkDevice                 m_device   = VK_NULL_HANDLE;
@@ -104,7 +126,14 @@ private:
   std::vector<nvvk::Texture>                                    m_transientTextures;
   std::array<nvvk::Texture, size_t(nrd::ResourceType::MAX_NUM)> m_userTexturePool;
   std::vector<VkSampler>                                        m_samplers;
-  nvvk::Buffer                                                  m_constantBuffer;
+  nvvk::Buffer                                                  m_constantBuffer;  // m_constantSlotsNum slots of m_constantSlotSize bytes
+  VkDeviceSize                                                  m_constantSlotSize = 0;
+  uint32_t                                                      m_constantSlotsNum = 0;
+
+  // Dispatches retrieved by prepare(), and the constant slot each of them reads
+  const nrd::DispatchDesc* m_preparedDispatches    = nullptr;
+  uint32_t                 m_preparedDispatchesNum = 0;
+  std::vector<uint32_t>    m_preparedSlots;
 
   std::vector<NRDPipeline> m_pipelines;
 
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "ParallelRecorder.hpp"
+
+#include <nvvk/error_vk.hpp>
+
+ParallelRecorder::ParallelRecorder(VkDevice device, uint32_t queueFamilyIndex, uint32_t numThreads, uint32_t frameCycleSize)
+    : m_device(device)
+    , m_queueFamilyIndex(queueFamilyIndex)
+    , m_threads(numThreads)
+    , m_pools(frameCycleSize)
+{
+}
+
+ParallelRecorder::~ParallelRecorder()
+{
+  for(auto& slot : m_pools)
+  {
+    for(auto& p : slot)
+    {
+      vkDestroyCommandPool(m_device, p.pool, nullptr);
+    }
+  }
+}
+
+void ParallelRecorder::beginFrame(uint32_t frameCycleIndex)
+{
+  m_frameCycleIndex = frameCycleIndex % uint32_t(m_pools.size());
+  for(auto& p : m_pools[m_frameCycleIndex])
+  {
+    NVVK_CHECK(vkResetCommandPool(m_device, p.pool, 0));
+  }
+}
+
+VkCommandBuffer ParallelRecorder::getCommandBuffer(uint32_t pass)
+{
+  std::vector<PassPool>& slot = m_pools[m_frameCycleIndex];
+  while(slot.size() <= pass)
+  {
+    PassPool p;
+
+    VkCommandPoolCreateInfo poolInfo{VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
+    poolInfo.flags            = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    poolInfo.queueFamilyIndex = m_queueFamilyIndex;
+    NVVK_CHECK(vkCreateCommandPool(m_device, &poolInfo, nullptr, &p.pool));
+
+    VkCommandBufferAllocateInfo allocInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+    allocInfo.commandPool        = p.pool;
+    allocInfo.level              = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+    allocInfo.commandBufferCount = 1;
+    NVVK_CHECK(vkAllocateCommandBuffers(m_device, &allocInfo, &p.cmd));
+
+    slot.push_back(p);
+  }
+  return slot[pass].cmd;
+}
+
+std::vector<VkCommandBuffer> ParallelRecorder::record(const std::vector<Pass>& passes)
+{
+  // Pools are created on the calling thread, the workers only record
+  std::vector<VkCommandBuffer> cmds(passes.size(), VK_NULL_HANDLE);
+  for(uint32_t p = 0; p < uint32_t(passes.size()); ++p)
+  {
+    if(passes[p])
+    {
+      cmds[p] = getCommandBuffer(p);
+    }
+  }
+
+  m_threads.parallelFor(uint32_t(passes.size()), [&](uint32_t p) {
+    if(!passes[p])
+    {
+      return;
+    }
+
+    VkCommandBufferInheritanceInfo inheritance{VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO};
+    VkCommandBufferBeginInfo       beginInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+    beginInfo.flags            = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    beginInfo.pInheritanceInfo = &inheritance;
+    NVVK_CHECK(vkBeginCommandBuffer(cmds[p], &beginInfo));
+    passes[p](cmds[p]);
+    NVVK_CHECK(vkEndCommandBuffer(cmds[p]));
+  });
+
+  return cmds;
+}
+
+void ParallelRecorder::execute(VkCommandBuffer primary, const std::vector<VkCommandBuffer>& secondaries)
+{
+  for(VkCommandBuffer cmd : secondaries)
+  {
+    if(cmd != VK_NULL_HANDLE)
+    {
+      vkCmdExecuteCommands(primary, 1, &cmd);
+    }
+  }
+}
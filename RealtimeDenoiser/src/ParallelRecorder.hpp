@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <functional>
+#include <vector>
+
+#include <vulkan/vulkan_core.h>
+
+#include "ThreadPool.hpp"
+
+/* Records the passes of a frame into secondary command buffers on the workers of its own
+ * ThreadPool, and executes them in order from the frame's primary command buffer.
+ * The pool is not shared with the background work of the engine (scene loading, HDR tables):
+ * its tasks would be queued behind those long jobs, and the frame would wait for them.
+ *
+ * Command pools must not be used by several threads at once: each pass gets its own pool, and
+ * there is one set of pools per frame cycle slot, so that a pool is only reset once the frame
+ * that last used it has completed.
+ * A secondary command buffer inherits no state from the primary: each pass binds the pipelines,
+ * descriptors and push constants of every dispatch it records.
+ */
+class ParallelRecorder
+{
+public:
+  using Pass = std::function<void(VkCommandBuffer)>;
+
+  /* 'numThreads' workers record the passes together with the calling thread */
+  ParallelRecorder(VkDevice device, uint32_t queueFamilyIndex, uint32_t numThreads, uint32_t frameCycleSize);
+  ~ParallelRecorder();
+
+  /* Reset the command pools of 'frameCycleIndex', to be called once the fence of that slot was waited on */
+  void beginFrame(uint32_t frameCycleIndex);
+
+  /* Record each pass into its own secondary command buffer, all in parallel, and return them in the
+   * order of 'passes'. A null pass leaves a null command buffer. */
+  std::vector<VkCommandBuffer> record(const std::vector<Pass>& passes);
+
+  /* vkCmdExecuteCommands for all the non null command buffers, in order */
+  static void execute(VkCommandBuffer primary, const std::vector<VkCommandBuffer>& secondaries);
+
+private:
+  struct PassPool
+  {
+    VkCommandPool   pool = VK_NULL_HANDLE;
+    VkCommandBuffer cmd  = VK_NULL_HANDLE;  // allocated once, reset with the pool
+  };
+
+  VkCommandBuffer getCommandBuffer(uint32_t pass);
+
+  VkDevice                           m_device = VK_NULL_HANDLE;
+  uint32_t                           m_queueFamilyIndex{0};
+  ThreadPool                         m_threads;
+  std::vector<std::vector<PassPool>> m_pools;  // [frame cycle slot][pass]
+  uint32_t                           m_frameCycleIndex{0};
+};
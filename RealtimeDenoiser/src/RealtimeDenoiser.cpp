@@ -31,10 +31,12 @@
 */
 //////////////////////////////////////////////////////////////////////////
 
+#include <algorithm>
 #include <array>
 #include <filesystem>
 #include <math.h>
 #include <memory>
+#include <optional>
 #include <vulkan/vulkan_core.h>
 
 #define VMA_IMPLEMENTATION
@@ -52,14 +54,13 @@
 #include "nvvkhl/element_gui.hpp"
 #include "nvvkhl/gbuffer.hpp"
 #include "nvh/gltfscene.hpp"
-#include "nvvkhl/gltf_scene_rtx.hpp"
 #include "nvvkhl/gltf_scene_vk.hpp"
-#include "nvvkhl/hdr_env.hpp"
 #include "nvvkhl/pipeline_container.hpp"
 #include "nvvkhl/scene_camera.hpp"
 #include "nvvkhl/tonemap_postprocess.hpp"
 #include "nvvkhl/element_dbgprintf.hpp"
 #include "nvvkhl/shaders/dh_comp.h"
+#include "nvvkhl/shaders/dh_scn_desc.h"
 
 #include "shaders/host_device.h"
 #include "_autogen/nrd.rchit.h"
@@ -70,8 +71,22 @@
 #include "_autogen/pathtrace.rahit.h"
 #include "_autogen/compositing.comp.h"
 #include "_autogen/taa.comp.h"
+#include "_autogen/exposure_histogram.comp.h"
+#include "_autogen/exposure_resolve.comp.h"
+#include "_autogen/firefly_histogram.comp.h"
+#include "_autogen/firefly_resolve.comp.h"
+#include "_autogen/thumbnail.comp.h"
 
 #include "NRDWrapper.hpp"
+#include "Diagnostics.hpp"
+#include "DeletionQueue.hpp"
+#include "HdrEnvironment.hpp"
+#include "ParallelRecorder.hpp"
+#include "SceneAccel.hpp"
+#include "SceneLoader.hpp"
+#include "StagingRing.hpp"
+#include "TextureStreamer.hpp"
+#include "ThreadPool.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 #include "Nrd_ui.h"
@@ -115,14 +130,30 @@ class NRDEngine : public nvvkhl::IAppElement
     eGBufNormalRoughness,         // encoded worldspace normal and linear roughness
     eGBufMotionVectors,           // 2D motion vectors
     eGBufViewZ,                   // linear viewspace depth
-    eGBufOutDebugView,            // NRD
     eGBufDenoisedUnpacked,
     eGBufDirectLighting,
-    eGBufTaa,  // out from TAA
+    eGBufTaa,      // out from TAA
+    eGBufExposed,  // TAA output with the auto-exposure applied, input of the tonemapper
 
     eGBufNumBuffers
   };
 
+  // Tiles of the thumbnail atlas, laid out row by row like the "Denoiser" panel
+  enum ThumbnailTile
+  {
+    eThumbDiff,
+    eThumbSpec,
+    eThumbNormalRoughness,
+    eThumbDenoised,
+    eThumbTaa,
+    eThumbLdr,
+    eThumbNrdValidation,
+
+    eThumbColumns = 2,
+    eThumbRows    = 4,
+    eThumbHeight  = 100  // in pixels, the width follows the aspect ratio of the viewport
+  };
+
   struct Settings
   {
     int       maxFrames{200000};
@@ -130,8 +161,55 @@ class NRDEngine : public nvvkhl::IAppElement
     glm::vec4 clearColor{1.F};
     float     envRotation{0.F};
     bool      showAxis{true};
+    int       thumbnailInterval{30};  // frames between two refreshes of the buffer thumbnails
+    bool      autoExposure{true};
+    float     exposureCompensation{0.F};  // in EV, on top of the key value
+    float     exposureSpeed{3.F};         // adaptation speed, in 1/seconds
+    bool      adaptiveFirefly{true};      // firefly clamp from the radiance histogram, instead of a fixed luminance
+    bool      extractSun{true};           // remove the sun from the HDR when it is sampled analytically (sunEnabled and sunFromHdr)
+    bool      sunEnabled{true};
+    bool      sunFromHdr{true};      // use the sun extracted from the HDR rather than the values below
+    float     sunAzimuth{0.8F};      // in radians
+    float     sunElevation{0.6F};    // in radians
+    float     sunAngle{0.27F};       // angular radius, in degrees
+    glm::vec3 sunColor{1.F, 0.95F, 0.85F};
+    float     sunIntensity{20000.F};  // radiance of the disk
+    bool      reuseCommandBuffers{true};  // record the denoising, composition and TAA once, see getRecordedChain()
+    bool      parallelRecording{true};    // record the passes of the frame on worker threads, see ParallelRecorder
+    int       method{NRD_REBLUR};
+    float     maxLuminance{10.F};  // fixed firefly clamp, without adaptiveFirefly
+    float     overrideRoughness{-1.F};
+    float     overrideMetallic{-1.F};
+    float     splitScreen{0.F};
+    glm::vec2 exposurePercentiles{0.5F, 0.95F};
+    float     fireflyPercentile{0.995F};
+    float     fireflyHeadroom{4.F};
+    float     blasStepBudget{2.F};     // GPU time of each BLAS build step of the scene loader, in milliseconds
+    int       blasScratchBudget{256};  // scratch memory of the BLAS builds, in MB
+    int       textureBudget{1024};     // memory of the streamed scene textures, in MB
+    bool      optimizeMeshes{true};    // reorder and clean up the meshes when loading
+    bool      quantizeVertices{true};  // compress the vertex attributes when loading
+    bool      compressTextures{true};  // compress the decoded textures to BC7 when loading
+    bool      generateMips{true};      // generate the mips of the embedded textures on the GPU when loading
   } m_settings;
 
+  /* Everything the render path reads from the UI, copied once at the start of onRender() (see
+   * takeSnapshot()). The passes recorded on the workers read this copy only, never the members the
+   * UI edits.
+   */
+  struct FrameSnapshot
+  {
+    Settings            settings;
+    nrd::ReblurSettings reblur;
+    nrd::RelaxSettings  relax;
+    glm::mat4           view{1.F};
+    float               fov{60.F};
+    glm::vec2           clipPlanes{0.1F, 1000.F};
+    glm::ivec2          mouseCoord{-1};
+    float               deltaTime{0.F};
+    bool                thumbnailsVisible{false};
+  };
+
 public:
   NRDEngine() { m_frameInfo.clearColor = glm::vec4(1.F); };
 
@@ -152,26 +230,49 @@ public:
     m_alloc = std::make_unique<nvvkhl::AllocVma>(allocator_info);  // Allocator
     m_scene = std::make_unique<nvh::gltf::Scene>();                // GLTF scene
     m_sceneVk = std::make_unique<nvvkhl::SceneVk>(m_device, m_app->getPhysicalDevice(), m_alloc.get());  // GLTF Scene buffers
-    m_sceneRtx = std::make_unique<nvvkhl::SceneRtx>(m_device, m_app->getPhysicalDevice(), m_alloc.get());  // GLTF Scene BLAS/TLAS
+    m_sceneAccel = std::make_unique<SceneAccel>(m_device, m_app->getPhysicalDevice(), m_alloc.get());  // GLTF Scene BLAS/TLAS
     m_tonemapper = std::make_unique<nvvkhl::TonemapperPostProcess>(m_device, m_alloc.get());
     m_sbt        = std::make_unique<nvvk::SBTWrapper>();
     m_picker     = std::make_unique<nvvk::RayPickerKHR>(m_device, m_app->getPhysicalDevice(), m_alloc.get());
     m_vkAxis     = std::make_unique<nvvk::AxisVK>();
-    m_hdrEnv     = std::make_unique<nvvkhl::HdrEnv>(m_device, m_app->getPhysicalDevice(), m_alloc.get());
     m_rtxSet     = std::make_unique<nvvk::DescriptorSetContainer>(m_device);
     m_sceneSet   = std::make_unique<nvvk::DescriptorSetContainer>(m_device);
     m_nrdSet     = std::make_unique<nvvk::DescriptorSetContainer>(m_device);
+    m_diagnostics = std::make_unique<Diagnostics>(m_device, m_alloc.get(), m_deletionQueue);
+
+    // Replaced resources are kept alive while the frames in flight may still use them
+    m_deletionQueue.setLatency(m_app->getFrameCycleSize());
+
+    // Pool of the reusable command buffers
+    VkCommandPoolCreateInfo poolInfo{VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
+    poolInfo.queueFamilyIndex = m_app->getQueue(0).familyIndex;
+    NVVK_CHECK(vkCreateCommandPool(m_device, &poolInfo, nullptr, &m_chainCmdPool));
 
-    m_hdrEnv->loadEnvironment("");
+    // Passes of the frame recorded concurrently, with command pools per pass and frame cycle slot.
+    // Two workers of its own, the calling thread records the third pass.
+    m_recorder = std::make_unique<ParallelRecorder>(m_device, m_app->getQueue(0).familyIndex, 2, m_app->getFrameCycleSize());
+
+    // Workers of the background tasks, leaving a hardware thread to the main thread and to each
+    // worker of the recorder: the importance sampling tables of the environments are built on them
+    m_threadPool = std::make_unique<ThreadPool>(std::max(std::thread::hardware_concurrency(), 4u) - 3);
+    m_hdrEnv = std::make_unique<HdrEnvironment>(m_device, m_alloc.get(), *m_threadPool, m_app->getQueue(0).familyIndex);
+
+    // Scenes are loaded in the background, with the images decoded on the same workers
+    m_sceneLoader = std::make_unique<SceneLoader>(m_device, m_app->getPhysicalDevice(), m_alloc.get(),
+                                                  m_app->getQueue(0).queue, m_app->getQueue(0).familyIndex, *m_threadPool);
+
+    // Staging of the uploads done while rendering, on the upload queue (see main())
+    m_stagingRing = std::make_unique<StagingRing>(m_device, m_alloc.get(), 128ull << 20);
+
+    m_hdrSunExtracted = extractHdrSun();
+    m_hdrEnv->loadEnvironment("", m_hdrSunExtracted);
 
     // Requesting ray tracing properties
-    VkPhysicalDeviceRayTracingPipelinePropertiesKHR rt_prop{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_PROPERTIES_KHR};
     VkPhysicalDeviceProperties2 prop2{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2};
-    prop2.pNext = &rt_prop;
+    prop2.pNext = &m_rtProperties;
     vkGetPhysicalDeviceProperties2(m_app->getPhysicalDevice(), &prop2);
     // Create utilities to create the Shading Binding Table (SBT)
-    uint32_t gct_queue_index = m_app->getQueue(0).familyIndex;
-    m_sbt->setup(m_app->getDevice(), gct_queue_index, m_alloc.get(), rt_prop);
+    m_sbt->setup(m_app->getDevice(), m_app->getQueue(0).familyIndex, m_alloc.get(), m_rtProperties);
 
     // Create resources
     createGbuffers(m_viewSize);
@@ -186,6 +287,9 @@ public:
     m_tonemapper->createComputePipeline();
     createCompositionPipeline();
     createTaaPipeline();
+    createThumbnailPipeline();
+    createExposurePipelines();
+    createFireflyPipelines();
   }
 
   void onDetach() override
@@ -194,15 +298,15 @@ public:
     destroyResources();
   }
 
+  // The previous G-Buffers and denoiser go through the deletion queue: the frames in flight may still
+  // be using them, while the new ones are created alongside.
   void onResize(uint32_t width, uint32_t height) override
   {
-    vkDeviceWaitIdle(m_device);
-
     createGbuffers({width, height});
+    m_diagnostics->resize(m_gBuffers->getSize());
 
-    m_tonemapper->updateComputeDescriptorSets(m_gBuffers->getDescriptorImageInfo(eGBufTaa),
+    m_tonemapper->updateComputeDescriptorSets(m_gBuffers->getDescriptorImageInfo(eGBufExposed),
                                               m_gBuffers->getDescriptorImageInfo(eGBufLdr));
-    writeRtxSet();
 
     nvvk::Texture userTexturePool[size_t(nrd::ResourceType::MAX_NUM)] = {};
 
@@ -219,12 +323,14 @@ public:
     poolTextureFromGBufTexture(nrd::ResourceType::IN_VIEWZ, eGBufViewZ);
     poolTextureFromGBufTexture(nrd::ResourceType::OUT_DIFF_RADIANCE_HITDIST, eGBufOutDiffRadianceHitDist);
     poolTextureFromGBufTexture(nrd::ResourceType::OUT_SPEC_RADIANCE_HITDIST, eGBufOutSpecRadianceHitDist);
-    poolTextureFromGBufTexture(nrd::ResourceType::OUT_VALIDATION, eGBufOutDebugView);
+    // Only present while the validation view is displayed
+    userTexturePool[size_t(nrd::ResourceType::OUT_VALIDATION)] = m_diagnostics->getTexture(Diagnostics::eNrdValidation);
 
     poolTextureFromGBufTexture(nrd::ResourceType::IN_SIGNAL, eGBufDiffRadianceHitDist);
     poolTextureFromGBufTexture(nrd::ResourceType::OUT_SIGNAL, eGBufOutDiffRadianceHitDist);
 
 
+    m_deletionQueue.retire(m_nrd);
     m_nrd.reset(new NRDWrapper(*m_alloc, width, height, userTexturePool));
   }
 
@@ -248,22 +354,25 @@ public:
       load_file = true;
     }
 
+    // GLFW only allows the dialog on the main thread; the chosen file is loaded in the background
     if(load_file)
     {
       auto filename = NVPSystem::windowOpenFileDialog(m_app->getWindowHandle(), "Load glTF | HDR",
                                                       "glTF(.gltf, .glb), HDR(.hdr)|*.gltf;*.glb;*.hdr");
-      onFileDrop(filename.c_str());
+      if(!filename.empty())
+      {
+        onFileDrop(filename.c_str());
+      }
     }
   }
 
   void onFileDrop(const char* filename) override
   {
     namespace fs = std::filesystem;
-    vkDeviceWaitIdle(m_device);
     std::string extension = fs::path(filename).extension().string();
     if(extension == ".gltf" || extension == ".glb")
     {
-      createScene(filename);
+      m_sceneLoader->load(filename);  // the current scene is rendered until the new one is ready
     }
     else if(extension == ".hdr")
     {
@@ -280,20 +389,62 @@ public:
     using namespace ImGuiH;
 
     bool reset{false};
+
+    // Take the scene being loaded in the background over, once complete
+    m_sceneLoader->setStepBudget(m_settings.blasStepBudget);
+    m_sceneLoader->setScratchBudget(VkDeviceSize(m_settings.blasScratchBudget) << 20);
+    m_sceneLoader->setOptimizeMeshes(m_settings.optimizeMeshes);
+    m_sceneLoader->setQuantizeVertices(m_settings.quantizeVertices);
+    m_sceneLoader->setCompressTextures(m_settings.compressTextures);
+    m_sceneLoader->setGenerateMips(m_settings.generateMips);
+    if(m_sceneLoader->update())
+    {
+      createScene(m_sceneLoader->take());
+    }
+
+    // Textures moved to the levels requested by the last frames: the descriptors are written to the
+    // next set of the ring, the frames in flight keep using theirs
+    if(m_textureStreamer)
+    {
+      m_textureStreamer->setBudget(VkDeviceSize(m_settings.textureBudget) << 20);
+    }
+    if(m_textureStreamer && m_textureStreamer->update())
+    {
+      m_sceneSetIndex = (m_sceneSetIndex + 1) % (m_app->getFrameCycleSize() + 1);
+      writeSceneSet();
+    }
+
     // Pick under mouse cursor
     if(ImGui::IsMouseDoubleClicked(ImGuiMouseButton_Left) || ImGui::IsKeyPressed(ImGuiKey_Space))
     {
       screenPicking();
     }
+    if(m_pickSerial && m_frameSerial >= *m_pickSerial + m_app->getFrameCycleSize())
+    {
+      applyPickResult();
+    }
     if(ImGui::IsKeyPressed(ImGuiKey_M))
     {
       onResize(m_app->getViewportSize().width, m_app->getViewportSize().height);  // Force recreation of G-Buffers
       reset = true;
     }
 
+    m_thumbnailsVisible = false;  // set again below if the "Denoiser" panel is open
+
     {  // Setting menu
       ImGui::Begin("Settings");
 
+      if(m_sceneLoader->isBusy())
+      {
+        std::string label = std::string(SceneLoader::getStageName(m_sceneLoader->getStage())) + " "
+                            + std::filesystem::path(m_sceneLoader->getFilename()).filename().string();
+        if(const SceneAccel* accel = m_sceneLoader->getSceneAccel(); accel && m_sceneLoader->getStage() == SceneLoader::Stage::eBuildingBlas)
+        {
+          label += " (" + std::to_string(accel->getBuiltBlas()) + "/" + std::to_string(accel->getBlasCount()) + ")";
+        }
+        ImGui::ProgressBar(m_sceneLoader->getProgress(), ImVec2(-1.F, 0.F), label.c_str());
+      }
+
       if(ImGui::CollapsingHeader("Camera"))
       {
         ImGuiH::CameraWidget();
@@ -308,11 +459,61 @@ public:
           reset |= PropertyEditor::entry("Depth", [&] { return ImGui::SliderInt("#1", &m_settings.maxDepth, 1, 10); });
           reset |= PropertyEditor::entry("Frames",
                                          [&] { return ImGui::DragInt("#3", &m_settings.maxFrames, 5.0F, 1, 1000000); });
-          ImGui::SliderFloat("Override Roughness", &m_pushConst.overrideRoughness, 0, 1, "%.3f");
-          ImGui::SliderFloat("Override Metalness", &m_pushConst.overrideMetallic, 0, 1, "%.3f");
+          ImGui::SliderFloat("Override Roughness", &m_settings.overrideRoughness, 0, 1, "%.3f");
+          ImGui::SliderFloat("Override Metalness", &m_settings.overrideMetallic, 0, 1, "%.3f");
+          PropertyEditor::entry("Adaptive Firefly Clamp", [&] { return ImGui::Checkbox("##AdaptiveFirefly", &m_settings.adaptiveFirefly); },
+                                "Clamp the indirect radiance against a high percentile of the previous frame's luminance");
+          if(m_settings.adaptiveFirefly)
+          {
+            PropertyEditor::entry("Percentile", [&] {
+              return ImGui::SliderFloat("##FireflyPercentile", &m_settings.fireflyPercentile, 0.9F, 1.F, "%.4f");
+            });
+            PropertyEditor::entry("Headroom", [&] {
+              return ImGui::SliderFloat("##FireflyHeadroom", &m_settings.fireflyHeadroom, 1.F, 16.F, "%.1f");
+            });
+          }
+          else
+          {
+            PropertyEditor::entry("Max Luminance", [&] {
+              return ImGui::DragFloat("##MaxLuminance", &m_settings.maxLuminance, 0.1F, 0.01F, 10000.F, "%.2f",
+                                      ImGuiSliderFlags_Logarithmic);
+            });
+          }
 
           PropertyEditor::treePop();
         }
+        if(PropertyEditor::treeNode("Scene Loading"))
+        {
+          PropertyEditor::entry("BLAS Step Budget", [&] {
+            return ImGui::SliderFloat("##BlasStepBudget", &m_settings.blasStepBudget, 0.5F, 16.F, "%.1f ms");
+          }, "GPU time of each step of BLAS builds, submitted once per frame while a scene loads");
+          PropertyEditor::entry("BLAS Scratch Budget", [&] {
+            return ImGui::SliderInt("##BlasScratchBudget", &m_settings.blasScratchBudget, 16, 2048, "%d MB",
+                                    ImGuiSliderFlags_Logarithmic);
+          }, "Scratch memory shared by the BLAS build steps, used from the next load on");
+          PropertyEditor::entry("Optimize Meshes", [&] { return ImGui::Checkbox("##OptimizeMeshes", &m_settings.optimizeMeshes); },
+                                "Weld vertices, remove degenerate and duplicate triangles, and reorder the meshes for the "
+                                "vertex fetches, from the next load on");
+          PropertyEditor::entry("Quantize Vertices", [&] { return ImGui::Checkbox("##QuantizeVertices", &m_settings.quantizeVertices); },
+                                "Octahedral 16-bit normals and tangents, 16-bit texture coordinates and indices, "
+                                "from the next load on");
+          PropertyEditor::entry("Compress Textures", [&] { return ImGui::Checkbox("##CompressTextures", &m_settings.compressTextures); },
+                                "Compress the JPG/PNG textures to BC7 when the device samples it, cached on disk for the "
+                                "next loads, from the next load on");
+          PropertyEditor::entry("GPU Mipmaps", [&] { return ImGui::Checkbox("##GenerateMips", &m_settings.generateMips); },
+                                "Generate the mip chains of the textures embedded in the file with a compute shader, "
+                                "rather than with blits, from the next load on");
+          PropertyEditor::entry("Texture Budget", [&] {
+            return ImGui::SliderInt("##TextureBudget", &m_settings.textureBudget, 64, 8192, "%d MB", ImGuiSliderFlags_Logarithmic);
+          }, "Memory of the streamed texture mip levels, the largest textures are kept coarser beyond it");
+          const TextureStreamer::Statistics stats = m_textureStreamer ? m_textureStreamer->getStatistics() : TextureStreamer::Statistics{};
+          PropertyEditor::entry("Streamed Textures", [&] {
+            ImGui::Text("%.1f / %.1f MB (%.1f MB requested, %u/%u updating)", float(stats.residentSize) / (1 << 20),
+                        float(stats.fullSize) / (1 << 20), float(stats.requestedSize) / (1 << 20), stats.pendingImages, stats.images);
+            return false;
+          }, "Resident mip levels of the streamed images, out of their full mip chains");
+          PropertyEditor::treePop();
+        }
         PropertyEditor::entry("Show Axis", [&] { return ImGui::Checkbox("##4", &m_settings.showAxis); });
         PropertyEditor::end();
       }
@@ -335,11 +536,71 @@ public:
           PropertyEditor::entry("Rotation", [&] { return ImGui::SliderAngle("Rotation", &m_settings.envRotation); }, "Rotating the environment");
           PropertyEditor::treePop();
         }
+        if(PropertyEditor::treeNode("Sun"))
+        {
+          reset |= PropertyEditor::entry("Enable", [&] { return ImGui::Checkbox("##SunEnabled", &m_settings.sunEnabled); },
+                                         "Sample an analytic sun disk together with the environment");
+          PropertyEditor::entry("Extract from HDR", [&] { return ImGui::Checkbox("##ExtractSun", &m_settings.extractSun); },
+                                "Remove the sun from the HDR when loading it, so that it is only lit by the analytic sun");
+          reset |= PropertyEditor::entry("Use HDR Sun", [&] { return ImGui::Checkbox("##SunFromHdr", &m_settings.sunFromHdr); },
+                                         "Use the sun found in the HDR rather than the values below");
+          // The sun removed from the HDR must be added back by the analytic one
+          if(extractHdrSun() != m_hdrSunExtracted)
+          {
+            createHdr(m_hdrFilename.c_str());
+            reset = true;
+          }
+          if(!m_settings.sunFromHdr)
+          {
+            reset |= PropertyEditor::entry("Azimuth", [&] { return ImGui::SliderAngle("##SunAzimuth", &m_settings.sunAzimuth, -180.F, 180.F); });
+            reset |= PropertyEditor::entry("Elevation", [&] { return ImGui::SliderAngle("##SunElevation", &m_settings.sunElevation, -90.F, 90.F); });
+            reset |= PropertyEditor::entry("Angular Radius", [&] {
+              return ImGui::SliderFloat("##SunAngle", &m_settings.sunAngle, 0.05F, 5.F, "%.2f deg", ImGuiSliderFlags_Logarithmic);
+            });
+            reset |= PropertyEditor::entry("Color", [&] { return ImGui::ColorEdit3("##SunColor", &m_settings.sunColor.x); });
+            reset |= PropertyEditor::entry("Intensity", [&] {
+              return ImGui::SliderFloat("##SunIntensity", &m_settings.sunIntensity, 0.F, 1000000.F, "%.0f", ImGuiSliderFlags_Logarithmic);
+            });
+          }
+          else
+          {
+            const HdrEnvironment::Sun& sun = m_hdrEnv->getSun();
+            PropertyEditor::entry("Angular Radius", [&] {
+              if(sun.valid)
+                ImGui::Text("%.2f deg", glm::degrees(sun.angularRadius));
+              else
+                ImGui::TextDisabled("No sun found in the HDR");
+              return false;
+            });
+          }
+          PropertyEditor::treePop();
+        }
         PropertyEditor::end();
       }
 
+      if(ImGui::CollapsingHeader("Material"))
+      {
+        materialUI();
+      }
+
       if(ImGui::CollapsingHeader("Tonemapper"))
       {
+        PropertyEditor::begin();
+        PropertyEditor::entry("Auto Exposure", [&] { return ImGui::Checkbox("##AutoExposure", &m_settings.autoExposure); },
+                              "Exposure derived from the luminance histogram of the image, before the tonemapper");
+        if(m_settings.autoExposure)
+        {
+          PropertyEditor::entry("Compensation", [&] {
+            return ImGui::SliderFloat("##Compensation", &m_settings.exposureCompensation, -5.F, 5.F, "%.1f EV");
+          });
+          PropertyEditor::entry("Adaptation Speed",
+                                [&] { return ImGui::SliderFloat("##Speed", &m_settings.exposureSpeed, 0.1F, 10.F); });
+          PropertyEditor::entry("Percentiles", [&] {
+            return ImGui::DragFloatRange2("##Percentiles", &m_settings.exposurePercentiles.x,
+                                          &m_settings.exposurePercentiles.y, 0.005F, 0.F, 1.F);
+          });
+        }
+        PropertyEditor::end();
         m_tonemapper->onUI();
       }
 
@@ -349,13 +610,18 @@ public:
 
         const char* const items[] = {"ReLAX", "ReBLUR", "Reference"};
         if(PropertyEditor::entry("Method",
-                                 [&]() { return ImGui::ListBox("Method", &m_pushConst.method, items, arraySize(items)); }))
+                                 [&]() { return ImGui::ListBox("Method", &m_settings.method, items, arraySize(items)); }))
         {
           reset = true;
         }
 
         PropertyEditor::entry("Split",
-                              [&]() { return ImGui::SliderFloat("#Split", &m_nrdSettings.splitScreen, 0.0, 1.0f); });
+                              [&]() { return ImGui::SliderFloat("#Split", &m_settings.splitScreen, 0.0, 1.0f); });
+        PropertyEditor::entry(
+            "Reuse Command Buffers", [&]() { return ImGui::Checkbox("##ReuseCmd", &m_settings.reuseCommandBuffers); },
+            "Record the denoising, composition and TAA passes once, and only re-record them when their inputs change");
+        PropertyEditor::entry("Parallel Recording", [&]() { return ImGui::Checkbox("##ParallelRec", &m_settings.parallelRecording); },
+                              "Record the ray tracing, denoising and post-processing passes on worker threads");
 
         if(PropertyEditor::entry("Denoiser Values", [&]() { return ImGui::Button("Reset"); }))
         {
@@ -372,34 +638,64 @@ public:
       // #NRD
       if(ImGui::CollapsingHeader("Denoiser", ImGuiTreeNodeFlags_DefaultOpen))
       {
-        ImVec2 tumbnailSize = {100 * m_gBuffers->getAspectRatio(), 100};
+        m_thumbnailsVisible = true;
+
+        PropertyEditor::begin();
+        PropertyEditor::entry("Refresh Interval", [&]() {
+          return ImGui::SliderInt("##ThumbnailInterval", &m_settings.thumbnailInterval, 1, 120, "%d frames");
+        });
+        if(PropertyEditor::entry("Thumbnails", [&]() { return ImGui::Button("Refresh"); }))
+        {
+          m_thumbnailsDirty = true;
+        }
+        PropertyEditor::end();
+
+        // All previews are tiles of the thumbnail atlas, see updateThumbnails()
+        VkDescriptorSet atlasSet      = m_thumbnails->getDescriptorSet(0);
+        ImVec2          tumbnailSize  = getThumbnailTileSize();
+        auto            thumbnailTile = [&](const char* name, ThumbnailTile tile) {
+          ImVec2 uv0 = {float(tile % eThumbColumns) / eThumbColumns, float(tile / eThumbColumns) / eThumbRows};
+          ImVec2 uv1 = {uv0.x + 1.F / eThumbColumns, uv0.y + 1.F / eThumbRows};
+          return ImGui::ImageButton(name, atlasSet, tumbnailSize, uv0, uv1);
+        };
+
+        auto showBuffer = [&](const char* name, GbufferNames buffer, ThumbnailTile tile) {
+          ImGui::Text("%s", name);
+          if(thumbnailTile(name, tile))
+          {
+            m_showBuffer     = buffer;
+            m_showDiagnostic = Diagnostics::eNone;
+          }
+        };
 
-        auto showBuffer = [&](const char* name, GbufferNames buffer) {
+        // Diagnostic images only exist while they are displayed, so there is nothing to preview otherwise
+        auto showDiagnostic = [&](const char* name, Diagnostics::Buffer buffer, ThumbnailTile tile) {
           ImGui::Text("%s", name);
-          if(ImGui::ImageButton(name, m_gBuffers->getDescriptorSet(buffer), tumbnailSize))
-            m_showBuffer = buffer;
+          bool clicked = m_diagnostics->isActive() ? thumbnailTile(name, tile) : ImGui::Button(name, tumbnailSize);
+          if(clicked)
+            m_showDiagnostic = buffer;
         };
 
         if(ImGui::BeginTable("thumbnails", 2))
         {
           ImGui::TableNextRow();
           ImGui::TableNextColumn();
-          showBuffer("Diffuse Radiance\n(REBLUR: YCoCg)", eGBufDiffRadianceHitDist);
+          showBuffer("Diffuse Radiance", eGBufDiffRadianceHitDist, eThumbDiff);
           ImGui::TableNextColumn();
-          showBuffer("Specular Radiance\n(REBLUR: YCoCg)", eGBufSpecRadianceHitDist);
+          showBuffer("Specular Radiance", eGBufSpecRadianceHitDist, eThumbSpec);
           ImGui::TableNextRow();
           ImGui::TableNextColumn();
-          showBuffer("Normal/Roughness", eGBufNormalRoughness);
+          showBuffer("Normal/Roughness", eGBufNormalRoughness, eThumbNormalRoughness);
           ImGui::TableNextColumn();
-          showBuffer("Denoised", eGBufDenoisedUnpacked);
+          showBuffer("Denoised", eGBufDenoisedUnpacked, eThumbDenoised);
           ImGui::TableNextRow();
           ImGui::TableNextColumn();
-          showBuffer("TAA", eGBufTaa);
+          showBuffer("TAA", eGBufTaa, eThumbTaa);
           ImGui::TableNextColumn();
-          showBuffer("LDR", eGBufLdr);
+          showBuffer("LDR", eGBufLdr, eThumbLdr);
           ImGui::TableNextRow();
           ImGui::TableNextColumn();
-          showBuffer("NRD Debug", eGBufOutDebugView);
+          showDiagnostic("NRD Validation", Diagnostics::eNrdValidation, eThumbNrdValidation);
 
           ImGui::EndTable();
         }
@@ -413,7 +709,9 @@ public:
       }
     }
 
-    m_tonemapper->updateComputeDescriptorSets(m_gBuffers->getDescriptorImageInfo(eGBufTaa),
+    updateDiagnostics();
+
+    m_tonemapper->updateComputeDescriptorSets(m_gBuffers->getDescriptorImageInfo(eGBufExposed),
                                               m_gBuffers->getDescriptorImageInfo(eGBufLdr));
 
 
@@ -421,16 +719,50 @@ public:
       ImGui::PushStyleVar(ImGuiStyleVar_WindowPadding, ImVec2(0.0F, 0.0F));
       ImGui::Begin("Viewport");
 
-      // Display the G-Buffer image
-      ImGui::Image(m_gBuffers->getDescriptorSet(m_showBuffer), ImGui::GetContentRegionAvail());
+      // Display the G-Buffer image, or the selected diagnostic image
+      VkDescriptorSet view_set = (m_showDiagnostic != Diagnostics::eNone && m_diagnostics->isActive()) ?
+                                     m_diagnostics->getDescriptorSet(m_showDiagnostic) :
+                                     m_gBuffers->getDescriptorSet(m_showBuffer);
+      ImGui::Image(view_set, ImGui::GetContentRegionAvail());
 
       ImGui::End();
       ImGui::PopStyleVar();
     }
   }
 
+  //--------------------------------------------------------------------------------------------------
+  // The camera and the settings the frame is recorded from
+  //
+  FrameSnapshot takeSnapshot() const
+  {
+    FrameSnapshot snapshot;
+    snapshot.settings          = m_settings;
+    snapshot.reblur            = m_reblurSettings;
+    snapshot.relax             = m_relaxSettings;
+    snapshot.view              = CameraManip.getMatrix();
+    snapshot.fov               = CameraManip.getFov();
+    snapshot.clipPlanes        = CameraManip.getClipPlanes();
+    snapshot.mouseCoord        = g_dbgPrintf->getMouseCoord();
+    snapshot.deltaTime         = ImGui::GetIO().DeltaTime;
+    snapshot.thumbnailsVisible = m_thumbnailsVisible;
+    return snapshot;
+  }
+
   void onRender(VkCommandBuffer cmd) override
   {
+    // The fence of this frame cycle slot was waited on: resources retired a full cycle ago are not in use anymore
+    m_deletionQueue.nextFrame();
+    m_recorder->beginFrame(m_app->getFrameCycleIndex());
+    if(m_textureStreamer)
+    {
+      m_textureStreamer->readFeedback(m_app->getFrameCycleIndex());
+    }
+
+    ++m_frameSerial;
+
+    // Everything below reads the UI state from this snapshot only
+    m_render = takeSnapshot();
+
     if(!m_scene->valid())
     {
       return;
@@ -440,17 +772,16 @@ public:
 
     auto scope_dbg = m_dutil->DBG_SCOPE(cmd);
 
+    // Material edits of the UI, before anything reads the materials
+    recordMaterialPatches(cmd);
+
     // Get camera info
-    float     view_aspect_ratio = m_viewSize.x / m_viewSize.y;
-    glm::vec3 eye;
-    glm::vec3 center;
-    glm::vec3 up;
-    CameraManip.getLookat(eye, center, up);
+    float view_aspect_ratio = m_viewSize.x / m_viewSize.y;
 
     // Update Frame buffer uniform buffer
-    const auto& clip = CameraManip.getClipPlanes();
-    m_frameInfo.view = CameraManip.getMatrix();
-    m_frameInfo.proj = glm::perspectiveRH_ZO(glm::radians(CameraManip.getFov()), view_aspect_ratio, clip.x, clip.y);
+    const glm::vec2& clip = m_render.clipPlanes;
+    m_frameInfo.view      = m_render.view;
+    m_frameInfo.proj = glm::perspectiveRH_ZO(glm::radians(m_render.fov), view_aspect_ratio, clip.x, clip.y);
 
     auto unflippedProj = m_frameInfo.proj;  // There's some weirness going on with the vertical
 
@@ -459,18 +790,20 @@ public:
 
     m_frameInfo.projInv     = glm::inverse(m_frameInfo.proj);
     m_frameInfo.viewInv     = glm::inverse(m_frameInfo.view);
-    m_frameInfo.envRotation = m_settings.envRotation;
-    m_frameInfo.clearColor  = m_settings.clearColor;
+    m_frameInfo.envRotation = m_render.settings.envRotation;
+    m_frameInfo.clearColor  = m_render.settings.clearColor;
     m_frameInfo.jitter      = halton(m_frame) - vec2(0.5);
-
-    vkCmdUpdateBuffer(cmd, m_bFrameInfo.buffer, 0, sizeof(FrameInfo), &m_frameInfo);
+    updateSun();
 
     // Push constant
-    m_pushConst.maxDepth   = m_settings.maxDepth;
-    m_pushConst.frame      = m_frame;
-    m_pushConst.mouseCoord = g_dbgPrintf->getMouseCoord();
-
-    raytraceScene(cmd);
+    m_pushConst.maxDepth          = m_render.settings.maxDepth;
+    m_pushConst.frame             = m_frame;
+    m_pushConst.mouseCoord        = m_render.mouseCoord;
+    m_pushConst.adaptiveFirefly   = m_render.settings.adaptiveFirefly ? 1 : 0;
+    m_pushConst.method            = m_render.settings.method;
+    m_pushConst.maxLuminance      = m_render.settings.maxLuminance;
+    m_pushConst.overrideRoughness = m_render.settings.overrideRoughness;
+    m_pushConst.overrideMetallic  = m_render.settings.overrideMetallic;
 
     // #NRD
     {
@@ -508,43 +841,140 @@ public:
 
         m_nrdSettings.isMotionVectorInWorldSpace = true;
 
-        // We want to visualize the denoiser's debug texture
-        m_nrdSettings.enableValidation = true;
+        // NRD only runs its validation pass while the validation view is displayed
+        m_nrdSettings.enableValidation = m_diagnostics->isActive();
+        m_nrdSettings.splitScreen      = m_render.settings.splitScreen;
 
         m_nrd->setCommonSettings(m_nrdSettings);
       }
 
       switch(m_pushConst.method)
       {
-        case NRD_REBLUR: {
-          m_nrd->setREBLURSettings(m_reblurSettings);
-          nrd::Identifier denoiser = nrd::Identifier(nrd::Denoiser::REBLUR_DIFFUSE_SPECULAR);
-          // Perform the denoising!
-          m_nrd->denoise(&denoiser, 1, cmd);
+        case NRD_REBLUR:
+          m_nrd->setREBLURSettings(m_render.reblur);
           break;
-        }
-        case NRD_RELAX: {
-          m_nrd->setRELAXSettings(m_relaxSettings);
-          nrd::Identifier denoiser = nrd::Identifier(nrd::Denoiser::RELAX_DIFFUSE_SPECULAR);
-          // Perform the denoising!
-          m_nrd->denoise(&denoiser, 1, cmd);
+        case NRD_RELAX:
+          m_nrd->setRELAXSettings(m_render.relax);
           break;
-        }
-        default: {
-          auto poolTextureFromGBufTexture = [&](GbufferNames gbufIndex) -> nvvk::Texture {
-            return {m_gBuffers->getColorImage(gbufIndex), nvvk::NullMemHandle, m_gBuffers->getDescriptorImageInfo(gbufIndex)};
-          };
-          nrd::Identifier denoisers[] = {nrd::Identifier(nrd::Denoiser::REFERENCE), nrd::Identifier(nrd::Denoiser::REFERENCE) + 1};
-          m_nrd->setUserPoolTexture(nrd::ResourceType::IN_SIGNAL, poolTextureFromGBufTexture(eGBufDiffRadianceHitDist));
-          m_nrd->setUserPoolTexture(nrd::ResourceType::OUT_SIGNAL, poolTextureFromGBufTexture(eGBufOutDiffRadianceHitDist));
-          m_nrd->denoise(&denoisers[0], 1, cmd);
-          m_nrd->setUserPoolTexture(nrd::ResourceType::IN_SIGNAL, poolTextureFromGBufTexture(eGBufSpecRadianceHitDist));
-          m_nrd->setUserPoolTexture(nrd::ResourceType::OUT_SIGNAL, poolTextureFromGBufTexture(eGBufOutSpecRadianceHitDist));
-          m_nrd->denoise(&denoisers[1], 1, cmd);
-        }
       }
     }
 
+    // Denoising, composition and TAA only depend on the G-Buffers and the settings, besides the
+    // constants uploaded by NRD. The reference denoiser swaps its pool textures mid-way and is
+    // always recorded directly.
+    VkCommandBuffer recordedChain = VK_NULL_HANDLE;
+    if(m_render.settings.reuseCommandBuffers && m_pushConst.method != NRD_REFERENCE)
+    {
+      recordedChain = getRecordedChain(cmd);
+    }
+
+    // The passes of the frame. They only read the state updated above, and each writes its own
+    // members, so that they can be recorded concurrently. Each sets all the pipeline state it uses,
+    // push constants included: the secondary command buffers inherit none.
+    ParallelRecorder::Pass tracePass = [this, slot = m_app->getFrameCycleIndex()](VkCommandBuffer c) {
+      vkCmdUpdateBuffer(c, m_bFrameInfo.buffer, 0, sizeof(FrameInfo), &m_frameInfo);
+
+      // Texture levels requested by this frame, read back once its slot comes around again
+      m_textureStreamer->cmdClearFeedback(c);
+      raytraceScene(c);
+      m_textureStreamer->cmdCopyFeedback(c, slot);
+
+      // Firefly clamp for the next frame, from the radiance of this one
+      computeFireflyClamp(c);
+    };
+    ParallelRecorder::Pass denoisePass = [this](VkCommandBuffer c) {
+      denoise(c);
+      recordPostDenoise(c);
+    };
+    ParallelRecorder::Pass postPass = [this](VkCommandBuffer c) {
+      {
+        VkMemoryBarrier barrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT};
+        vkCmdPipelineBarrier(c, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+                             &barrier, 0, nullptr, 0, nullptr);
+      }
+
+      // Exposure for the next frame, from the luminance of this one
+      computeExposure(c);
+
+      // Apply tonemapper - take GBuffer-X and output to GBuffer-0
+      m_tonemapper->runCompute(c, m_gBuffers->getSize());
+
+      // Render corner axis
+      renderAxis(c);
+
+      // Downsample the buffers shown in the "Denoiser" panel
+      updateThumbnails(c);
+    };
+
+    if(m_render.settings.parallelRecording)
+    {
+      std::vector<VkCommandBuffer> secondaries =
+          m_recorder->record({tracePass, recordedChain ? ParallelRecorder::Pass{} : denoisePass, postPass});
+      if(recordedChain)
+      {
+        secondaries[1] = recordedChain;
+      }
+      ParallelRecorder::execute(cmd, secondaries);
+    }
+    else
+    {
+      tracePass(cmd);
+      if(recordedChain)
+      {
+        vkCmdExecuteCommands(cmd, 1, &recordedChain);
+      }
+      else
+      {
+        denoisePass(cmd);
+      }
+      postPass(cmd);
+    }
+
+    recordPicking(cmd);
+
+    m_frame++;
+  }
+
+
+  //--------------------------------------------------------------------------------------------------
+  // Run the NRD denoiser selected by m_pushConst.method
+  //
+  void denoise(VkCommandBuffer cmd)
+  {
+    switch(m_pushConst.method)
+    {
+      case NRD_REBLUR: {
+        nrd::Identifier denoiser = nrd::Identifier(nrd::Denoiser::REBLUR_DIFFUSE_SPECULAR);
+        // Perform the denoising!
+        m_nrd->denoise(&denoiser, 1, cmd);
+        break;
+      }
+      case NRD_RELAX: {
+        nrd::Identifier denoiser = nrd::Identifier(nrd::Denoiser::RELAX_DIFFUSE_SPECULAR);
+        // Perform the denoising!
+        m_nrd->denoise(&denoiser, 1, cmd);
+        break;
+      }
+      default: {
+        auto poolTextureFromGBufTexture = [&](GbufferNames gbufIndex) -> nvvk::Texture {
+          return {m_gBuffers->getColorImage(gbufIndex), nvvk::NullMemHandle, m_gBuffers->getDescriptorImageInfo(gbufIndex)};
+        };
+        nrd::Identifier denoisers[] = {nrd::Identifier(nrd::Denoiser::REFERENCE), nrd::Identifier(nrd::Denoiser::REFERENCE) + 1};
+        m_nrd->setUserPoolTexture(nrd::ResourceType::IN_SIGNAL, poolTextureFromGBufTexture(eGBufDiffRadianceHitDist));
+        m_nrd->setUserPoolTexture(nrd::ResourceType::OUT_SIGNAL, poolTextureFromGBufTexture(eGBufOutDiffRadianceHitDist));
+        m_nrd->denoise(&denoisers[0], 1, cmd);
+        m_nrd->setUserPoolTexture(nrd::ResourceType::IN_SIGNAL, poolTextureFromGBufTexture(eGBufSpecRadianceHitDist));
+        m_nrd->setUserPoolTexture(nrd::ResourceType::OUT_SIGNAL, poolTextureFromGBufTexture(eGBufOutSpecRadianceHitDist));
+        m_nrd->denoise(&denoisers[1], 1, cmd);
+      }
+    }
+  }
+
+  //--------------------------------------------------------------------------------------------------
+  // Everything between the denoiser and the tonemapper: composition and TAA
+  //
+  void recordPostDenoise(VkCommandBuffer cmd)
+  {
     auto shaderWriteToShaderRead = [this](GbufferNames buffer) {
       return nvvk::makeImageMemoryBarrier(m_gBuffers->getColorImage(buffer), VK_ACCESS_SHADER_WRITE_BIT,
                                           VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL);
@@ -560,12 +990,21 @@ public:
           shaderWriteToShaderRead(eGBufOutDiffRadianceHitDist), shaderWriteToShaderRead(eGBufOutSpecRadianceHitDist),
           shaderWriteToShaderRead(eGBufDirectLighting),         shaderWriteToShaderRead(eGBufNormalRoughness),
           shaderWriteToShaderRead(eGBufBaseColorMetalness),     shaderWriteToShaderRead(eGBufViewZ),
-          shaderWriteToShaderRead(eGBufOutDebugView),           shaderReadToShaderWrite(eGBufDenoisedUnpacked)};
+          shaderReadToShaderWrite(eGBufDenoisedUnpacked)};
 
       vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0,
                            nullptr, 0, nullptr, barriers.size(), barriers.data());
     }
 
+    // The validation output is only read by the UI
+    if(m_diagnostics->isActive())
+    {
+      auto barrier = nvvk::makeImageMemoryBarrier(m_diagnostics->getImage(Diagnostics::eNrdValidation), VK_ACCESS_SHADER_WRITE_BIT,
+                                                  VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL);
+      vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0,
+                           nullptr, 0, nullptr, 1, &barrier);
+    }
+
     // Assemble denoised diffuse and specular radiances
     compose(cmd, m_gBuffers->getColorImageView(eGBufDenoisedUnpacked));
 
@@ -582,37 +1021,103 @@ public:
 
     // Apply temporal aliasing
     applyTaa(cmd);
+  }
 
-    // Apply tonemapper - take GBuffer-X and output to GBuffer-0
-    m_tonemapper->runCompute(cmd, m_gBuffers->getSize());
+  //--------------------------------------------------------------------------------------------------
+  // Denoising, composition and TAA through reusable secondary command buffers.
+  // NRD records this frame's constants into 'cmd' and returns a key of its dispatch list. The chain
+  // recorded for that key is returned again, so that nothing else gets recorded while the
+  // G-Buffers and the settings don't change. Returns VK_NULL_HANDLE when NRD could not prepare the
+  // dispatches, for the frame to be recorded directly.
+  //
+  VkCommandBuffer getRecordedChain(VkCommandBuffer cmd)
+  {
+    nrd::Identifier denoiser = nrd::Identifier(m_pushConst.method == NRD_REBLUR ? nrd::Denoiser::REBLUR_DIFFUSE_SPECULAR :
+                                                                                  nrd::Denoiser::RELAX_DIFFUSE_SPECULAR);
+    uint64_t key = 0;
+    if(!m_nrd->prepare(&denoiser, 1, cmd, key))
+    {
+      return VK_NULL_HANDLE;
+    }
+    // Read by compose() and applyTaa()
+    NRDWrapper::hashValue(key, uint64_t(m_pushConst.method));
+    NRDWrapper::hashValue(key, m_render.settings.autoExposure ? 1 : 0);
 
-    // Render corner axis
-    renderAxis(cmd);
+    auto found = std::find_if(m_recordedChains.begin(), m_recordedChains.end(),
+                              [key](const RecordedChain& chain) { return chain.key == key; });
+    if(found == m_recordedChains.end())
+    {
+      RecordedChain chain{key};
+
+      VkCommandBufferAllocateInfo allocInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+      allocInfo.commandPool        = m_chainCmdPool;
+      allocInfo.level              = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+      allocInfo.commandBufferCount = 1;
+      NVVK_CHECK(vkAllocateCommandBuffers(m_device, &allocInfo, &chain.cmd));
+
+      // The frames in flight may all be executing the same chain
+      VkCommandBufferInheritanceInfo inheritance{VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO};
+      VkCommandBufferBeginInfo       beginInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+      beginInfo.flags            = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+      beginInfo.pInheritanceInfo = &inheritance;
+      NVVK_CHECK(vkBeginCommandBuffer(chain.cmd, &beginInfo));
+      m_nrd->recordDispatches(chain.cmd);
+      recordPostDenoise(chain.cmd);
+      NVVK_CHECK(vkEndCommandBuffer(chain.cmd));
+
+      // Keep the most recent chains only: NRD alternates between a couple of them
+      if(m_recordedChains.size() >= kMaxRecordedChains)
+      {
+        retireRecordedChain(m_recordedChains.back().cmd);
+        m_recordedChains.pop_back();
+      }
+      m_recordedChains.insert(m_recordedChains.begin(), chain);
+      found = m_recordedChains.begin();
+    }
 
-    m_frame++;
+    return found->cmd;
   }
 
+  void retireRecordedChain(VkCommandBuffer chain)
+  {
+    m_deletionQueue.push([device = m_device, pool = m_chainCmdPool, chain]() { vkFreeCommandBuffers(device, pool, 1, &chain); });
+  }
 
-private:
-  void createScene(const std::string& filename)
+  // To be called whenever an image or a buffer referenced by the recorded chains is replaced
+  void invalidateRecordedChains()
   {
-    if(!m_scene->load(filename))
+    for(const RecordedChain& chain : m_recordedChains)
     {
-      LOGE("Error loading scene");
-      return;
+      retireRecordedChain(chain.cmd);
     }
+    m_recordedChains.clear();
+  }
 
-    nvvkhl::setCamera(filename, m_scene->getRenderCameras(), m_scene->getSceneBounds());  // Camera auto-scene-fitting
-    g_elem_camera->setSceneRadius(m_scene->getSceneBounds().radius());                    // Navigation help
-
-    {  // Create the Vulkan side of the scene
-      auto cmd = m_app->createTempCmdBuffer();
-      m_sceneVk->create(cmd, *m_scene);
-      m_sceneRtx->create(cmd, *m_scene, *m_sceneVk, VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR);  // Create BLAS / TLAS
-
-      m_app->submitAndWaitTempCmdBuffer(cmd);
-
-      m_picker->setTlas(m_sceneRtx->tlas());
+private:
+  void createScene(SceneLoader::Result&& loaded)
+  {
+    nvvkhl::setCamera(loaded.filename, loaded.scene->getRenderCameras(), loaded.scene->getSceneBounds());  // Camera auto-scene-fitting
+    g_elem_camera->setSceneRadius(loaded.scene->getSceneBounds().radius());  // Navigation help
+
+    {  // Swap the Vulkan side of the scene, the frames in flight keep using the previous one
+      m_deletionQueue.retire(m_sceneVk);
+      m_deletionQueue.retire(m_sceneAccel);
+      m_deletionQueue.retire(m_vertexQuantizer);
+      m_deletionQueue.retire(m_textureStreamer);
+      m_scene           = std::move(loaded.scene);
+      m_sceneVk         = std::move(loaded.sceneVk);
+      m_sceneAccel      = std::move(loaded.sceneAccel);
+      m_vertexQuantizer = std::move(loaded.vertexQuantizer);
+
+      // The decoded images start as placeholders in m_sceneVk, and are streamed from here on
+      m_textureStreamer = std::make_unique<TextureStreamer>(m_device, m_alloc.get(), *m_stagingRing, m_app->getQueue(1).queue,
+                                                            m_app->getQueue(1).familyIndex, m_app->getQueue(0).familyIndex,
+                                                            m_deletionQueue, m_app->getFrameCycleSize());
+      m_textureStreamer->setup(m_scene->getModel(), *m_sceneVk, std::move(loaded.images), std::move(loaded.textures));
+
+      m_picker->setTlas(m_sceneAccel->tlas());
+      m_materialPatches.clear();
+      m_selectedMaterial = -1;
     }
 
     // Descriptor Set and Pipelines
@@ -622,16 +1127,21 @@ private:
     createRtxPipeline();  // must recreate due to texture changes
     writeSceneSet();
     writeRtxSet();
+
+    resetFrame();
   }
 
   void createGbuffers(const glm::vec2& size)
   {
+    invalidateRecordedChains();
+
     m_viewSize = size;
     VkExtent2D vk_size{static_cast<uint32_t>(m_viewSize.x), static_cast<uint32_t>(m_viewSize.y)};
 
     std::vector<VkFormat> color_buffers(eGBufNumBuffers);
     color_buffers[eGBufLdr] = VK_FORMAT_R8G8B8A8_UNORM;
     color_buffers[eGBufTaa] = VK_FORMAT_R16G16B16A16_SFLOAT;
+    color_buffers[eGBufExposed] = VK_FORMAT_R16G16B16A16_SFLOAT;
 
     // #NRD Create buffers according to NRD's requirements. Consult NRDDescs.h to learn
     // which (minimum) format is required for each input buffer type.
@@ -642,12 +1152,11 @@ private:
     color_buffers[eGBufViewZ]                  = VK_FORMAT_R16_SFLOAT;
     color_buffers[eGBufOutDiffRadianceHitDist] = VK_FORMAT_R16G16B16A16_SFLOAT;
     color_buffers[eGBufOutSpecRadianceHitDist] = VK_FORMAT_R16G16B16A16_SFLOAT;
-    color_buffers[eGBufOutDebugView]           = VK_FORMAT_R8G8B8A8_UNORM;
     color_buffers[eGBufDenoisedUnpacked]       = VK_FORMAT_R16G16B16A16_SFLOAT;
     color_buffers[eGBufDirectLighting]         = VK_FORMAT_R16G16B16A16_SFLOAT;
 
     // Creation of the GBuffers
-    m_gBuffers.reset();
+    m_deletionQueue.retire(m_gBuffers);
     m_gBuffers = std::make_unique<nvvkhl::GBuffer>(m_device, m_alloc.get(), vk_size, color_buffers, VK_FORMAT_UNDEFINED);
 
     m_dutil->setObjectName(m_gBuffers->getColorImage(eGBufOutDiffRadianceHitDist),
@@ -662,10 +1171,17 @@ private:
                            nrd::GetResourceTypeString(nrd::ResourceType::IN_NORMAL_ROUGHNESS));
     m_dutil->setObjectName(m_gBuffers->getColorImage(eGBufMotionVectors), nrd::GetResourceTypeString(nrd::ResourceType::IN_MV));
     m_dutil->setObjectName(m_gBuffers->getColorImage(eGBufViewZ), nrd::GetResourceTypeString(nrd::ResourceType::IN_VIEWZ));
-    m_dutil->setObjectName(m_gBuffers->getColorImage(eGBufOutDebugView),
-                           nrd::GetResourceTypeString(nrd::ResourceType::OUT_VALIDATION));
     m_dutil->setObjectName(m_gBuffers->getColorImage(eGBufDenoisedUnpacked), "AssembledHDR");
     m_dutil->setObjectName(m_gBuffers->getColorImage(eGBufDirectLighting), "DirectLightingHDR");
+    m_dutil->setObjectName(m_gBuffers->getColorImage(eGBufExposed), "ExposedHDR");
+
+    // Small atlas holding the previews of the "Denoiser" panel
+    ImVec2     tileSize = getThumbnailTileSize();
+    VkExtent2D atlasSize{uint32_t(tileSize.x) * eThumbColumns, uint32_t(tileSize.y) * eThumbRows};
+    m_deletionQueue.retire(m_thumbnails);
+    m_thumbnails = std::make_unique<nvvkhl::GBuffer>(m_device, m_alloc.get(), atlasSize, VK_FORMAT_R8G8B8A8_UNORM, VK_FORMAT_UNDEFINED);
+    m_dutil->setObjectName(m_thumbnails->getColorImage(0), "ThumbnailAtlas");
+    m_thumbnailsDirty = true;
 
     // Indicate the renderer to reset its frame
     resetFrame();
@@ -681,14 +1197,24 @@ private:
                                          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
     m_dutil->DBG_NAME(m_bFrameInfo.buffer);
 
+    // Auto-exposure state and histogram, only accessed by the GPU
+    m_bExposure = m_alloc->createBuffer(sizeof(ExposureData), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+    m_dutil->DBG_NAME(m_bExposure.buffer);
+    vkCmdFillBuffer(cmd, m_bExposure.buffer, 0, VK_WHOLE_SIZE, 0);
+
+    // Adaptive firefly clamp and its histogram, only accessed by the GPU
+    m_bFirefly = m_alloc->createBuffer(sizeof(FireflyData), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+    m_dutil->DBG_NAME(m_bFirefly.buffer);
+    vkCmdFillBuffer(cmd, m_bFirefly.buffer, 0, VK_WHOLE_SIZE, 0);
+
     m_app->submitAndWaitTempCmdBuffer(cmd);
   }
 
   void createRtxSet()
   {
     auto& d = m_rtxSet;
-    d->deinit();
-    d->init(m_device);
+    retireDescriptorSet(d);
+    d = std::make_unique<nvvk::DescriptorSetContainer>(m_device);
 
     // This descriptor set, holds the top level acceleration structure and the output image
     d->addBinding(RtxBindings::eTlas, VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, 1, VK_SHADER_STAGE_ALL);
@@ -702,15 +1228,20 @@ private:
   void createSceneSet()
   {
     auto& d = m_sceneSet;
-    d->deinit();
-    d->init(m_device);
+    retireDescriptorSet(d);
+    d = std::make_unique<nvvk::DescriptorSetContainer>(m_device);
 
     // This descriptor set, holds the top level acceleration structure and the output image
     d->addBinding(SceneBindings::eFrameInfo, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_ALL);
     d->addBinding(SceneBindings::eSceneDesc, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_ALL);
     d->addBinding(SceneBindings::eTextures, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, m_sceneVk->nbTextures(), VK_SHADER_STAGE_ALL);
+    d->addBinding(SceneBindings::eTextureFeedback, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_ALL);
+    d->addBinding(SceneBindings::eQuantizedPrimitives, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_ALL);
+    d->addBinding(SceneBindings::eQuantizedData, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_ALL);
     d->initLayout();
-    d->initPool(1);
+    // Ring of sets, one more than the frames in flight: the streamed textures are written to a set no frame uses
+    d->initPool(m_app->getFrameCycleSize() + 1);
+    m_sceneSetIndex = 0;
     m_dutil->DBG_NAME(d->getLayout());
     m_dutil->DBG_NAME(d->getSet());
   }
@@ -718,8 +1249,8 @@ private:
   void createNrdSet()
   {
     auto& d = m_nrdSet;
-    d->deinit();
-    d->init(m_device);
+    retireDescriptorSet(d);
+    d = std::make_unique<nvvk::DescriptorSetContainer>(m_device);
 
     // #NRD
     d->addBinding(NrdBindings::eNormal_Roughness, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_ALL);
@@ -729,12 +1260,18 @@ private:
     d->addBinding(NrdBindings::eDirectLighting, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_ALL);
     d->addBinding(NrdBindings::eObjectMotion, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_ALL);
     d->addBinding(NrdBindings::eBaseColor_Metalness, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_ALL);
+    d->addBinding(NrdBindings::eFireflyClamp, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_ALL);
 
-
-    d->initLayout();
-    d->initPool(1);
+    // The images are pushed when tracing, so that replacing the G-Buffers never touches a set in use
+    d->initLayout(VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR);
     m_dutil->DBG_NAME(d->getLayout());
-    m_dutil->DBG_NAME(d->getSet());
+  }
+
+  // Descriptor sets may be bound by frames in flight, their destruction is deferred
+  void retireDescriptorSet(std::unique_ptr<nvvk::DescriptorSetContainer>& d)
+  {
+    std::shared_ptr<nvvk::DescriptorSetContainer> retired(std::move(d));
+    m_deletionQueue.push([retired]() { retired->deinit(); });
   }
 
   //--------------------------------------------------------------------------------------------------
@@ -742,8 +1279,18 @@ private:
   //
   void createRtxPipeline()
   {
+    {  // The pipeline and its SBT may still be used by frames in flight
+      std::shared_ptr<nvvk::SBTWrapper> retiredSbt(std::move(m_sbt));
+      m_deletionQueue.push([device = m_device, retiredPipe = m_rtxPipe, retiredSbt]() mutable {
+        retiredPipe.destroy(device);
+        retiredSbt->destroy();
+      });
+      m_rtxPipe = {};
+      m_sbt     = std::make_unique<nvvk::SBTWrapper>();
+      m_sbt->setup(m_device, m_app->getQueue(0).familyIndex, m_alloc.get(), m_rtProperties);
+    }
+
     auto& p = m_rtxPipe;
-    p.destroy(m_device);
     p.plines.resize(1);
     // Creating all shaders
     enum StageIndices
@@ -869,7 +1416,7 @@ private:
     }
 
     // Write to descriptors
-    VkAccelerationStructureKHR tlas = m_sceneRtx->tlas();
+    VkAccelerationStructureKHR tlas = m_sceneAccel->tlas();
     VkWriteDescriptorSetAccelerationStructureKHR desc_as_info{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_KHR};
     desc_as_info.accelerationStructureCount = 1;
     desc_as_info.pAccelerationStructures    = &tlas;
@@ -877,20 +1424,6 @@ private:
     std::vector<VkWriteDescriptorSet> writes;
     writes.emplace_back(m_rtxSet->makeWrite(0, RtxBindings::eTlas, &desc_as_info));
 
-    // #NRD images that the RTX pipeline produces
-    auto bindImage = [&](NrdBindings binding, GbufferNames gbuf) {
-      writes.emplace_back(m_nrdSet->makeWrite(0, binding, &m_gBuffers->getDescriptorImageInfo(gbuf)));
-    };
-
-    // #NRD
-    bindImage(NrdBindings::eUnfiltered_Diff, eGBufDiffRadianceHitDist);
-    bindImage(NrdBindings::eUnfiltered_Spec, eGBufSpecRadianceHitDist);
-    bindImage(NrdBindings::eNormal_Roughness, eGBufNormalRoughness);
-    bindImage(NrdBindings::eViewZ, eGBufViewZ);
-    bindImage(NrdBindings::eObjectMotion, eGBufMotionVectors);
-    bindImage(NrdBindings::eDirectLighting, eGBufDirectLighting);
-    bindImage(NrdBindings::eBaseColor_Metalness, eGBufBaseColorMetalness);  // use the LDR buffer as temporary storage for the base/metalness
-
     vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
   }
 
@@ -909,14 +1442,19 @@ private:
     VkDescriptorBufferInfo scene_desc{m_sceneVk->sceneDesc().buffer, 0, VK_WHOLE_SIZE};
 
     std::vector<VkWriteDescriptorSet> writes;
-    writes.emplace_back(d->makeWrite(0, SceneBindings::eFrameInfo, &dbi_unif));
-    writes.emplace_back(d->makeWrite(0, SceneBindings::eSceneDesc, &scene_desc));
-    std::vector<VkDescriptorImageInfo> diit;
-    for(const auto& texture : m_sceneVk->textures())  // All texture samplers
+    VkDescriptorBufferInfo feedback            = m_textureStreamer->getFeedbackBuffer();
+    VkDescriptorBufferInfo quantizedPrimitives = m_vertexQuantizer->getPrimitiveBuffer();
+    VkDescriptorBufferInfo quantizedData       = m_vertexQuantizer->getDataBuffer();
+    writes.emplace_back(d->makeWrite(m_sceneSetIndex, SceneBindings::eFrameInfo, &dbi_unif));
+    writes.emplace_back(d->makeWrite(m_sceneSetIndex, SceneBindings::eSceneDesc, &scene_desc));
+    writes.emplace_back(d->makeWrite(m_sceneSetIndex, SceneBindings::eTextureFeedback, &feedback));
+    writes.emplace_back(d->makeWrite(m_sceneSetIndex, SceneBindings::eQuantizedPrimitives, &quantizedPrimitives));
+    writes.emplace_back(d->makeWrite(m_sceneSetIndex, SceneBindings::eQuantizedData, &quantizedData));
+    const std::vector<VkDescriptorImageInfo>& diit = m_textureStreamer->getDescriptors();  // All texture samplers
+    if(!diit.empty())
     {
-      diit.emplace_back(texture.descriptor);
+      writes.emplace_back(d->makeWriteArray(m_sceneSetIndex, SceneBindings::eTextures, diit.data()));
     }
-    writes.emplace_back(d->makeWriteArray(0, SceneBindings::eTextures, diit.data()));
 
     vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
   }
@@ -928,10 +1466,10 @@ private:
   void updateFrame()
   {
     static glm::mat4 ref_cam_matrix;
-    static float     ref_fov{CameraManip.getFov()};
+    static float     ref_fov{m_render.fov};
 
-    const auto& m   = CameraManip.getMatrix();
-    const auto  fov = CameraManip.getFov();
+    const auto& m   = m_render.view;
+    const auto  fov = m_render.fov;
 
     if(ref_cam_matrix != m || ref_fov != fov)
     {
@@ -940,6 +1478,28 @@ private:
     }
   }
 
+  //--------------------------------------------------------------------------------------------------
+  // Allocate the diagnostic images when a diagnostic view gets selected, and release
+  // them again once the view is left. NRD's user pool is updated accordingly.
+  //
+  void updateDiagnostics()
+  {
+    const bool wanted = m_showDiagnostic != Diagnostics::eNone;
+    if(wanted == m_diagnostics->isActive())
+    {
+      return;
+    }
+
+    m_diagnostics->setActive(wanted, m_gBuffers->getSize());
+    m_thumbnailsDirty = true;
+    invalidateRecordedChains();
+
+    if(m_nrd)
+    {
+      m_nrd->setUserPoolTexture(nrd::ResourceType::OUT_VALIDATION, m_diagnostics->getTexture(Diagnostics::eNrdValidation));
+    }
+  }
+
   //--------------------------------------------------------------------------------------------------
   // To be call when renderer need to re-start
   //
@@ -964,13 +1524,13 @@ private:
 
 
   //--------------------------------------------------------------------------------------------------
-  // Send a ray under mouse coordinates, and retrieve the information
-  // - Set new camera interest point on hit position
+  // Request a ray under mouse coordinates. The ray is traced along with the next frame, see
+  // recordPicking(), and the result applied by applyPickResult() once that frame completed.
   //
   void screenPicking()
   {
-    auto* tlas = m_sceneRtx->tlas();
-    if(tlas == VK_NULL_HANDLE)
+    auto* tlas = m_sceneAccel->tlas();
+    if(tlas == VK_NULL_HANDLE || m_pickInFlight)
       return;
 
     ImGui::Begin("Viewport");  // ImGui, picking within "viewport"
@@ -982,8 +1542,6 @@ private:
     ImVec2 local_mouse_pos = mouse_pos / main_size;
     ImGui::End();
 
-    auto* cmd = m_app->createTempCmdBuffer();
-
     // Finding current camera matrices
     const auto& view = CameraManip.getMatrix();
     auto        proj = glm::perspectiveRH_ZO(glm::radians(CameraManip.getFov()), aspect_ratio, 0.1F, 1000.0F);
@@ -996,9 +1554,40 @@ private:
     pick_info.modelViewInv   = glm::inverse(view);
     pick_info.perspectiveInv = glm::inverse(proj);
 
-    // Run and wait for result
-    m_picker->run(cmd, pick_info);
-    m_app->submitAndWaitTempCmdBuffer(cmd);
+    m_pickRequest  = pick_info;
+    m_pickInFlight = true;
+  }
+
+  //--------------------------------------------------------------------------------------------------
+  // Trace the requested picking ray in the frame command buffer, instead of a separate submission
+  // waited on. The result can be read once the frame cycle slot of this frame comes around again,
+  // its fence having been waited on.
+  //
+  void recordPicking(VkCommandBuffer cmd)
+  {
+    if(!m_pickRequest)
+    {
+      return;
+    }
+
+    m_picker->run(cmd, *m_pickRequest);
+    m_pickRequest.reset();
+
+    VkMemoryBarrier barrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT};
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0,
+                         nullptr, 0, nullptr);
+
+    m_pickSerial = m_frameSerial;
+  }
+
+  //--------------------------------------------------------------------------------------------------
+  // Retrieve the picking information of a completed request
+  // - Set new camera interest point on hit position
+  //
+  void applyPickResult()
+  {
+    m_pickSerial.reset();
+    m_pickInFlight = false;
 
     // Retrieving picking information
     nvvk::RayPickerKHR::PickResult pr = m_picker->getResult();
@@ -1014,6 +1603,12 @@ private:
       return;
     }
 
+    // A scene loaded while the ray was in flight
+    if(pr.instanceID >= m_scene->getRenderNodes().size())
+    {
+      return;
+    }
+
     // Find where the hit point is and set the interest position
     glm::vec3 world_pos = glm::vec3(pr.worldRayOrigin + pr.worldRayDirection * pr.hitT);
     glm::vec3 eye;
@@ -1022,24 +1617,240 @@ private:
     CameraManip.getLookat(eye, center, up);
     CameraManip.setLookat(eye, world_pos, up, false);
 
-    //    auto float_as_uint = [](float f) { return *reinterpret_cast<uint32_t*>(&f); };
-
     // Logging picking info.
     const nvh::gltf::RenderNode& renderNode = m_scene->getRenderNodes()[pr.instanceID];
     const tinygltf::Node&        node       = m_scene->getModel().nodes[renderNode.refNodeID];
 
+    m_selectedMaterial = renderNode.materialID;
+
     LOGI("Node Name: %s\n", node.name.c_str());
     LOGI(" - GLTF: NodeID: %d, MeshID: %d, TriangleId: %d\n", renderNode.refNodeID, node.mesh, pr.primitiveID);
     LOGI(" - Render: RenderNode: %d, RenderPrim: %d\n", pr.instanceID, pr.instanceCustomIndex);
     LOGI("{%3.2f, %3.2f, %3.2f}, Dist: %3.2f\n", world_pos.x, world_pos.y, world_pos.z, pr.hitT);
   }
 
+  //--------------------------------------------------------------------------------------------------
+  // Parameters of the material of the last picked object. The edits change the glTF material and
+  // are patched in the material buffer of the scene with the next frame (see patchMaterial()),
+  // without rebuilding anything: the denoiser history carries on.
+  //
+  void materialUI()
+  {
+    using namespace ImGuiH;
+    using nvvkhl_shaders::GltfShadeMaterial;
+
+    tinygltf::Model& model = m_scene->getModel();
+    if(m_selectedMaterial < 0 || m_selectedMaterial >= static_cast<int>(model.materials.size()))
+    {
+      ImGui::TextDisabled("Double-click an object to edit its material");
+      return;
+    }
+    tinygltf::Material&             material = model.materials[m_selectedMaterial];
+    tinygltf::PbrMetallicRoughness& pbr      = material.pbrMetallicRoughness;
+
+    PropertyEditor::begin();
+    PropertyEditor::entry("Name", [&] {
+      ImGui::Text("%s (%d)", material.name.c_str(), m_selectedMaterial);
+      return false;
+    });
+
+    glm::vec4 baseColor = glm::make_vec4(pbr.baseColorFactor.data());
+    if(PropertyEditor::entry("Base Color", [&] { return ImGui::ColorEdit4("##BaseColor", &baseColor.x); }))
+    {
+      pbr.baseColorFactor = {baseColor.x, baseColor.y, baseColor.z, baseColor.w};
+      patchMaterial(m_selectedMaterial, offsetof(GltfShadeMaterial, pbrBaseColorFactor), baseColor);
+    }
+    float metallic = float(pbr.metallicFactor);
+    if(PropertyEditor::entry("Metallic", [&] { return ImGui::SliderFloat("##Metallic", &metallic, 0.F, 1.F); }))
+    {
+      pbr.metallicFactor = metallic;
+      patchMaterial(m_selectedMaterial, offsetof(GltfShadeMaterial, pbrMetallicFactor), metallic);
+    }
+    float roughness = float(pbr.roughnessFactor);
+    if(PropertyEditor::entry("Roughness", [&] { return ImGui::SliderFloat("##Roughness", &roughness, 0.F, 1.F); }))
+    {
+      pbr.roughnessFactor = roughness;
+      patchMaterial(m_selectedMaterial, offsetof(GltfShadeMaterial, pbrRoughnessFactor), roughness);
+    }
+
+    // The shading material holds the factor scaled by KHR_materials_emissive_strength
+    float      emissiveStrength = 1.F;
+    const auto ext              = material.extensions.find("KHR_materials_emissive_strength");
+    if(ext != material.extensions.end() && ext->second.Has("emissiveStrength"))
+    {
+      emissiveStrength = float(ext->second.Get("emissiveStrength").GetNumberAsDouble());
+    }
+    glm::vec3 emissive = glm::make_vec3(material.emissiveFactor.data());
+    if(PropertyEditor::entry("Emissive", [&] { return ImGui::ColorEdit3("##Emissive", &emissive.x); }))
+    {
+      material.emissiveFactor = {emissive.x, emissive.y, emissive.z};
+      patchMaterial(m_selectedMaterial, offsetof(GltfShadeMaterial, emissiveFactor), emissive * emissiveStrength);
+    }
+
+    // Any texture of the scene: all are in the bindless array already, only the index changes
+    int texture = pbr.baseColorTexture.index;
+    if(PropertyEditor::entry("Base Color Texture", [&] {
+         auto name = [&](int t) {
+           if(t < 0)
+             return std::string("None");
+           const int source = model.textures[t].source;
+           return std::to_string(t) + ": "
+                  + (source >= 0 && !model.images[source].name.empty() ? model.images[source].name : model.textures[t].name);
+         };
+         bool changed = false;
+         if(ImGui::BeginCombo("##BaseColorTexture", name(texture).c_str()))
+         {
+           for(int t = -1; t < static_cast<int>(model.textures.size()); ++t)
+           {
+             if(ImGui::Selectable(name(t).c_str(), t == texture))
+             {
+               changed = t != texture;
+               texture = t;
+             }
+           }
+           ImGui::EndCombo();
+         }
+         return changed;
+       }))
+    {
+      pbr.baseColorTexture.index = texture;
+      patchMaterial(m_selectedMaterial,
+                    offsetof(GltfShadeMaterial, pbrBaseColorTexture) + offsetof(decltype(GltfShadeMaterial::pbrBaseColorTexture), index),
+                    int32_t(texture));
+    }
+    PropertyEditor::end();
+  }
+
+  // Queue the write of 'value' to the field at 'fieldOffset' of the shading material 'material'
+  template <typename T>
+  void patchMaterial(int material, size_t fieldOffset, const T& value)
+  {
+    static_assert(sizeof(T) % 4 == 0 && sizeof(T) <= sizeof(MaterialPatch::data), "vkCmdUpdateBuffer writes whole words");
+    MaterialPatch patch;
+    patch.offset = VkDeviceSize(material) * sizeof(nvvkhl_shaders::GltfShadeMaterial) + fieldOffset;
+    patch.size   = sizeof(T);
+    memcpy(patch.data.data(), &value, sizeof(T));
+    m_materialPatches.push_back(patch);
+  }
+
+  // The frames in flight read the material buffer: the patches are ordered after them by the barriers
+  void recordMaterialPatches(VkCommandBuffer cmd)
+  {
+    if(m_materialPatches.empty())
+    {
+      return;
+    }
+
+    VkMemoryBarrier before{VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_TRANSFER_WRITE_BIT};
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1,
+                         &before, 0, nullptr, 0, nullptr);
+    for(const MaterialPatch& patch : m_materialPatches)
+    {
+      vkCmdUpdateBuffer(cmd, m_sceneVk->material().buffer, patch.offset, patch.size, patch.data.data());
+    }
+    VkMemoryBarrier after{VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT};
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, 0, 1,
+                         &after, 0, nullptr, 0, nullptr);
+    m_materialPatches.clear();
+  }
+
+  //--------------------------------------------------------------------------------------------------
+  // Size of one tile of the thumbnail atlas
+  //
+  ImVec2 getThumbnailTileSize() const
+  {
+    float aspect = m_viewSize.x / std::max(m_viewSize.y, 1.F);
+    return {std::max(1.F, floorf(eThumbHeight * aspect)), float(eThumbHeight)};
+  }
+
+  //--------------------------------------------------------------------------------------------------
+  // Downsample the buffers shown in the "Denoiser" panel into the thumbnail atlas.
+  // The panel then only samples this small image, instead of each full resolution buffer.
+  // The atlas is refreshed every few frames, and only while the panel is open.
+  //
+  void updateThumbnails(VkCommandBuffer cmd)
+  {
+    if(!m_render.thumbnailsVisible)
+    {
+      return;
+    }
+    if(!m_thumbnailsDirty && ++m_thumbnailsAge < m_render.settings.thumbnailInterval)
+    {
+      return;
+    }
+    m_thumbnailsDirty = false;
+    m_thumbnailsAge   = 0;
+
+    auto scope_dbg = m_dutil->DBG_SCOPE(cmd);
+
+    // Wait for all passes writing the sources (compute and axis rendering), and for the UI to be done with the atlas
+    {
+      VkMemoryBarrier barrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+      barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+      barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+      vkCmdPipelineBarrier(cmd,
+                           VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
+                               | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                           VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_thumbnailPipeline);
+
+    ImVec2     tileSize = getThumbnailTileSize();
+    VkExtent2D tileExtent{uint32_t(tileSize.x), uint32_t(tileSize.y)};
+
+    auto downsample = [&](ThumbnailTile tile, const VkDescriptorImageInfo& source, int decode) {
+      VkDescriptorImageInfo sourceInfo = {VK_NULL_HANDLE, source.imageView, VK_IMAGE_LAYOUT_GENERAL};
+      VkDescriptorImageInfo atlasInfo  = {VK_NULL_HANDLE, m_thumbnails->getColorImageView(0), VK_IMAGE_LAYOUT_GENERAL};
+
+      std::array<VkWriteDescriptorSet, 2> writes{};
+      writes[0]                 = {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+      writes[0].dstBinding      = uint32_t(ThumbnailBindings::eThumbSource);
+      writes[0].descriptorCount = 1;
+      writes[0].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+      writes[0].pImageInfo      = &sourceInfo;
+      writes[1]                 = writes[0];
+      writes[1].dstBinding      = uint32_t(ThumbnailBindings::eThumbAtlas);
+      writes[1].pImageInfo      = &atlasInfo;
+      vkCmdPushDescriptorSetKHR(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_thumbnailLayout, 0, uint32_t(writes.size()),
+                                writes.data());
+
+      ThumbnailPushConstant pc{};
+      pc.tileOffset = {int(tileExtent.width) * (tile % eThumbColumns), int(tileExtent.height) * (tile / eThumbColumns)};
+      pc.tileSize   = {int(tileExtent.width), int(tileExtent.height)};
+      pc.decode     = decode;
+      pc.method     = m_pushConst.method;
+      vkCmdPushConstants(cmd, m_thumbnailLayout, VK_SHADER_STAGE_ALL, 0, sizeof(ThumbnailPushConstant), &pc);
+
+      VkExtent2D group_counts = getGroupCounts(tileExtent);
+      vkCmdDispatch(cmd, group_counts.width, group_counts.height, 1);
+    };
+
+    downsample(eThumbDiff, m_gBuffers->getDescriptorImageInfo(eGBufDiffRadianceHitDist), THUMBNAIL_RADIANCE);
+    downsample(eThumbSpec, m_gBuffers->getDescriptorImageInfo(eGBufSpecRadianceHitDist), THUMBNAIL_RADIANCE);
+    downsample(eThumbNormalRoughness, m_gBuffers->getDescriptorImageInfo(eGBufNormalRoughness), THUMBNAIL_NORMAL);
+    downsample(eThumbDenoised, m_gBuffers->getDescriptorImageInfo(eGBufDenoisedUnpacked), THUMBNAIL_HDR);
+    downsample(eThumbTaa, m_gBuffers->getDescriptorImageInfo(eGBufTaa), THUMBNAIL_HDR);
+    downsample(eThumbLdr, m_gBuffers->getDescriptorImageInfo(eGBufLdr), THUMBNAIL_LDR);
+    if(m_diagnostics->isActive())
+    {
+      downsample(eThumbNrdValidation, m_diagnostics->getTexture(Diagnostics::eNrdValidation).descriptor, THUMBNAIL_LDR);
+    }
+
+    // The atlas is read by the UI
+    VkImageMemoryBarrier barrier =
+        nvvk::makeImageMemoryBarrier(m_thumbnails->getColorImage(0), VK_ACCESS_SHADER_WRITE_BIT,
+                                     VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL);
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0,
+                         nullptr, 0, nullptr, 1, &barrier);
+  }
+
   //--------------------------------------------------------------------------------------------------
   // Render the axis in the bottom left corner of the screen
   //
   void renderAxis(const VkCommandBuffer& cmd)
   {
-    if(m_settings.showAxis)
+    if(m_render.settings.showAxis)
     {
       float axis_size = 50.F;
 
@@ -1049,7 +1860,7 @@ private:
       // Rendering the axis
       vkCmdBeginRendering(cmd, &r_info);
       m_vkAxis->setAxisSize(axis_size);
-      m_vkAxis->display(cmd, CameraManip.getMatrix(), m_gBuffers->getSize());
+      m_vkAxis->display(cmd, m_render.view, m_gBuffers->getSize());
       vkCmdEndRendering(cmd);
     }
   }
@@ -1059,11 +1870,48 @@ private:
     auto scope_dbg = m_dutil->DBG_SCOPE(cmd);
 
     // Ray trace
-    std::vector<VkDescriptorSet> desc_sets{m_rtxSet->getSet(), m_sceneSet->getSet(), m_nrdSet->getSet(),
-                                           m_hdrEnv->getDescriptorSet()};
+    std::vector<VkDescriptorSet> desc_sets{m_rtxSet->getSet(), m_sceneSet->getSet(m_sceneSetIndex)};
+    VkDescriptorSet              hdr_set = m_hdrEnv->getDescriptorSet();
     vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, m_rtxPipe.plines[0]);
     vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, m_rtxPipe.layout, 0,
                             static_cast<uint32_t>(desc_sets.size()), desc_sets.data(), 0, nullptr);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, m_rtxPipe.layout, 3, 1, &hdr_set, 0, nullptr);
+
+    // #NRD images that the RTX pipeline produces
+    {
+      std::vector<VkWriteDescriptorSet> writes;
+      auto bindImage = [&](NrdBindings binding, GbufferNames gbuf) {
+        VkWriteDescriptorSet descriptorWrite{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, nullptr};
+        descriptorWrite.descriptorCount = 1;
+        descriptorWrite.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        descriptorWrite.dstBinding      = uint32_t(binding);
+        descriptorWrite.pImageInfo      = &m_gBuffers->getDescriptorImageInfo(gbuf);
+
+        writes.emplace_back(descriptorWrite);
+      };
+
+      bindImage(NrdBindings::eUnfiltered_Diff, eGBufDiffRadianceHitDist);
+      bindImage(NrdBindings::eUnfiltered_Spec, eGBufSpecRadianceHitDist);
+      bindImage(NrdBindings::eNormal_Roughness, eGBufNormalRoughness);
+      bindImage(NrdBindings::eViewZ, eGBufViewZ);
+      bindImage(NrdBindings::eObjectMotion, eGBufMotionVectors);
+      bindImage(NrdBindings::eDirectLighting, eGBufDirectLighting);
+      bindImage(NrdBindings::eBaseColor_Metalness, eGBufBaseColorMetalness);  // use the LDR buffer as temporary storage for the base/metalness
+
+      VkDescriptorBufferInfo fireflyInfo = {m_bFirefly.buffer, 0, VK_WHOLE_SIZE};
+      {
+        VkWriteDescriptorSet descriptorWrite{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, nullptr};
+        descriptorWrite.descriptorCount = 1;
+        descriptorWrite.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorWrite.dstBinding      = uint32_t(NrdBindings::eFireflyClamp);
+        descriptorWrite.pBufferInfo     = &fireflyInfo;
+
+        writes.emplace_back(descriptorWrite);
+      }
+
+      vkCmdPushDescriptorSetKHR(cmd, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, m_rtxPipe.layout, 2,
+                                static_cast<uint32_t>(writes.size()), writes.data());
+    }
     vkCmdPushConstants(cmd, m_rtxPipe.layout, VK_SHADER_STAGE_ALL, 0, sizeof(RtxPushConstant), &m_pushConst);
 
     const auto& size = m_gBuffers->getSize();
@@ -1085,18 +1933,82 @@ private:
 
   void createHdr(const char* filename)
   {
-    m_hdrEnv = std::make_unique<nvvkhl::HdrEnv>(m_app->getDevice(), m_app->getPhysicalDevice(), m_alloc.get());
+    m_deletionQueue.retire(m_hdrEnv);
+    m_hdrEnv = std::make_unique<HdrEnvironment>(m_app->getDevice(), m_alloc.get(), *m_threadPool, m_app->getQueue(0).familyIndex);
+
+    m_hdrFilename     = filename;
+    m_hdrSunExtracted = extractHdrSun();
+    m_hdrEnv->loadEnvironment(m_hdrFilename, m_hdrSunExtracted);
+  }
+
+  // Only remove the sun from the HDR when the analytic sun lights the scene in its place
+  bool extractHdrSun() const { return m_settings.extractSun && m_settings.sunEnabled && m_settings.sunFromHdr; }
+
+  // Sun parameters of the frame: the one extracted from the HDR, or the one set in the UI
+  void updateSun()
+  {
+    const HdrEnvironment::Sun& hdrSun = m_hdrEnv->getSun();
+    m_frameInfo.sunProbability        = 0.F;
+    if(!m_render.settings.sunEnabled)
+    {
+      return;
+    }
 
-    m_hdrEnv->loadEnvironment(filename);
+    glm::vec3 direction;
+    glm::vec3 radiance;
+    float     angularRadius;
+    if(m_render.settings.sunFromHdr)
+    {
+      if(!hdrSun.valid)
+      {
+        return;
+      }
+      direction     = hdrSun.direction;
+      angularRadius = hdrSun.angularRadius;
+      radiance      = hdrSun.radiance * glm::vec3(m_render.settings.clearColor);
+    }
+    else
+    {
+      direction = {cosf(m_render.settings.sunElevation) * cosf(m_render.settings.sunAzimuth), sinf(m_render.settings.sunElevation),
+                   cosf(m_render.settings.sunElevation) * sinf(m_render.settings.sunAzimuth)};
+      angularRadius = glm::radians(m_render.settings.sunAngle);
+      radiance      = m_render.settings.sunColor * m_render.settings.sunIntensity;
+    }
+
+    const float solidAngle = 2.F * glm::pi<float>() * (1.F - cosf(angularRadius));
+    m_frameInfo.sunDirection = direction;
+    m_frameInfo.sunCosAngle  = cosf(angularRadius);
+    m_frameInfo.sunRadiance  = radiance;
+
+    // Split the light samples in proportion of the power of both lights, keeping some for each
+    const float sunPower = std::max(radiance.x, std::max(radiance.y, radiance.z)) * solidAngle;
+    const glm::vec4& envColor = m_render.settings.clearColor;
+    const float      envPower = m_hdrEnv->getIntegral() * std::max(envColor.x, std::max(envColor.y, envColor.z));
+    if(sunPower > 0.F)
+    {
+      m_frameInfo.sunProbability = glm::clamp(sunPower / (sunPower + envPower), 0.1F, 0.9F);
+    }
   }
 
   void destroyResources()
   {
+    m_sceneLoader.reset();
+    m_textureStreamer.reset();
+    m_recordedChains.clear();
+    m_deletionQueue.flush();  // the device is idle
+    m_stagingRing.reset();     // after the texture streamers
+    vkDestroyCommandPool(m_device, m_chainCmdPool, nullptr);  // frees the recorded chains
+    m_recorder.reset();
+
     m_nrd.reset();
+    m_diagnostics.reset();
 
     m_alloc->destroy(m_bFrameInfo);
+    m_alloc->destroy(m_bExposure);
+    m_alloc->destroy(m_bFirefly);
 
     m_gBuffers.reset();
+    m_thumbnails.reset();
 
     vkDestroyPipeline(m_device, m_compositionPipeline, nullptr);
     vkDestroyPipelineLayout(m_device, m_compositionLayout, nullptr);
@@ -1104,6 +2016,17 @@ private:
     vkDestroyPipeline(m_device, m_taaPipeline, nullptr);
     vkDestroyPipelineLayout(m_device, m_taaLayout, nullptr);
     vkDestroyDescriptorSetLayout(m_device, m_taaDescSetlayout, nullptr);
+    vkDestroyPipeline(m_device, m_thumbnailPipeline, nullptr);
+    vkDestroyPipelineLayout(m_device, m_thumbnailLayout, nullptr);
+    vkDestroyDescriptorSetLayout(m_device, m_thumbnailDescSetlayout, nullptr);
+    vkDestroyPipeline(m_device, m_exposureHistogramPipeline, nullptr);
+    vkDestroyPipeline(m_device, m_exposureResolvePipeline, nullptr);
+    vkDestroyPipelineLayout(m_device, m_exposureLayout, nullptr);
+    vkDestroyDescriptorSetLayout(m_device, m_exposureDescSetlayout, nullptr);
+    vkDestroyPipeline(m_device, m_fireflyHistogramPipeline, nullptr);
+    vkDestroyPipeline(m_device, m_fireflyResolvePipeline, nullptr);
+    vkDestroyPipelineLayout(m_device, m_fireflyLayout, nullptr);
+    vkDestroyDescriptorSetLayout(m_device, m_fireflyDescSetlayout, nullptr);
 
     m_rtxPipe.destroy(m_device);
     m_rtxSet->deinit();
@@ -1178,6 +2101,8 @@ private:
     std::vector<VkDescriptorSetLayoutBinding> layoutBindings;
     layoutBindings.push_back({uint32_t(TaaBindings::eInImage), VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT});
     layoutBindings.push_back({uint32_t(TaaBindings::eOutImage), VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT});
+    layoutBindings.push_back({uint32_t(TaaBindings::eOutExposed), VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT});
+    layoutBindings.push_back({uint32_t(TaaBindings::eInExposure), VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT});
     VkDescriptorSetLayoutCreateInfo layoutInfo{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
 
     layoutInfo.flags        = VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR;
@@ -1187,7 +2112,7 @@ private:
     NVVK_CHECK(vkCreateDescriptorSetLayout(m_device, &layoutInfo, nullptr, &m_taaDescSetlayout));
     m_dutil->setObjectName(m_taaDescSetlayout, "TAA Descriptor Set Layout");
 
-    VkPushConstantRange push_constant{VK_SHADER_STAGE_ALL, 0, sizeof(float)};
+    VkPushConstantRange push_constant{VK_SHADER_STAGE_ALL, 0, sizeof(TaaPushConstant)};
 
     VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo{VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO, nullptr};
     pipelineLayoutCreateInfo.setLayoutCount = 1;
@@ -1222,6 +2147,54 @@ private:
     vkDestroyShaderModule(m_device, assembleShader, nullptr);
   }
 
+  void createThumbnailPipeline()
+  {
+    std::vector<VkDescriptorSetLayoutBinding> layoutBindings;
+    layoutBindings.push_back({uint32_t(ThumbnailBindings::eThumbSource), VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT});
+    layoutBindings.push_back({uint32_t(ThumbnailBindings::eThumbAtlas), VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT});
+    VkDescriptorSetLayoutCreateInfo layoutInfo{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
+
+    layoutInfo.flags        = VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR;
+    layoutInfo.bindingCount = layoutBindings.size();
+    layoutInfo.pBindings    = layoutBindings.data();
+
+    NVVK_CHECK(vkCreateDescriptorSetLayout(m_device, &layoutInfo, nullptr, &m_thumbnailDescSetlayout));
+    m_dutil->setObjectName(m_thumbnailDescSetlayout, "Thumbnail Descriptor Set Layout");
+
+    VkPushConstantRange push_constant{VK_SHADER_STAGE_ALL, 0, sizeof(ThumbnailPushConstant)};
+
+    VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo{VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO, nullptr};
+    pipelineLayoutCreateInfo.setLayoutCount = 1;
+    pipelineLayoutCreateInfo.pSetLayouts    = &m_thumbnailDescSetlayout;
+
+    pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+    pipelineLayoutCreateInfo.pPushConstantRanges    = &push_constant;
+
+    NVVK_CHECK(vkCreatePipelineLayout(m_device, &pipelineLayoutCreateInfo, nullptr, &m_thumbnailLayout));
+
+    VkShaderModuleCreateInfo shaderInfo{VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO, nullptr};
+    shaderInfo.codeSize = sizeof(thumbnail_comp);
+    shaderInfo.pCode    = thumbnail_comp;
+
+    VkShaderModule thumbnailShader = VK_NULL_HANDLE;
+    NVVK_CHECK(vkCreateShaderModule(m_device, &shaderInfo, nullptr, &thumbnailShader));
+
+    VkPipelineShaderStageCreateInfo stageCreateInfo{VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, nullptr};
+    stageCreateInfo.stage  = VK_SHADER_STAGE_COMPUTE_BIT;
+    stageCreateInfo.module = thumbnailShader;
+    stageCreateInfo.pName  = "main";
+
+    VkComputePipelineCreateInfo pipelineInfo{VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO, nullptr};
+    pipelineInfo.layout = m_thumbnailLayout;
+    pipelineInfo.stage  = stageCreateInfo;
+
+    NVVK_CHECK(vkCreateComputePipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_thumbnailPipeline));
+
+    m_dutil->setObjectName(m_thumbnailPipeline, "Thumbnail Pipeline");
+
+    vkDestroyShaderModule(m_device, thumbnailShader, nullptr);
+  }
+
 
   void compose(VkCommandBuffer& commandBuffer, VkImageView outImage)
   {
@@ -1271,6 +2244,10 @@ private:
 
     vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_compositionPipeline);
 
+    // Recorded into secondary command buffers, which inherit no push constants. Only 'method' is
+    // read, and it is part of the key of the reused chains.
+    vkCmdPushConstants(commandBuffer, m_compositionLayout, VK_SHADER_STAGE_ALL, 0, sizeof(RtxPushConstant), &m_pushConst);
+
     VkExtent2D group_counts = getGroupCounts(m_gBuffers->getSize());
     vkCmdDispatch(commandBuffer, group_counts.width, group_counts.height, 1);
   }
@@ -1292,17 +2269,256 @@ private:
 
     bindImage(TaaBindings::eInImage, eGBufDenoisedUnpacked);
     bindImage(TaaBindings::eOutImage, eGBufTaa);
+    bindImage(TaaBindings::eOutExposed, eGBufExposed);
+
+    VkDescriptorBufferInfo exposureInfo = {m_bExposure.buffer, 0, VK_WHOLE_SIZE};
+    {
+      VkWriteDescriptorSet descriptorWrite{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, nullptr};
+      descriptorWrite.descriptorCount = 1;
+      descriptorWrite.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      descriptorWrite.dstBinding      = uint32_t(TaaBindings::eInExposure);
+      descriptorWrite.pBufferInfo     = &exposureInfo;
+
+      writes.push_back(descriptorWrite);
+    }
 
     vkCmdPushDescriptorSetKHR(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_taaLayout, 0, writes.size(), writes.data());
 
     vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_taaPipeline);
-    float alpha = 0.1F;
-    vkCmdPushConstants(commandBuffer, m_taaLayout, VK_SHADER_STAGE_ALL, 0, sizeof(float), &alpha);
+    TaaPushConstant taaPushConst{0.1F, m_render.settings.autoExposure ? 1 : 0};
+    vkCmdPushConstants(commandBuffer, m_taaLayout, VK_SHADER_STAGE_ALL, 0, sizeof(TaaPushConstant), &taaPushConst);
 
     VkExtent2D group_counts = getGroupCounts(m_gBuffers->getSize());
     vkCmdDispatch(commandBuffer, group_counts.width, group_counts.height, 1);
   }
 
+  //--------------------------------------------------------------------------------------------------
+  // Auto-exposure: histogram of the TAA output, then resolved into the exposure used by the next
+  // frame's TAA pass. Everything stays on the GPU.
+  //
+  void computeExposure(VkCommandBuffer cmd)
+  {
+    if(!m_render.settings.autoExposure)
+    {
+      return;
+    }
+
+    auto scope_dbg = m_dutil->DBG_SCOPE(cmd);
+
+    VkDescriptorImageInfo  imageInfo  = {VK_NULL_HANDLE, m_gBuffers->getColorImageView(eGBufTaa), VK_IMAGE_LAYOUT_GENERAL};
+    VkDescriptorBufferInfo bufferInfo = {m_bExposure.buffer, 0, VK_WHOLE_SIZE};
+
+    std::array<VkWriteDescriptorSet, 2> writes{};
+    writes[0]                 = {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+    writes[0].dstBinding      = uint32_t(ExposureBindings::eExposureImage);
+    writes[0].descriptorCount = 1;
+    writes[0].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    writes[0].pImageInfo      = &imageInfo;
+    writes[1]                 = {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+    writes[1].dstBinding      = uint32_t(ExposureBindings::eExposureData);
+    writes[1].descriptorCount = 1;
+    writes[1].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    writes[1].pBufferInfo     = &bufferInfo;
+    vkCmdPushDescriptorSetKHR(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_exposureLayout, 0, uint32_t(writes.size()), writes.data());
+
+    // Temporal adaptation, frame rate independent
+    m_exposurePushConst.lowPercentile  = m_render.settings.exposurePercentiles.x;
+    m_exposurePushConst.highPercentile = m_render.settings.exposurePercentiles.y;
+    m_exposurePushConst.keyValue       = 0.18F * exp2f(m_render.settings.exposureCompensation);
+    m_exposurePushConst.adaptation     = 1.F - expf(-m_render.deltaTime * m_render.settings.exposureSpeed);
+    vkCmdPushConstants(cmd, m_exposureLayout, VK_SHADER_STAGE_ALL, 0, sizeof(ExposurePushConstant), &m_exposurePushConst);
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_exposureHistogramPipeline);
+    VkExtent2D group_counts = getGroupCounts(m_gBuffers->getSize());
+    vkCmdDispatch(cmd, group_counts.width, group_counts.height, 1);
+
+    VkBufferMemoryBarrier barrier{VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER};
+    barrier.srcAccessMask       = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask       = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer              = m_bExposure.buffer;
+    barrier.size                = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr,
+                         1, &barrier, 0, nullptr);
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_exposureResolvePipeline);
+    vkCmdDispatch(cmd, 1, 1, 1);
+
+    // The exposure is read by the TAA pass of the next frame, and the cleared histogram is accumulated again
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr,
+                         1, &barrier, 0, nullptr);
+  }
+
+  void createExposurePipelines()
+  {
+    std::vector<VkDescriptorSetLayoutBinding> layoutBindings;
+    layoutBindings.push_back({uint32_t(ExposureBindings::eExposureImage), VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT});
+    layoutBindings.push_back({uint32_t(ExposureBindings::eExposureData), VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT});
+    VkDescriptorSetLayoutCreateInfo layoutInfo{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
+
+    layoutInfo.flags        = VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR;
+    layoutInfo.bindingCount = layoutBindings.size();
+    layoutInfo.pBindings    = layoutBindings.data();
+
+    NVVK_CHECK(vkCreateDescriptorSetLayout(m_device, &layoutInfo, nullptr, &m_exposureDescSetlayout));
+    m_dutil->setObjectName(m_exposureDescSetlayout, "Exposure Descriptor Set Layout");
+
+    VkPushConstantRange push_constant{VK_SHADER_STAGE_ALL, 0, sizeof(ExposurePushConstant)};
+
+    VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo{VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO, nullptr};
+    pipelineLayoutCreateInfo.setLayoutCount = 1;
+    pipelineLayoutCreateInfo.pSetLayouts    = &m_exposureDescSetlayout;
+
+    pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+    pipelineLayoutCreateInfo.pPushConstantRanges    = &push_constant;
+
+    NVVK_CHECK(vkCreatePipelineLayout(m_device, &pipelineLayoutCreateInfo, nullptr, &m_exposureLayout));
+
+
+    m_exposureHistogramPipeline = createComputePipeline(m_exposureLayout, exposure_histogram_comp,
+                                                        sizeof(exposure_histogram_comp), "Exposure Histogram Pipeline");
+    m_exposureResolvePipeline   = createComputePipeline(m_exposureLayout, exposure_resolve_comp,
+                                                        sizeof(exposure_resolve_comp), "Exposure Resolve Pipeline");
+  }
+
+  //--------------------------------------------------------------------------------------------------
+  // Adaptive firefly clamp: histogram of the noisy radiance written by the raygen, then resolved
+  // into the luminance the next frame's raygen clamps against. Everything stays on the GPU.
+  //
+  void computeFireflyClamp(VkCommandBuffer cmd)
+  {
+    if(!m_render.settings.adaptiveFirefly)
+    {
+      return;
+    }
+
+    auto scope_dbg = m_dutil->DBG_SCOPE(cmd);
+
+    {
+      VkMemoryBarrier barrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT};
+      vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+                           &barrier, 0, nullptr, 0, nullptr);
+    }
+
+    std::vector<VkWriteDescriptorSet> writes;
+
+    auto bindImage = [&](FireflyBindings binding, GbufferNames gbufImage) {
+      VkWriteDescriptorSet descriptorWrite{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, nullptr};
+      descriptorWrite.descriptorCount = 1;
+      descriptorWrite.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+      descriptorWrite.dstBinding      = uint32_t(binding);
+      descriptorWrite.pImageInfo      = &m_gBuffers->getDescriptorImageInfo(uint32_t(gbufImage));
+
+      writes.emplace_back(descriptorWrite);
+    };
+
+    bindImage(FireflyBindings::eFireflyDiff, eGBufDiffRadianceHitDist);
+    bindImage(FireflyBindings::eFireflySpec, eGBufSpecRadianceHitDist);
+    bindImage(FireflyBindings::eFireflyBaseColor, eGBufBaseColorMetalness);
+
+    VkDescriptorBufferInfo bufferInfo = {m_bFirefly.buffer, 0, VK_WHOLE_SIZE};
+    {
+      VkWriteDescriptorSet descriptorWrite{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, nullptr};
+      descriptorWrite.descriptorCount = 1;
+      descriptorWrite.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      descriptorWrite.dstBinding      = uint32_t(FireflyBindings::eFireflyData);
+      descriptorWrite.pBufferInfo     = &bufferInfo;
+
+      writes.emplace_back(descriptorWrite);
+    }
+
+    vkCmdPushDescriptorSetKHR(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_fireflyLayout, 0, uint32_t(writes.size()), writes.data());
+
+    m_fireflyPushConst.method     = m_pushConst.method;
+    m_fireflyPushConst.percentile = m_render.settings.fireflyPercentile;
+    m_fireflyPushConst.headroom   = m_render.settings.fireflyHeadroom;
+    m_fireflyPushConst.adaptation = 1.F - expf(-m_render.deltaTime * 5.F);
+    vkCmdPushConstants(cmd, m_fireflyLayout, VK_SHADER_STAGE_ALL, 0, sizeof(FireflyPushConstant), &m_fireflyPushConst);
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_fireflyHistogramPipeline);
+    VkExtent2D group_counts = getGroupCounts(m_gBuffers->getSize());
+    vkCmdDispatch(cmd, group_counts.width, group_counts.height, 1);
+
+    VkBufferMemoryBarrier barrier{VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER};
+    barrier.srcAccessMask       = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask       = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer              = m_bFirefly.buffer;
+    barrier.size                = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr,
+                         1, &barrier, 0, nullptr);
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_fireflyResolvePipeline);
+    vkCmdDispatch(cmd, 1, 1, 1);
+
+    // The clamp is read by the raygen of the next frame, and the cleared histogram is accumulated again
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0,
+                         nullptr, 1, &barrier, 0, nullptr);
+  }
+
+  void createFireflyPipelines()
+  {
+    std::vector<VkDescriptorSetLayoutBinding> layoutBindings;
+    layoutBindings.push_back({uint32_t(FireflyBindings::eFireflyDiff), VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT});
+    layoutBindings.push_back({uint32_t(FireflyBindings::eFireflySpec), VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT});
+    layoutBindings.push_back({uint32_t(FireflyBindings::eFireflyBaseColor), VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT});
+    layoutBindings.push_back({uint32_t(FireflyBindings::eFireflyData), VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT});
+    VkDescriptorSetLayoutCreateInfo layoutInfo{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
+
+    layoutInfo.flags        = VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR;
+    layoutInfo.bindingCount = layoutBindings.size();
+    layoutInfo.pBindings    = layoutBindings.data();
+
+    NVVK_CHECK(vkCreateDescriptorSetLayout(m_device, &layoutInfo, nullptr, &m_fireflyDescSetlayout));
+    m_dutil->setObjectName(m_fireflyDescSetlayout, "Firefly Descriptor Set Layout");
+
+    VkPushConstantRange push_constant{VK_SHADER_STAGE_ALL, 0, sizeof(FireflyPushConstant)};
+
+    VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo{VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO, nullptr};
+    pipelineLayoutCreateInfo.setLayoutCount = 1;
+    pipelineLayoutCreateInfo.pSetLayouts    = &m_fireflyDescSetlayout;
+
+    pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+    pipelineLayoutCreateInfo.pPushConstantRanges    = &push_constant;
+
+    NVVK_CHECK(vkCreatePipelineLayout(m_device, &pipelineLayoutCreateInfo, nullptr, &m_fireflyLayout));
+
+    m_fireflyHistogramPipeline = createComputePipeline(m_fireflyLayout, firefly_histogram_comp,
+                                                       sizeof(firefly_histogram_comp), "Firefly Histogram Pipeline");
+    m_fireflyResolvePipeline   = createComputePipeline(m_fireflyLayout, firefly_resolve_comp,
+                                                       sizeof(firefly_resolve_comp), "Firefly Resolve Pipeline");
+  }
+
+  // Compute pipeline from a SPIR-V array of _autogen
+  VkPipeline createComputePipeline(VkPipelineLayout layout, const uint32_t* code, size_t codeSize, const char* name)
+  {
+    VkShaderModuleCreateInfo shaderInfo{VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO, nullptr};
+    shaderInfo.codeSize = codeSize;
+    shaderInfo.pCode    = code;
+
+    VkShaderModule shader = VK_NULL_HANDLE;
+    NVVK_CHECK(vkCreateShaderModule(m_device, &shaderInfo, nullptr, &shader));
+
+    VkPipelineShaderStageCreateInfo stageCreateInfo{VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, nullptr};
+    stageCreateInfo.stage  = VK_SHADER_STAGE_COMPUTE_BIT;
+    stageCreateInfo.module = shader;
+    stageCreateInfo.pName  = "main";
+
+    VkComputePipelineCreateInfo pipelineInfo{VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO, nullptr};
+    pipelineInfo.layout = layout;
+    pipelineInfo.stage  = stageCreateInfo;
+
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    NVVK_CHECK(vkCreateComputePipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline));
+    m_dutil->setObjectName(pipeline, name);
+
+    vkDestroyShaderModule(m_device, shader, nullptr);
+    return pipeline;
+  }
+
 
   //--------------------------------------------------------------------------------------------------
   //
@@ -1310,16 +2526,20 @@ private:
   nvvkhl::Application*              m_app{nullptr};
   std::unique_ptr<nvvk::DebugUtil>  m_dutil;
   std::unique_ptr<nvvkhl::AllocVma> m_alloc;
+  DeletionQueue                     m_deletionQueue;  // Resources replaced at runtime, until the GPU is done with them
 
   glm::vec2                                     m_viewSize = {1, 1};
   VkDevice                                      m_device   = VK_NULL_HANDLE;
-  std::unique_ptr<nvvkhl::GBuffer>              m_gBuffers;  // G-Buffers: color + depth
+  std::unique_ptr<nvvkhl::GBuffer>              m_gBuffers;    // G-Buffers: color + depth
+  std::unique_ptr<nvvkhl::GBuffer>              m_thumbnails;  // Atlas of the "Denoiser" panel previews
   std::unique_ptr<nvvk::DescriptorSetContainer> m_rtxSet;    // Descriptor set
   std::unique_ptr<nvvk::DescriptorSetContainer> m_sceneSet;  // Descriptor set
   std::unique_ptr<nvvk::DescriptorSetContainer> m_nrdSet;    // Descriptor set
 
   // Resources
   nvvk::Buffer m_bFrameInfo;
+  nvvk::Buffer m_bExposure;  // ExposureData
+  nvvk::Buffer m_bFirefly;   // FireflyData
 
   // Pipeline
   RtxPushConstant m_pushConst{
@@ -1332,19 +2552,43 @@ private:
       -1.0,        // overrideMetallic
   };  // Information sent to the shader
   nvvkhl::PipelineContainer m_rtxPipe;
+  VkPhysicalDeviceRayTracingPipelinePropertiesKHR m_rtProperties{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_PROPERTIES_KHR};
   int                       m_frame{0};
   FrameInfo                 m_frameInfo{};
 
-  GbufferNames m_showBuffer = eGBufLdr;
+  GbufferNames        m_showBuffer     = eGBufLdr;
+  Diagnostics::Buffer m_showDiagnostic = Diagnostics::eNone;  // takes precedence over m_showBuffer
 
   std::unique_ptr<nvh::gltf::Scene>              m_scene;
   std::unique_ptr<nvvkhl::SceneVk>               m_sceneVk;
-  std::unique_ptr<nvvkhl::SceneRtx>              m_sceneRtx;
+  std::unique_ptr<SceneAccel>                    m_sceneAccel;
+  std::unique_ptr<VertexQuantizer>               m_vertexQuantizer;  // compressed vertex attributes of m_sceneVk
+  std::unique_ptr<SceneLoader>                   m_sceneLoader;  // next scene, loaded while the current one renders
+  std::unique_ptr<TextureStreamer>               m_textureStreamer;  // mip levels of the current scene textures
+  std::unique_ptr<StagingRing>                   m_stagingRing;      // staging of the texture streaming uploads
+  uint32_t                                       m_sceneSetIndex{0};  // set of m_sceneSet with the current textures
   std::unique_ptr<nvvkhl::TonemapperPostProcess> m_tonemapper;
   std::unique_ptr<nvvk::SBTWrapper>              m_sbt;     // Shading binding table wrapper
   std::unique_ptr<nvvk::RayPickerKHR>            m_picker;  // For ray picking info
+  std::optional<nvvk::RayPickerKHR::PickInfo>    m_pickRequest;         // to be traced with the next frame
+  int                                            m_selectedMaterial{-1};  // of the last picked object, see materialUI()
+
+  // Field of a shading material to write with the next frame
+  struct MaterialPatch
+  {
+    VkDeviceSize            offset{0};
+    VkDeviceSize            size{0};
+    std::array<uint8_t, 16> data{};
+  };
+  std::vector<MaterialPatch> m_materialPatches;
+  bool                                           m_pickInFlight{false};  // requested and not applied yet
+  std::optional<uint64_t>                        m_pickSerial;           // serial of the frame tracing the request
+  uint64_t                                       m_frameSerial{0};       // frames recorded so far
   std::unique_ptr<nvvk::AxisVK>                  m_vkAxis;
-  std::unique_ptr<nvvkhl::HdrEnv>                m_hdrEnv;
+  std::unique_ptr<HdrEnvironment>                m_hdrEnv;
+  std::string                                    m_hdrFilename;  // to reload the environment when the sun extraction changes
+  bool                                           m_hdrSunExtracted{false};  // sun removed from the loaded HDR, see extractHdrSun()
+  std::unique_ptr<Diagnostics>                   m_diagnostics;  // Debug-only images, allocated on demand
 
   // #NRD
   std::unique_ptr<NRDWrapper> m_nrd;
@@ -1359,6 +2603,58 @@ private:
   VkPipeline            m_taaPipeline              = {};
   VkPipelineLayout      m_taaLayout                = {};
   VkDescriptorSetLayout m_taaDescSetlayout         = VK_NULL_HANDLE;
+
+  // Auto-exposure compute shaders
+  VkPipeline            m_exposureHistogramPipeline = {};
+  VkPipeline            m_exposureResolvePipeline   = {};
+  VkPipelineLayout      m_exposureLayout            = {};
+  VkDescriptorSetLayout m_exposureDescSetlayout     = VK_NULL_HANDLE;
+  ExposurePushConstant  m_exposurePushConst{
+      -10.F,  // minLogLum
+      22.F,   // logLumRange
+      0.5F,   // lowPercentile
+      0.95F,  // highPercentile
+      0.18F,  // keyValue, updated from the compensation
+      1.F,    // adaptation, updated from the frame time
+  };
+
+  // Adaptive firefly clamp compute shaders
+  VkPipeline            m_fireflyHistogramPipeline = {};
+  VkPipeline            m_fireflyResolvePipeline   = {};
+  VkPipelineLayout      m_fireflyLayout            = {};
+  VkDescriptorSetLayout m_fireflyDescSetlayout     = VK_NULL_HANDLE;
+  FireflyPushConstant   m_fireflyPushConst{
+      -10.F,   // minLogLum
+      30.F,    // logLumRange
+      0.995F,  // percentile
+      4.F,     // headroom
+      0.1F,    // minLuminance
+      1.F,     // adaptation, updated from the frame time
+      NRD_REBLUR,  // method, updated from m_pushConst
+  };
+
+  // Denoising, composition and TAA recorded into secondary command buffers, most recent first
+  struct RecordedChain
+  {
+    uint64_t        key = 0;  // from NRDWrapper::prepare() and the settings read by the chain
+    VkCommandBuffer cmd = VK_NULL_HANDLE;
+  };
+  static constexpr size_t    kMaxRecordedChains = 4;
+  VkCommandPool              m_chainCmdPool     = VK_NULL_HANDLE;
+  std::vector<RecordedChain> m_recordedChains;
+
+  FrameSnapshot m_render;  // snapshot the current frame is recorded from
+
+  std::unique_ptr<ThreadPool>       m_threadPool;  // workers shared by the background tasks of the engine
+  std::unique_ptr<ParallelRecorder> m_recorder;    // frame passes recorded on its own workers
+
+  // Thumbnail compute shader
+  VkPipeline            m_thumbnailPipeline      = {};
+  VkPipelineLayout      m_thumbnailLayout        = {};
+  VkDescriptorSetLayout m_thumbnailDescSetlayout = VK_NULL_HANDLE;
+  bool                  m_thumbnailsVisible      = false;  // "Denoiser" panel open during the last UI pass
+  bool                  m_thumbnailsDirty        = true;   // refresh on the next frame, regardless of the interval
+  int                   m_thumbnailsAge          = 0;      // frames since the last refresh
 };
 
 //////////////////////////////////////////////////////////////////////////
@@ -1409,6 +2705,15 @@ auto main(int /*argc*/, char** /*argv*/) -> int
   spec.physicalDevice = vkCtx.m_physicalDevice;
   spec.device         = vkCtx.m_device;
   spec.queues.push_back({vkCtx.m_queueGCT.familyIndex, vkCtx.m_queueGCT.queueIndex, vkCtx.m_queueGCT.queue});
+  // Queue of the uploads running along the rendering: the transfer queue, or the graphics queue without one
+  if(vkCtx.m_queueT.queue != VK_NULL_HANDLE)
+  {
+    spec.queues.push_back({vkCtx.m_queueT.familyIndex, vkCtx.m_queueT.queueIndex, vkCtx.m_queueT.queue});
+  }
+  else
+  {
+    spec.queues.push_back(spec.queues[0]);
+  }
 
   // Create the application
   auto app = std::make_unique<nvvkhl::Application>(spec);
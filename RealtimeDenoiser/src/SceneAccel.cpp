@@ -0,0 +1,489 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "SceneAccel.hpp"
+
+#include <nvh/nvprint.hpp>
+#include <nvvk/debug_util_vk.hpp>
+#include <nvvk/error_vk.hpp>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+VkDeviceAddress getAddress(VkDevice device, VkBuffer buffer)
+{
+  VkBufferDeviceAddressInfo info{VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO, nullptr, buffer};
+  return vkGetBufferDeviceAddress(device, &info);
+}
+
+VkDeviceAddress getAddress(VkDevice device, VkAccelerationStructureKHR accel)
+{
+  VkAccelerationStructureDeviceAddressInfoKHR info{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR};
+  info.accelerationStructure = accel;
+  return vkGetAccelerationStructureDeviceAddressKHR(device, &info);
+}
+
+VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+  return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// Makes the acceleration structure (and scratch) writes of a build visible to the next builds and to the shaders
+void accelBarrier(VkCommandBuffer cmd, VkPipelineStageFlags dstStage)
+{
+  VkMemoryBarrier barrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+  barrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+  barrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, dstStage, 0, 1, &barrier, 0,
+                       nullptr, 0, nullptr);
+}
+
+}  // namespace
+
+SceneAccel::SceneAccel(VkDevice device, VkPhysicalDevice physicalDevice, nvvk::ResourceAllocator* alloc)
+    : m_device(device)
+    , m_alloc(alloc)
+{
+  VkPhysicalDeviceAccelerationStructurePropertiesKHR asProps{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_PROPERTIES_KHR};
+  VkPhysicalDeviceProperties2 props{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2, &asProps};
+  vkGetPhysicalDeviceProperties2(physicalDevice, &props);
+  m_scratchAlignment = std::max<VkDeviceSize>(asProps.minAccelerationStructureScratchOffsetAlignment, 1);
+}
+
+SceneAccel::~SceneAccel()
+{
+  destroy();
+}
+
+void SceneAccel::setup(const nvh::gltf::Scene& scene, const nvvkhl::SceneVk& sceneVk, VkBuildAccelerationStructureFlagsKHR flags)
+{
+  destroy();
+  m_flags = flags;
+
+  const auto&  primitives     = scene.getRenderPrimitives();
+  VkDeviceSize largestScratch = 0;
+  VkDeviceSize totalScratch   = 0;
+  m_blasInputs.resize(primitives.size());
+  for(size_t p = 0; p < primitives.size(); ++p)
+  {
+    const nvh::gltf::RenderPrimitive& prim  = primitives[p];
+    BlasInput&                        input = m_blasInputs[p];
+
+    VkAccelerationStructureGeometryTrianglesDataKHR triangles{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR};
+    triangles.vertexFormat             = VK_FORMAT_R32G32B32_SFLOAT;
+    triangles.vertexData.deviceAddress = getAddress(m_device, sceneVk.vertexBuffers()[p].position.buffer);
+    triangles.vertexStride             = sizeof(glm::vec3);
+    triangles.maxVertex                = static_cast<uint32_t>(prim.vertexCount) - 1;
+    triangles.indexType                = VK_INDEX_TYPE_UINT32;
+    triangles.indexData.deviceAddress  = getAddress(m_device, sceneVk.indices()[p].buffer);
+
+    input.geometry.geometryType       = VK_GEOMETRY_TYPE_TRIANGLES_KHR;
+    input.geometry.geometry.triangles = triangles;
+    input.geometry.flags              = VK_GEOMETRY_NO_DUPLICATE_ANY_HIT_INVOCATION_BIT_KHR;  // any-hit for alpha
+    input.range.primitiveCount        = static_cast<uint32_t>(prim.indexCount / 3);
+
+    VkAccelerationStructureBuildGeometryInfoKHR buildInfo{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR};
+    buildInfo.type          = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
+    buildInfo.flags         = m_flags;
+    buildInfo.mode          = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
+    buildInfo.geometryCount = 1;
+    buildInfo.pGeometries   = &input.geometry;
+    vkGetAccelerationStructureBuildSizesKHR(m_device, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &buildInfo,
+                                            &input.range.primitiveCount, &input.sizes);
+
+    m_totalTriangles += input.range.primitiveCount;
+    largestScratch = std::max(largestScratch, alignUp(input.sizes.buildScratchSize, m_scratchAlignment));
+    totalScratch += alignUp(input.sizes.buildScratchSize, m_scratchAlignment);
+  }
+  m_scratchCapacity = std::max(largestScratch, std::min(m_scratchBudget, totalScratch));
+
+  m_blas.resize(m_blasInputs.size());
+  m_blasAddresses.resize(m_blasInputs.size(), 0);
+
+  if((m_flags & VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR) && !m_blasInputs.empty())
+  {
+    VkQueryPoolCreateInfo queryInfo{VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO};
+    queryInfo.queryType  = VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR;
+    queryInfo.queryCount = static_cast<uint32_t>(m_blasInputs.size());
+    NVVK_CHECK(vkCreateQueryPool(m_device, &queryInfo, nullptr, &m_compactQueries));
+  }
+}
+
+uint64_t SceneAccel::cmdBuildBlas(VkCommandBuffer cmd, uint64_t maxTriangles)
+{
+  // Next BLAS up to the triangle and scratch budgets, with their offsets in the scratch buffer
+  size_t                    end       = m_nextBlas;
+  uint64_t                  triangles = 0;
+  VkDeviceSize              scratch   = 0;
+  std::vector<VkDeviceSize> scratchOffsets;
+  while(end < m_blasInputs.size())
+  {
+    const BlasInput&   input       = m_blasInputs[end];
+    const VkDeviceSize blasScratch = alignUp(input.sizes.buildScratchSize, m_scratchAlignment);
+    if(end > m_nextBlas && (triangles + input.range.primitiveCount > maxTriangles || scratch + blasScratch > m_scratchCapacity))
+    {
+      break;
+    }
+    scratchOffsets.push_back(scratch);
+    scratch += blasScratch;
+    triangles += input.range.primitiveCount;
+    ++end;
+  }
+  if(end == m_nextBlas)
+  {
+    return 0;
+  }
+
+  const VkDeviceAddress scratchAddress = ensureScratch(m_scratchCapacity);
+  m_stats.scratchSize                  = m_scratchCapacity;
+  m_stats.steps++;
+
+  std::vector<VkAccelerationStructureBuildGeometryInfoKHR>     buildInfos;
+  std::vector<const VkAccelerationStructureBuildRangeInfoKHR*> ranges;
+  for(size_t b = m_nextBlas; b < end; ++b)
+  {
+    BlasInput& input = m_blasInputs[b];
+    m_blas[b]        = createAccel(VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR, input.sizes.accelerationStructureSize);
+
+    m_blasAddresses[b] = getAddress(m_device, m_blas[b].accel);
+
+    VkAccelerationStructureBuildGeometryInfoKHR buildInfo{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR};
+    buildInfo.type                      = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
+    buildInfo.flags                     = m_flags;
+    buildInfo.mode                      = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
+    buildInfo.dstAccelerationStructure  = m_blas[b].accel;
+    buildInfo.geometryCount             = 1;
+    buildInfo.pGeometries               = &input.geometry;
+    buildInfo.scratchData.deviceAddress = scratchAddress + scratchOffsets[b - m_nextBlas];
+    buildInfos.push_back(buildInfo);
+    ranges.push_back(&input.range);
+  }
+
+  vkCmdBuildAccelerationStructuresKHR(cmd, static_cast<uint32_t>(buildInfos.size()), buildInfos.data(), ranges.data());
+  accelBarrier(cmd, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR);
+
+  for(size_t b = m_nextBlas; b < end; ++b)
+  {
+    m_stats.builtSize += m_blasInputs[b].sizes.accelerationStructureSize;
+  }
+
+  // Compacted by the next step
+  if(m_compactQueries != VK_NULL_HANDLE)
+  {
+    std::vector<VkAccelerationStructureKHR> handles;
+    for(size_t b = m_nextBlas; b < end; ++b)
+    {
+      handles.push_back(m_blas[b].accel);
+    }
+    const uint32_t first = static_cast<uint32_t>(m_nextBlas);
+    const uint32_t count = static_cast<uint32_t>(handles.size());
+    vkCmdResetQueryPool(cmd, m_compactQueries, first, count);
+    vkCmdWriteAccelerationStructuresPropertiesKHR(cmd, count, handles.data(), VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR,
+                                                  m_compactQueries, first);
+    m_compactBegin = m_nextBlas;
+    m_compactEnd   = end;
+  }
+  else
+  {
+    m_stats.compactSize = m_stats.builtSize;
+  }
+
+  m_nextBlas = end;
+  m_builtTriangles += triangles;
+  return triangles;
+}
+
+void SceneAccel::cmdCompactBlas(VkCommandBuffer cmd)
+{
+  if(m_compactBegin == m_compactEnd)
+  {
+    return;
+  }
+
+  const uint32_t            count = static_cast<uint32_t>(m_compactEnd - m_compactBegin);
+  std::vector<VkDeviceSize> compactSizes(count);
+  NVVK_CHECK(vkGetQueryPoolResults(m_device, m_compactQueries, static_cast<uint32_t>(m_compactBegin), count,
+                                   count * sizeof(VkDeviceSize), compactSizes.data(), sizeof(VkDeviceSize),
+                                   VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+
+  for(size_t b = m_compactBegin; b < m_compactEnd; ++b)
+  {
+    const VkDeviceSize compactSize = compactSizes[b - m_compactBegin];
+    m_stats.compactSize += compactSize;
+
+    nvvk::AccelKHR compact = createAccel(VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR, compactSize);
+
+    VkCopyAccelerationStructureInfoKHR copyInfo{VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_INFO_KHR};
+    copyInfo.src  = m_blas[b].accel;
+    copyInfo.dst  = compact.accel;
+    copyInfo.mode = VK_COPY_ACCELERATION_STRUCTURE_MODE_COMPACT_KHR;
+    vkCmdCopyAccelerationStructureKHR(cmd, &copyInfo);
+
+    m_retiredBlas.push_back(m_blas[b]);
+    m_blas[b] = compact;
+
+    m_blasAddresses[b] = getAddress(m_device, compact.accel);
+  }
+  accelBarrier(cmd, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR);
+
+  m_compactBegin = m_compactEnd = 0;
+}
+
+void SceneAccel::releaseRetiredBlas()
+{
+  for(auto& blas : m_retiredBlas)
+  {
+    m_alloc->destroy(blas);
+  }
+  m_retiredBlas.clear();
+}
+
+// The cache is staged in a buffer of its own rather than in the StagingRing: it is read by the
+// deserialization, which needs a queue with acceleration structure support rather than the transfer
+// queue, and all of it must be resident at once, often more than the ring holds.
+void SceneAccel::cmdDeserializeBlas(VkCommandBuffer cmd, const uint8_t* data, size_t size, const std::vector<VkDeviceSize>& offsets)
+{
+  m_serialized = m_alloc->createBuffer(cmd, size, data, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
+  {
+    VkMemoryBarrier barrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr, VK_ACCESS_TRANSFER_WRITE_BIT,
+                            VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR};
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+                         0, 1, &barrier, 0, nullptr, 0, nullptr);
+  }
+  const VkDeviceAddress base = getAddress(m_device, m_serialized.buffer);
+
+  for(size_t b = 0; b < m_blasInputs.size(); ++b)
+  {
+    // Serialized header: driver UUID, compatibility UUID, serialized size, deserialized size, ...
+    uint64_t deserializedSize = 0;
+    memcpy(&deserializedSize, data + offsets[b] + 2 * VK_UUID_SIZE + sizeof(uint64_t), sizeof(uint64_t));
+
+    m_blas[b] = createAccel(VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR, deserializedSize);
+    m_blasAddresses[b] = getAddress(m_device, m_blas[b].accel);
+
+    VkCopyMemoryToAccelerationStructureInfoKHR copyInfo{VK_STRUCTURE_TYPE_COPY_MEMORY_TO_ACCELERATION_STRUCTURE_INFO_KHR};
+    copyInfo.src.deviceAddress = base + offsets[b];
+    copyInfo.dst               = m_blas[b].accel;
+    copyInfo.mode              = VK_COPY_ACCELERATION_STRUCTURE_MODE_DESERIALIZE_KHR;
+    vkCmdCopyMemoryToAccelerationStructureKHR(cmd, &copyInfo);
+  }
+  accelBarrier(cmd, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR);
+
+  m_nextBlas       = m_blasInputs.size();
+  m_builtTriangles = m_totalTriangles;
+  m_stats.builtSize = m_stats.compactSize = size;  // already compacted when serialized
+}
+
+void SceneAccel::cmdQuerySerializedSizes(VkCommandBuffer cmd)
+{
+  if(m_blas.empty())
+  {
+    return;
+  }
+
+  VkQueryPoolCreateInfo queryInfo{VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO};
+  queryInfo.queryType  = VK_QUERY_TYPE_ACCELERATION_STRUCTURE_SERIALIZATION_SIZE_KHR;
+  queryInfo.queryCount = static_cast<uint32_t>(m_blas.size());
+  NVVK_CHECK(vkCreateQueryPool(m_device, &queryInfo, nullptr, &m_sizeQueries));
+
+  std::vector<VkAccelerationStructureKHR> handles;
+  for(const auto& blas : m_blas)
+  {
+    handles.push_back(blas.accel);
+  }
+  vkCmdResetQueryPool(cmd, m_sizeQueries, 0, queryInfo.queryCount);
+  vkCmdWriteAccelerationStructuresPropertiesKHR(cmd, queryInfo.queryCount, handles.data(),
+                                                VK_QUERY_TYPE_ACCELERATION_STRUCTURE_SERIALIZATION_SIZE_KHR, m_sizeQueries, 0);
+}
+
+void SceneAccel::cmdSerializeBlas(VkCommandBuffer cmd)
+{
+  if(m_sizeQueries == VK_NULL_HANDLE)
+  {
+    return;
+  }
+
+  std::vector<VkDeviceSize> sizes(m_blas.size());
+  NVVK_CHECK(vkGetQueryPoolResults(m_device, m_sizeQueries, 0, static_cast<uint32_t>(sizes.size()),
+                                   sizes.size() * sizeof(VkDeviceSize), sizes.data(), sizeof(VkDeviceSize),
+                                   VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+
+  VkDeviceSize total = 0;
+  m_serializedOffsets.resize(sizes.size());
+  for(size_t b = 0; b < sizes.size(); ++b)
+  {
+    m_serializedOffsets[b] = total;
+    total += alignUp(sizes[b], 256);  // as required by the deserialization
+  }
+  m_serializedSize = total;
+
+  m_serialized = m_alloc->createBuffer(total, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                                       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+                                           | VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+  const VkDeviceAddress base = getAddress(m_device, m_serialized.buffer);
+  for(size_t b = 0; b < m_blas.size(); ++b)
+  {
+    VkCopyAccelerationStructureToMemoryInfoKHR copyInfo{VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_TO_MEMORY_INFO_KHR};
+    copyInfo.src               = m_blas[b].accel;
+    copyInfo.dst.deviceAddress = base + m_serializedOffsets[b];
+    copyInfo.mode              = VK_COPY_ACCELERATION_STRUCTURE_MODE_SERIALIZE_KHR;
+    vkCmdCopyAccelerationStructureToMemoryKHR(cmd, &copyInfo);
+  }
+
+  VkMemoryBarrier barrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT};
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_PIPELINE_STAGE_HOST_BIT, 0, 1,
+                       &barrier, 0, nullptr, 0, nullptr);
+}
+
+void SceneAccel::readSerializedBlas(std::vector<uint8_t>& data, std::vector<VkDeviceSize>& offsets)
+{
+  data.clear();
+  offsets = m_serializedOffsets;
+  if(m_serialized.buffer == VK_NULL_HANDLE || m_serializedOffsets.empty())
+  {
+    return;
+  }
+
+  const uint8_t* mapped = static_cast<const uint8_t*>(m_alloc->map(m_serialized));
+  data.assign(mapped, mapped + m_serializedSize);
+  m_alloc->unmap(m_serialized);
+}
+
+void SceneAccel::cmdBuildTlas(VkCommandBuffer cmd, const nvh::gltf::Scene& scene)
+{
+  const auto& materials = scene.getModel().materials;
+
+  std::vector<VkAccelerationStructureInstanceKHR> instances;
+  instances.reserve(scene.getRenderNodes().size());
+  for(const nvh::gltf::RenderNode& node : scene.getRenderNodes())
+  {
+    VkAccelerationStructureInstanceKHR instance{};
+    const glm::mat4 rows = glm::transpose(node.worldMatrix);  // VkTransformMatrixKHR is 3x4 row-major
+    memcpy(&instance.transform, &rows, sizeof(VkTransformMatrixKHR));
+    instance.instanceCustomIndex                    = node.renderPrimID;
+    instance.mask                                   = 0xFF;
+    instance.instanceShaderBindingTableRecordOffset = 0;
+    instance.accelerationStructureReference         = m_blasAddresses[node.renderPrimID];
+    if(node.materialID >= 0 && node.materialID < static_cast<int>(materials.size()) && materials[node.materialID].doubleSided)
+    {
+      instance.flags = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR;
+    }
+    instances.push_back(instance);
+  }
+
+  m_instances = m_alloc->createBuffer(cmd, instances,
+                                      VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT
+                                          | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR);
+  {
+    VkMemoryBarrier barrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr, VK_ACCESS_TRANSFER_WRITE_BIT,
+                            VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR};
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+                         0, 1, &barrier, 0, nullptr, 0, nullptr);
+  }
+
+  VkAccelerationStructureGeometryInstancesDataKHR instancesData{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR};
+  instancesData.data.deviceAddress = getAddress(m_device, m_instances.buffer);
+
+  VkAccelerationStructureGeometryKHR geometry{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR};
+  geometry.geometryType       = VK_GEOMETRY_TYPE_INSTANCES_KHR;
+  geometry.geometry.instances = instancesData;
+
+  VkAccelerationStructureBuildGeometryInfoKHR buildInfo{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR};
+  buildInfo.type          = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
+  buildInfo.flags         = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
+  buildInfo.mode          = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
+  buildInfo.geometryCount = 1;
+  buildInfo.pGeometries   = &geometry;
+
+  const uint32_t                           instanceCount = static_cast<uint32_t>(instances.size());
+  VkAccelerationStructureBuildSizesInfoKHR sizes{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR};
+  vkGetAccelerationStructureBuildSizesKHR(m_device, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &buildInfo,
+                                          &instanceCount, &sizes);
+
+  m_tlas                              = createAccel(VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR, sizes.accelerationStructureSize);
+  buildInfo.dstAccelerationStructure  = m_tlas.accel;
+  buildInfo.scratchData.deviceAddress = ensureScratch(sizes.buildScratchSize);
+
+  VkAccelerationStructureBuildRangeInfoKHR        range{instanceCount, 0, 0, 0};
+  const VkAccelerationStructureBuildRangeInfoKHR* pRange = &range;
+  vkCmdBuildAccelerationStructuresKHR(cmd, 1, &buildInfo, &pRange);
+
+  // Traced by the ray tracing pipeline, and by the ray queries of the picker
+  accelBarrier(cmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+
+  nvvk::DebugUtil(m_device).setObjectName(m_tlas.accel, "SceneTlas");
+}
+
+void SceneAccel::releaseBuildResources()
+{
+  m_alloc->destroy(m_scratch);
+  m_alloc->destroy(m_instances);
+  m_alloc->destroy(m_serialized);
+  releaseRetiredBlas();
+  m_serializedOffsets.clear();
+  m_serializedSize = 0;
+  vkDestroyQueryPool(m_device, m_sizeQueries, nullptr);
+  vkDestroyQueryPool(m_device, m_compactQueries, nullptr);
+  m_sizeQueries    = VK_NULL_HANDLE;
+  m_compactQueries = VK_NULL_HANDLE;
+  m_scratchSize = 0;
+}
+
+VkDeviceAddress SceneAccel::ensureScratch(VkDeviceSize size)
+{
+  if(size > m_scratchSize)
+  {
+    m_alloc->destroy(m_scratch);
+    m_scratch     = m_alloc->createBuffer(size + m_scratchAlignment,  // room to align the start address
+                                          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
+    m_scratchSize = size;
+  }
+  return alignUp(getAddress(m_device, m_scratch.buffer), m_scratchAlignment);
+}
+
+nvvk::AccelKHR SceneAccel::createAccel(VkAccelerationStructureTypeKHR type, VkDeviceSize size)
+{
+  VkAccelerationStructureCreateInfoKHR createInfo{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR};
+  createInfo.type = type;
+  createInfo.size = size;
+  return m_alloc->createAcceleration(createInfo);
+}
+
+void SceneAccel::destroy()
+{
+  releaseBuildResources();
+  for(auto& blas : m_blas)
+  {
+    m_alloc->destroy(blas);
+  }
+  m_alloc->destroy(m_tlas);
+  m_blas.clear();
+  m_blasAddresses.clear();
+  m_blasInputs.clear();
+  m_nextBlas       = 0;
+  m_compactBegin   = 0;
+  m_compactEnd     = 0;
+  m_stats          = {};
+  m_totalTriangles = 0;
+  m_builtTriangles = 0;
+}
@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <vector>
+
+#include <vulkan/vulkan_core.h>
+
+#include <nvh/gltfscene.hpp>
+#include <nvvk/resourceallocator_vk.hpp>
+#include <nvvkhl/gltf_scene_vk.hpp>
+
+/* Acceleration structures of a glTF scene: one BLAS per render primitive, and a TLAS with one
+ * instance per render node, whose custom index is the render primitive (as the hit shaders expect).
+ *
+ * Unlike nvvkhl::SceneRtx, the BLAS are built in steps of a bounded number of triangles, so that
+ * the builds of a large scene can be spread over several submissions, see SceneLoader.
+ * The BLAS of a step also fit in a scratch memory budget: a single scratch buffer of that size
+ * (or of the largest BLAS, if larger) is allocated and reused by all steps.
+ * With VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR, each step of BLAS is compacted
+ * by the next step: the compacted sizes are queried with the builds, and the BLAS copied into
+ * tightly sized ones once the sizes are known.
+ */
+class SceneAccel
+{
+public:
+  SceneAccel(VkDevice device, VkPhysicalDevice physicalDevice, nvvk::ResourceAllocator* alloc);
+  ~SceneAccel();
+
+  /* Gather the build inputs of all BLAS. The buffers of 'sceneVk' are referenced by the builds. */
+  void setup(const nvh::gltf::Scene& scene, const nvvkhl::SceneVk& sceneVk, VkBuildAccelerationStructureFlagsKHR flags);
+
+  /* Scratch memory of the BLAS builds, to be set before the first step */
+  void setScratchBudget(VkDeviceSize budget) { m_scratchBudget = budget; }
+
+  /* Record the builds of the next BLAS, up to 'maxTriangles' triangles and the scratch budget but at least one BLAS.
+   * The scratch buffer is shared by all steps: the previous step must have completed.
+   * Returns the number of triangles recorded, 0 once all BLAS are built.
+   */
+  uint64_t cmdBuildBlas(VkCommandBuffer cmd, uint64_t maxTriangles);
+  bool     isBlasBuilt() const { return m_nextBlas == m_blasInputs.size(); }
+  size_t   getBuiltBlas() const { return m_nextBlas; }
+  size_t   getBlasCount() const { return m_blasInputs.size(); }
+
+  /* Record the compaction of the BLAS of the previous step, which must have completed.
+   * The original BLAS are kept until releaseRetiredBlas(), once this step completed too.
+   */
+  void cmdCompactBlas(VkCommandBuffer cmd);
+  void releaseRetiredBlas();
+
+  /* Create all BLAS from serialized data instead of building them, see AccelCache.
+   * 'offsets' locate the serialized BLAS of each render primitive in 'data', and are 256-byte aligned.
+   */
+  void cmdDeserializeBlas(VkCommandBuffer cmd, const uint8_t* data, size_t size, const std::vector<VkDeviceSize>& offsets);
+
+  /* Serialization of the built BLAS, in two steps: the query of their serialized sizes, then,
+   * once that completed, the copy to host memory. readSerializedBlas() returns the data packed
+   * with 256-byte aligned offsets once the copy completed.
+   */
+  void cmdQuerySerializedSizes(VkCommandBuffer cmd);
+  void cmdSerializeBlas(VkCommandBuffer cmd);
+  void readSerializedBlas(std::vector<uint8_t>& data, std::vector<VkDeviceSize>& offsets);
+
+  /* Record the TLAS build, once all BLAS are built */
+  void cmdBuildTlas(VkCommandBuffer cmd, const nvh::gltf::Scene& scene);
+
+  /* Memory of the BLAS as built, and after compaction (same as built for BLAS not compacted) */
+  struct Statistics
+  {
+    VkDeviceSize builtSize{0};
+    VkDeviceSize compactSize{0};
+    VkDeviceSize scratchSize{0};  // of the buffer shared by the BLAS steps
+    uint32_t     steps{0};
+  };
+  const Statistics& getStatistics() const { return m_stats; }
+
+  /* Release the memory only needed while building, once the builds completed */
+  void releaseBuildResources();
+
+  VkAccelerationStructureKHR tlas() const { return m_tlas.accel; }
+  uint64_t                   getTotalTriangles() const { return m_totalTriangles; }
+  uint64_t                   getBuiltTriangles() const { return m_builtTriangles; }
+
+private:
+  struct BlasInput
+  {
+    VkAccelerationStructureGeometryKHR       geometry{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR};
+    VkAccelerationStructureBuildRangeInfoKHR range{};
+    VkAccelerationStructureBuildSizesInfoKHR sizes{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR};
+  };
+
+  // Scratch buffer of at least 'size' bytes, returns its device address
+  VkDeviceAddress ensureScratch(VkDeviceSize size);
+  nvvk::AccelKHR  createAccel(VkAccelerationStructureTypeKHR type, VkDeviceSize size);
+  void            destroy();
+
+  VkDevice                 m_device = VK_NULL_HANDLE;
+  nvvk::ResourceAllocator* m_alloc  = nullptr;
+  VkDeviceSize             m_scratchAlignment{128};
+  VkDeviceSize             m_scratchBudget{256ull << 20};
+  VkDeviceSize             m_scratchCapacity{0};  // scratch of the BLAS steps, from the budget and the largest BLAS
+
+  VkBuildAccelerationStructureFlagsKHR m_flags{};
+  std::vector<BlasInput>               m_blasInputs;  // one per render primitive
+  std::vector<nvvk::AccelKHR>          m_blas;
+  std::vector<VkDeviceAddress>         m_blasAddresses;
+  size_t                               m_nextBlas{0};
+  size_t                               m_compactBegin{0};  // BLAS of the previous step, to compact
+  size_t                               m_compactEnd{0};
+  VkQueryPool                          m_compactQueries = VK_NULL_HANDLE;  // compacted size of each BLAS
+  std::vector<nvvk::AccelKHR>          m_retiredBlas;                      // replaced by their compacted copy
+  Statistics                           m_stats;
+  uint64_t                             m_totalTriangles{0};
+  uint64_t                             m_builtTriangles{0};
+
+  VkQueryPool               m_sizeQueries = VK_NULL_HANDLE;  // serialized size of each BLAS
+  nvvk::Buffer              m_serialized;                   // serialized BLAS, uploaded or read back
+  std::vector<VkDeviceSize> m_serializedOffsets;
+  VkDeviceSize              m_serializedSize{0};
+
+  nvvk::AccelKHR m_tlas;
+  nvvk::Buffer   m_instances;  // VkAccelerationStructureInstanceKHR of the TLAS build
+  nvvk::Buffer   m_scratch;
+  VkDeviceSize   m_scratchSize{0};
+};
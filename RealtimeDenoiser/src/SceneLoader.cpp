@@ -0,0 +1,1086 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "SceneLoader.hpp"
+
+#include <nvh/nvprint.hpp>
+#include <nvvk/error_vk.hpp>
+
+#include "MappedFile.hpp"
+#include "MeshOptimizer.hpp"
+#include "TextureCompressor.hpp"
+#include "VertexQuantizer.hpp"
+#include "stb_image.h"
+#include "tiny_gltf.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+SceneLoader::SceneLoader(VkDevice                 device,
+                         VkPhysicalDevice         physicalDevice,
+                         nvvk::ResourceAllocator* alloc,
+                         VkQueue                  queue,
+                         uint32_t                 queueFamilyIndex,
+                         ThreadPool&              threads)
+    : m_device(device)
+    , m_physicalDevice(physicalDevice)
+    , m_alloc(alloc)
+    , m_queue(queue)
+    , m_threads(threads)
+{
+  VkCommandPoolCreateInfo poolInfo{VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
+  poolInfo.flags            = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  poolInfo.queueFamilyIndex = queueFamilyIndex;
+  NVVK_CHECK(vkCreateCommandPool(m_device, &poolInfo, nullptr, &m_cmdPool));
+
+  VkCommandBufferAllocateInfo allocInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+  allocInfo.commandPool        = m_cmdPool;
+  allocInfo.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  allocInfo.commandBufferCount = 1;
+  NVVK_CHECK(vkAllocateCommandBuffers(m_device, &allocInfo, &m_cmd));
+
+  VkFenceCreateInfo fenceInfo{VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
+  NVVK_CHECK(vkCreateFence(m_device, &fenceInfo, nullptr, &m_fence));
+
+  // The BLAS steps are sized from their measured duration, when the queue supports timestamps
+  uint32_t familyCount = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, nullptr);
+  std::vector<VkQueueFamilyProperties> families(familyCount);
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, families.data());
+  m_hasTimestamps = queueFamilyIndex < familyCount && families[queueFamilyIndex].timestampValidBits > 0;
+
+  VkPhysicalDeviceIDProperties idProps{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES};
+  VkPhysicalDeviceProperties2  props{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2, &idProps};
+  vkGetPhysicalDeviceProperties2(physicalDevice, &props);
+  m_timestampPeriod = props.properties.limits.timestampPeriod;
+  memcpy(m_deviceUUID, idProps.deviceUUID, VK_UUID_SIZE);
+
+  // The streamed textures are sampled with linear filtering, in both color spaces
+  m_supportsBC7 = true;
+  for(VkFormat format : {VK_FORMAT_BC7_UNORM_BLOCK, VK_FORMAT_BC7_SRGB_BLOCK})
+  {
+    VkFormatProperties formatProps{};
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &formatProps);
+    m_supportsBC7 &= (formatProps.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT) != 0;
+  }
+
+  if(m_hasTimestamps)
+  {
+    VkQueryPoolCreateInfo queryInfo{VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO};
+    queryInfo.queryType  = VK_QUERY_TYPE_TIMESTAMP;
+    queryInfo.queryCount = 4;
+    NVVK_CHECK(vkCreateQueryPool(m_device, &queryInfo, nullptr, &m_queryPool));
+  }
+
+  m_mipGenerator = std::make_unique<MipGenerator>(m_device, m_alloc);
+}
+
+namespace {
+constexpr VkBuildAccelerationStructureFlagsKHR kBlasFlags =
+    VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR;
+
+// Elements of an accessor, in place in their buffer
+struct AccessorData
+{
+  const uint8_t* data{nullptr};
+  size_t         elementSize{0};
+  size_t         stride{0};
+  size_t         count{0};
+
+  bool   isPacked() const { return stride == elementSize; }
+  size_t size() const { return elementSize * count; }
+};
+
+// tinygltf file reads of the external buffers, copied once from a mapping of the file
+bool readMappedFile(std::vector<unsigned char>* out, std::string* err, const std::string& path, void* /*userData*/)
+{
+  MappedFile file;
+  if(!file.open(path))
+  {
+    if(err)
+    {
+      *err += "File open error : " + path + "\n";
+    }
+    return false;
+  }
+  out->assign(file.data(), file.data() + file.size());
+  return true;
+}
+
+// Null data for the accessors that cannot be compared byte-wise: sparse, without buffer view, or invalid
+AccessorData getAccessorData(const tinygltf::Model& model, const tinygltf::Accessor& accessor)
+{
+  AccessorData result;
+  const int    componentSize = tinygltf::GetComponentSizeInBytes(accessor.componentType);
+  const int    components    = tinygltf::GetNumComponentsInType(accessor.type);
+  if(accessor.sparse.isSparse || accessor.bufferView < 0 || componentSize <= 0 || components <= 0 || accessor.count == 0)
+  {
+    return result;
+  }
+
+  const tinygltf::BufferView& view   = model.bufferViews[accessor.bufferView];
+  const tinygltf::Buffer&     buffer = model.buffers[view.buffer];
+  result.elementSize                 = size_t(componentSize) * size_t(components);
+  result.stride                      = view.byteStride > 0 ? view.byteStride : result.elementSize;
+  result.count                       = accessor.count;
+
+  const size_t offset = view.byteOffset + accessor.byteOffset;
+  if(offset + result.stride * (result.count - 1) + result.elementSize > buffer.data.size())
+  {
+    return {};
+  }
+  result.data = buffer.data.data() + offset;
+  return result;
+}
+
+// Same hash as for the cache keys, over the packed elements
+uint64_t hashAccessor(const AccessorData& accessor)
+{
+  constexpr uint64_t kBasis = 0xCBF29CE484222325ull;
+  if(accessor.isPacked())
+  {
+    return AccelCache::hashData(accessor.data, accessor.size(), kBasis);
+  }
+  std::vector<uint8_t> packed(accessor.size());
+  for(size_t e = 0; e < accessor.count; ++e)
+  {
+    memcpy(packed.data() + e * accessor.elementSize, accessor.data + e * accessor.stride, accessor.elementSize);
+  }
+  return AccelCache::hashData(packed.data(), packed.size(), kBasis);
+}
+
+bool isSameData(const AccessorData& a, const AccessorData& b)
+{
+  if(a.elementSize != b.elementSize || a.count != b.count)
+  {
+    return false;
+  }
+  if(a.isPacked() && b.isPacked())
+  {
+    return memcmp(a.data, b.data, a.size()) == 0;
+  }
+  for(size_t e = 0; e < a.count; ++e)
+  {
+    if(memcmp(a.data + e * a.stride, b.data + e * b.stride, a.elementSize) != 0)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Flag the accessors read by the mesh primitives
+void markPrimitiveAccessors(const tinygltf::Model& model, std::vector<bool>& accessors)
+{
+  accessors.resize(model.accessors.size(), false);
+  auto mark = [&](int accessor) {
+    if(accessor >= 0 && accessor < static_cast<int>(accessors.size()))
+    {
+      accessors[accessor] = true;
+    }
+  };
+  for(const tinygltf::Mesh& mesh : model.meshes)
+  {
+    for(const tinygltf::Primitive& primitive : mesh.primitives)
+    {
+      mark(primitive.indices);
+      for(const auto& attribute : primitive.attributes)
+      {
+        mark(attribute.second);
+      }
+      for(const auto& target : primitive.targets)
+      {
+        for(const auto& attribute : target)
+        {
+          mark(attribute.second);
+        }
+      }
+    }
+  }
+}
+}  // namespace
+
+SceneLoader::~SceneLoader()
+{
+  if(m_parsing.valid())
+  {
+    m_parsing.wait();
+  }
+  if(m_cacheWrite.valid())
+  {
+    m_cacheWrite.wait();
+  }
+  abandon();
+  vkDestroyQueryPool(m_device, m_queryPool, nullptr);
+  vkDestroyFence(m_device, m_fence, nullptr);
+  vkDestroyCommandPool(m_device, m_cmdPool, nullptr);
+}
+
+void SceneLoader::load(const std::string& filename)
+{
+  // The parser cannot be interrupted: the new file is loaded once it returns
+  if(m_stage == Stage::eParsing)
+  {
+    m_nextFilename = filename;
+    return;
+  }
+
+  abandon();
+
+  m_filename  = filename;
+  m_stage     = Stage::eParsing;
+  m_loadStart = std::chrono::steady_clock::now();
+  m_parsing   = std::async(std::launch::async, [this, filename, optimize = m_optimizeMeshes, quantize = m_quantizeVertices,
+                                                compress = m_compressTextures && m_supportsBC7,
+                                                generateMips = m_generateMips]() {
+    Parsed parsed;
+    parsed.scene = std::make_unique<nvh::gltf::Scene>();
+    if(!loadScene(filename, *parsed.scene))
+    {
+      parsed.scene.reset();
+      return parsed;
+    }
+    // The geometry replaced below is released once its replacement exists, step by step
+    std::vector<bool> geometryAccessors;
+    size_t            released = 0;
+    markPrimitiveAccessors(parsed.scene->getModel(), geometryAccessors);
+    bool changed = deduplicateGeometry(parsed.scene->getModel(), m_threads);
+    if(optimize)
+    {
+      const auto                start = std::chrono::steady_clock::now();
+      MeshOptimizer::Statistics stats;
+      if(MeshOptimizer::optimize(parsed.scene->getModel(), m_threads, stats))
+      {
+        released += releaseReplacedGeometry(parsed.scene->getModel(), geometryAccessors);
+        markPrimitiveAccessors(parsed.scene->getModel(), geometryAccessors);
+        changed = true;
+      }
+      const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+      LOGI("SceneLoader: optimized %llu meshes in %.1f ms: %llu -> %llu vertices, %llu -> %llu triangles (%llu degenerate, %llu duplicates), ACMR %.3f -> %.3f\n",
+           static_cast<unsigned long long>(stats.meshes), ms, static_cast<unsigned long long>(stats.verticesBefore),
+           static_cast<unsigned long long>(stats.verticesAfter), static_cast<unsigned long long>(stats.trianglesBefore),
+           static_cast<unsigned long long>(stats.trianglesAfter), static_cast<unsigned long long>(stats.degenerateTriangles),
+           static_cast<unsigned long long>(stats.duplicateTriangles), stats.getAcmrBefore(), stats.getAcmrAfter());
+    }
+    if(quantize)
+    {
+      const auto                  start = std::chrono::steady_clock::now();
+      VertexQuantizer::Statistics stats;
+      changed |= VertexQuantizer::quantize(parsed.scene->getModel(), m_threads, stats);
+      const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+      LOGI("SceneLoader: quantized the vertex attributes of %llu meshes in %.1f ms: %.1f MB instead of %.1f MB\n",
+           static_cast<unsigned long long>(stats.primitives), ms, stats.bytesAfter / (1024.0 * 1024.0),
+           stats.bytesBefore / (1024.0 * 1024.0));
+    }
+    if(changed)
+    {
+      released += releaseReplacedGeometry(parsed.scene->getModel(), geometryAccessors);
+      LOGI("SceneLoader: released %.1f MB of replaced geometry\n", double(released) / (1 << 20));
+
+      // Makes the render primitives again, from the merged, optimized and quantized accessors
+      const size_t    primitives = parsed.scene->getRenderPrimitives().size();
+      tinygltf::Model model      = std::move(parsed.scene->getModel());
+      parsed.scene->takeModel(std::move(model));
+      LOGI("SceneLoader: %zu render primitives (and BLAS) instead of %zu\n", parsed.scene->getRenderPrimitives().size(), primitives);
+    }
+    decodeImages(parsed.scene->getModel(), std::filesystem::path(filename).parent_path().string(), m_threads, compress,
+                 parsed.images);
+    if(generateMips)
+    {
+      takeEmbeddedImages(parsed.scene->getModel(), parsed.embedded);
+    }
+
+    // The optimized meshes have other BLAS, and the quantized ones may have other render primitives
+    parsed.cacheKey = AccelCache::computeKey(filename, parsed.scene->getModel(), kBlasFlags, m_deviceUUID);
+    parsed.cacheKey = AccelCache::hashData(reinterpret_cast<const uint8_t*>(&optimize), sizeof(optimize), parsed.cacheKey);
+    parsed.cacheKey = AccelCache::hashData(reinterpret_cast<const uint8_t*>(&quantize), sizeof(quantize), parsed.cacheKey);
+    parsed.cache.open(parsed.cacheKey, parsed.scene->getRenderPrimitives().size());
+    return parsed;
+  });
+}
+
+bool SceneLoader::update()
+{
+  if(m_stepInFlight)
+  {
+    if(vkGetFenceStatus(m_device, m_fence) != VK_SUCCESS)
+    {
+      return false;
+    }
+    completeStep();
+  }
+
+  switch(m_stage)
+  {
+    case Stage::eIdle:
+      return false;
+
+    case Stage::eParsing: {
+      if(m_parsing.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+      {
+        return false;
+      }
+      Parsed parsed  = m_parsing.get();
+      m_result.scene  = std::move(parsed.scene);
+      m_result.images = std::move(parsed.images);
+      m_cacheKey      = parsed.cacheKey;
+      m_cache        = std::move(parsed.cache);
+      m_stage        = Stage::eIdle;
+
+      if(!m_nextFilename.empty())
+      {
+        m_result = {};
+        load(std::exchange(m_nextFilename, {}));
+        return false;
+      }
+      if(!m_result.scene)
+      {
+        LOGE("Error loading scene %s\n", m_filename.c_str());
+        m_result = {};
+        return false;
+      }
+
+      // Buffers and textures, in a single submission: nvvkhl::SceneVk creates them all at once
+      m_result.filename = m_filename;
+      m_result.sceneVk  = std::make_unique<nvvkhl::SceneVk>(m_device, m_physicalDevice, m_alloc);
+      VkCommandBuffer cmd = beginStep();
+      m_result.sceneVk->create(cmd, *m_result.scene);
+      m_result.vertexQuantizer = std::make_unique<VertexQuantizer>(m_device, m_alloc);
+      m_result.vertexQuantizer->create(cmd, *m_result.scene);
+
+      // The embedded images, whose mip chains are generated once all first levels are uploaded
+      m_result.textures.resize(parsed.embedded.size());
+      for(size_t i = 0; i < parsed.embedded.size(); ++i)
+      {
+        if(parsed.embedded[i].isValid())
+        {
+          m_result.textures[i] = m_mipGenerator->createTexture(cmd, parsed.embedded[i]);
+          ++m_mipTextures;
+        }
+      }
+      if(m_mipTextures > 0)
+      {
+        // Timed from the completion of the uploads to that of the last pass
+        if(m_hasTimestamps)
+        {
+          vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_queryPool, 2);
+        }
+        m_mipDispatches = m_mipGenerator->cmdGenerate(cmd);
+        if(m_hasTimestamps)
+        {
+          vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_queryPool, 3);
+        }
+      }
+      submitStep(cmd);
+      m_stage = Stage::eUploading;
+      return false;
+    }
+
+    case Stage::eUploading:
+      // Everything that follows reads the geometry from the device
+      releaseCpuData(m_result.scene->getModel());
+
+      m_result.sceneAccel = std::make_unique<SceneAccel>(m_device, m_physicalDevice, m_alloc);
+      m_result.sceneAccel->setScratchBudget(m_scratchBudget);
+      m_result.sceneAccel->setup(*m_result.scene, *m_result.sceneVk, kBlasFlags);
+      m_stage = Stage::eBuildingBlas;
+
+      // BLAS built by a previous run, uploaded straight from the mapped cache file
+      m_fromCache = m_cache.isCompatible(m_device);
+      if(m_fromCache)
+      {
+        VkCommandBuffer cmd = beginStep();
+        m_result.sceneAccel->cmdDeserializeBlas(cmd, m_cache.getData(), m_cache.getDataSize(), m_cache.getOffsets());
+        submitStep(cmd);
+        return false;
+      }
+      if(m_cache.isOpen())
+      {
+        LOGI("SceneLoader: the cached BLAS are not compatible with this driver, rebuilding them\n");
+        m_cache.close();
+      }
+      [[fallthrough]];
+
+    case Stage::eBuildingBlas: {
+      // The previous step completed: its BLAS get compacted along with the builds of this one
+      m_result.sceneAccel->releaseRetiredBlas();
+      VkCommandBuffer cmd = beginStep();
+      m_result.sceneAccel->cmdCompactBlas(cmd);
+      m_stepTriangles = 0;
+      if(!m_result.sceneAccel->isBlasBuilt())
+      {
+        m_stepTriangles = m_result.sceneAccel->cmdBuildBlas(cmd, m_trianglesPerStep);
+      }
+      else
+      {
+        if(!m_fromCache)
+        {
+          m_result.sceneAccel->cmdQuerySerializedSizes(cmd);
+        }
+        m_result.sceneAccel->cmdBuildTlas(cmd, *m_result.scene);
+        m_stage = Stage::eBuildingTlas;
+      }
+      submitStep(cmd);
+      return false;
+    }
+
+    case Stage::eBuildingTlas: {
+      if(m_fromCache || m_result.sceneAccel->getTotalTriangles() == 0)
+      {
+        return finish();
+      }
+      VkCommandBuffer cmd = beginStep();
+      m_result.sceneAccel->cmdSerializeBlas(cmd);
+      submitStep(cmd);
+      m_stage = Stage::eCaching;
+      return false;
+    }
+
+    case Stage::eCaching: {
+      // Written in the background: the scene does not depend on it
+      auto data    = std::make_shared<std::vector<uint8_t>>();
+      auto offsets = std::make_shared<std::vector<VkDeviceSize>>();
+      m_result.sceneAccel->readSerializedBlas(*data, *offsets);
+      if(m_cacheWrite.valid())
+      {
+        m_cacheWrite.wait();
+      }
+      m_cacheWrite = std::async(std::launch::async, [key = m_cacheKey, data, offsets]() {
+        const bool written = AccelCache::write(key, *data, *offsets);
+        if(!written)
+        {
+          LOGW("SceneLoader: could not write %s\n", AccelCache::getPath(key).c_str());
+        }
+        return written;
+      });
+      return finish();
+    }
+
+    case Stage::eReady:
+      return true;
+  }
+  return false;
+}
+
+bool SceneLoader::finish()
+{
+  m_result.sceneAccel->releaseBuildResources();
+  m_cache.close();
+  m_stage = Stage::eReady;
+
+  const SceneAccel::Statistics& stats = m_result.sceneAccel->getStatistics();
+  if(!m_fromCache && stats.builtSize > 0)
+  {
+    LOGI("SceneLoader: %zu BLAS built in %u steps, with %.1f MB of scratch memory\n", m_result.sceneAccel->getBlasCount(),
+         stats.steps, double(stats.scratchSize) / (1 << 20));
+    LOGI("SceneLoader: BLAS compacted from %.1f MB to %.1f MB (%.0f%% saved)\n", double(stats.builtSize) / (1 << 20),
+         double(stats.compactSize) / (1 << 20), 100.0 * (1.0 - double(stats.compactSize) / double(stats.builtSize)));
+  }
+
+  const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_loadStart).count();
+  LOGI("SceneLoader: %s ready in %.2f s, %llu triangles%s\n", m_filename.c_str(), seconds,
+       static_cast<unsigned long long>(m_result.sceneAccel->getTotalTriangles()), m_fromCache ? ", BLAS from the cache" : "");
+  return true;
+}
+
+SceneLoader::Result SceneLoader::take()
+{
+  Result result = std::move(m_result);
+  m_result      = {};
+  m_stage       = Stage::eIdle;
+  return result;
+}
+
+float SceneLoader::getProgress() const
+{
+  switch(m_stage)
+  {
+    case Stage::eParsing:
+      return 0.F;
+    case Stage::eUploading:
+      return 0.1F;
+    case Stage::eBuildingBlas: {
+      const uint64_t total = m_result.sceneAccel ? m_result.sceneAccel->getTotalTriangles() : 0;
+      const float    built = total > 0 ? float(m_result.sceneAccel->getBuiltTriangles()) / float(total) : 1.F;
+      return 0.2F + 0.75F * built;
+    }
+    case Stage::eBuildingTlas:
+      return 0.95F;
+    case Stage::eCaching:
+      return 0.98F;
+    case Stage::eReady:
+      return 1.F;
+    default:
+      return 0.F;
+  }
+}
+
+const char* SceneLoader::getStageName(Stage stage)
+{
+  switch(stage)
+  {
+    case Stage::eParsing:
+      return "Parsing";
+    case Stage::eUploading:
+      return "Uploading";
+    case Stage::eBuildingBlas:
+      return "Building BLAS";
+    case Stage::eBuildingTlas:
+      return "Building TLAS";
+    case Stage::eCaching:
+      return "Caching BLAS";
+    case Stage::eReady:
+      return "Ready";
+    default:
+      return "Idle";
+  }
+}
+
+bool SceneLoader::loadScene(const std::string& filename, nvh::gltf::Scene& scene)
+{
+  std::string extension = std::filesystem::path(filename).extension().string();
+  std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return char(tolower(c)); });
+  if(extension != ".gltf" && extension != ".glb")
+  {
+    return scene.load(filename);  // converted by nvh::gltf::Scene
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  MappedFile file;
+  if(!file.open(filename) || file.size() > UINT32_MAX)
+  {
+    LOGE("SceneLoader: could not map %s\n", filename.c_str());
+    return false;
+  }
+
+  tinygltf::TinyGLTF    loader;
+  tinygltf::FsCallbacks fs{};
+  fs.FileExists         = &tinygltf::FileExists;
+  fs.ExpandFilePath     = &tinygltf::ExpandFilePath;
+  fs.ReadWholeFile      = &readMappedFile;
+  fs.WriteWholeFile     = &tinygltf::WriteWholeFile;
+  fs.GetFileSizeInBytes = &tinygltf::GetFileSizeInBytes;
+  loader.SetFsCallbacks(fs);
+
+  // Parsed in place: the binary chunk of a .glb is copied once, straight to its buffer
+  tinygltf::Model    model;
+  std::string        err, warn;
+  const std::string  basedir = std::filesystem::path(filename).parent_path().string();
+  const unsigned int size    = static_cast<unsigned int>(file.size());
+  const bool         loaded  = extension == ".glb" ?
+                                  loader.LoadBinaryFromMemory(&model, &err, &warn, file.data(), size, basedir) :
+                                  loader.LoadASCIIFromString(&model, &err, &warn, reinterpret_cast<const char*>(file.data()), size, basedir);
+  if(!warn.empty())
+  {
+    LOGW("SceneLoader: %s\n", warn.c_str());
+  }
+  if(!loaded)
+  {
+    LOGE("SceneLoader: %s\n", err.c_str());
+    return false;
+  }
+  file.close();
+
+  size_t bufferSize = 0;
+  for(const tinygltf::Buffer& buffer : model.buffers)
+  {
+    bufferSize += buffer.data.size();
+  }
+  scene.takeModel(std::move(model));
+
+  const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  LOGI("SceneLoader: parsed %s with %.1f MB of buffers in %.1f ms\n", filename.c_str(), double(bufferSize) / (1 << 20), ms);
+  return true;
+}
+
+size_t SceneLoader::releaseReplacedGeometry(tinygltf::Model& model, const std::vector<bool>& geometryAccessors)
+{
+  // Accessors still read: by the primitives, the skins and the animations
+  std::vector<bool> used;
+  markPrimitiveAccessors(model, used);
+  auto markUsed = [&](int accessor) {
+    if(accessor >= 0 && accessor < static_cast<int>(used.size()))
+    {
+      used[accessor] = true;
+    }
+  };
+  for(const tinygltf::Skin& skin : model.skins)
+  {
+    markUsed(skin.inverseBindMatrices);
+  }
+  for(const tinygltf::Animation& animation : model.animations)
+  {
+    for(const tinygltf::AnimationSampler& sampler : animation.samplers)
+    {
+      markUsed(sampler.input);
+      markUsed(sampler.output);
+    }
+  }
+
+  // A view is dropped when only replaced accessors use it. Views used by no accessor at all may be
+  // read by images or extensions, and are kept.
+  enum ViewUse : uint8_t
+  {
+    eUnknown,
+    eReplaced,
+    eUsed
+  };
+  std::vector<ViewUse> views(model.bufferViews.size(), eUnknown);
+  auto useView = [&](int view, bool replaced) {
+    if(view >= 0 && view < static_cast<int>(views.size()))
+    {
+      views[view] = replaced ? std::max(views[view], eReplaced) : eUsed;
+    }
+  };
+  for(size_t a = 0; a < model.accessors.size(); ++a)
+  {
+    const tinygltf::Accessor& accessor = model.accessors[a];
+    const bool replaced = a < geometryAccessors.size() && geometryAccessors[a] && !used[a];
+    useView(accessor.bufferView, replaced);
+    useView(accessor.sparse.indices.bufferView, replaced);
+    useView(accessor.sparse.values.bufferView, replaced);
+  }
+  for(const tinygltf::Image& image : model.images)
+  {
+    useView(image.bufferView, false);
+  }
+
+  // Each buffer with dropped views is replaced by a copy of its other views
+  size_t released = 0;
+  for(size_t b = 0; b < model.buffers.size(); ++b)
+  {
+    std::vector<int> kept;
+    bool             dropped = false;
+    for(size_t v = 0; v < model.bufferViews.size(); ++v)
+    {
+      if(model.bufferViews[v].buffer == static_cast<int>(b))
+      {
+        dropped |= views[v] == eReplaced;
+        if(views[v] != eReplaced)
+        {
+          kept.push_back(static_cast<int>(v));
+        }
+      }
+    }
+    if(!dropped)
+    {
+      continue;
+    }
+
+    std::vector<unsigned char>& data = model.buffers[b].data;
+    std::vector<size_t>         offsets(kept.size());
+    size_t                      size = 0;
+    for(size_t k = 0; k < kept.size(); ++k)
+    {
+      offsets[k] = (size + 15) & ~size_t(15);  // as aligned as any accessor may need
+      size       = offsets[k] + model.bufferViews[kept[k]].byteLength;
+    }
+    if(size >= data.size())
+    {
+      continue;  // overlapping views
+    }
+
+    std::vector<unsigned char> compact(size);
+    for(size_t k = 0; k < kept.size(); ++k)
+    {
+      tinygltf::BufferView& view = model.bufferViews[kept[k]];
+      memcpy(compact.data() + offsets[k], data.data() + view.byteOffset, view.byteLength);
+      view.byteOffset = offsets[k];
+    }
+    for(size_t v = 0; v < model.bufferViews.size(); ++v)
+    {
+      if(model.bufferViews[v].buffer == static_cast<int>(b) && views[v] == eReplaced)
+      {
+        model.bufferViews[v].byteOffset = 0;
+        model.bufferViews[v].byteLength = 0;
+      }
+    }
+    released += data.size() - compact.size();
+    data.swap(compact);
+  }
+  return released;
+}
+
+void SceneLoader::releaseCpuData(tinygltf::Model& model)
+{
+  size_t released = 0;
+  for(tinygltf::Buffer& buffer : model.buffers)
+  {
+    released += buffer.data.size();
+    std::vector<unsigned char>().swap(buffer.data);
+  }
+  for(tinygltf::Image& image : model.images)
+  {
+    released += image.image.size();
+    std::vector<unsigned char>().swap(image.image);
+  }
+  LOGI("SceneLoader: released %.1f MB of geometry and images, uploaded\n", double(released) / (1 << 20));
+}
+
+void SceneLoader::decodeImages(tinygltf::Model&                           model,
+                               const std::string&                         basedir,
+                               ThreadPool&                                threads,
+                               bool                                       compress,
+                               std::vector<TextureStreamer::SourceImage>& sources)
+{
+  sources.clear();
+  sources.resize(model.images.size());
+
+  auto isDecodable = [](const tinygltf::Image& image) {
+    if(image.uri.empty() || image.uri.compare(0, 5, "data:") == 0)
+    {
+      return false;  // embedded, already decoded by tinygltf
+    }
+    std::string extension = std::filesystem::path(image.uri).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return char(tolower(c)); });
+    return extension == ".jpg" || extension == ".jpeg" || extension == ".png" || extension == ".bmp" || extension == ".tga";
+  };
+
+  std::vector<uint32_t> pending;
+  for(uint32_t i = 0; i < static_cast<uint32_t>(model.images.size()); ++i)
+  {
+    if(isDecodable(model.images[i]))
+    {
+      pending.push_back(i);
+    }
+  }
+  if(pending.empty())
+  {
+    return;
+  }
+
+  // How the materials sample each image, for the mip averaging and the error metric of the compression
+  std::vector<TextureCompressor::Usage> usages(model.images.size(), TextureCompressor::Usage::eData);
+  auto setUsage = [&](int texture, TextureCompressor::Usage usage) {
+    if(texture >= 0 && texture < static_cast<int>(model.textures.size()) && model.textures[texture].source >= 0
+       && model.textures[texture].source < static_cast<int>(usages.size()))
+    {
+      TextureCompressor::Usage& current = usages[model.textures[texture].source];
+      current = current == TextureCompressor::Usage::eColor ? current : usage;  // sRGB wins, as in TextureStreamer
+    }
+  };
+  for(const tinygltf::Material& material : model.materials)
+  {
+    setUsage(material.normalTexture.index, TextureCompressor::Usage::eNormal);
+    setUsage(material.pbrMetallicRoughness.baseColorTexture.index, TextureCompressor::Usage::eColor);
+    setUsage(material.emissiveTexture.index, TextureCompressor::Usage::eColor);
+  }
+
+  const auto            start = std::chrono::steady_clock::now();
+  std::atomic<uint32_t> decoded{0};
+  std::atomic<uint32_t> cached{0};
+
+  // On the background workers, with the loading thread. The frames are recorded on workers of their
+  // own (see ParallelRecorder), so they don't wait for these long tasks.
+  threads.parallelFor(
+      static_cast<uint32_t>(pending.size()),
+      [&](uint32_t p) {
+        tinygltf::Image& image = model.images[pending[p]];
+        std::string      uri;
+        tinygltf::URIDecode(image.uri, &uri, nullptr);
+        const std::string path = (std::filesystem::path(basedir) / uri).string();
+
+        // The file is decoded from the same mapping it is hashed from
+        const auto imageStart = std::chrono::steady_clock::now();
+        MappedFile file;
+        if(!file.open(path))
+        {
+          LOGW("SceneLoader: could not open %s\n", path.c_str());
+          return;
+        }
+        const TextureCompressor::Usage usage    = usages[pending[p]];
+        const uint64_t                 key      = compress ? TextureCompressor::computeKey(file.data(), file.size(), usage) : 0;
+        TextureStreamer::SourceImage&  source   = sources[pending[p]];
+        uint8_t                        placeholder[4];
+        const bool                     isCached = compress && TextureCompressor::readCache(key, source, placeholder);
+        if(!isCached)
+        {
+          int      width = 0, height = 0, channels = 0;
+          stbi_uc* pixels = stbi_load_from_memory(file.data(), static_cast<int>(file.size()), &width, &height, &channels,
+                                                  STBI_rgb_alpha);
+          if(pixels == nullptr)
+          {
+            LOGW("SceneLoader: could not decode %s\n", path.c_str());
+            return;
+          }
+          std::vector<uint8_t> data(pixels, pixels + size_t(width) * size_t(height) * 4);
+          stbi_image_free(pixels);
+          source = TextureStreamer::makeSourceImage(std::move(data), uint32_t(width), uint32_t(height),
+                                                    usage == TextureCompressor::Usage::eColor);
+          memcpy(placeholder, source.mips.back().data(), sizeof(placeholder));
+          if(compress)
+          {
+            source = TextureCompressor::compress(source, usage);
+            TextureCompressor::writeCache(key, source, placeholder);
+          }
+        }
+
+        image.width      = 1;
+        image.height     = 1;
+        image.component  = 4;
+        image.bits       = 8;
+        image.pixel_type = TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE;
+        image.image.assign(placeholder, placeholder + sizeof(placeholder));
+        image.uri.clear();
+        ++decoded;
+        cached += isCached ? 1 : 0;
+
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - imageStart).count();
+        LOGI("SceneLoader: %s %s (%ux%u) in %.1f ms\n", isCached ? "read the cached BC7 of" : compress ? "decoded and compressed" : "decoded",
+             uri.c_str(), source.width, source.height, ms);
+      });
+
+  const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  LOGI("SceneLoader: decoded %u/%zu images (%u from the texture cache) in %.1f ms\n", decoded.load(), pending.size(),
+       cached.load(), ms);
+}
+
+void SceneLoader::takeEmbeddedImages(tinygltf::Model& model, std::vector<TextureStreamer::SourceImage>& images)
+{
+  images.clear();
+  images.resize(model.images.size());
+
+  // Sampled as sRGB, as in TextureStreamer
+  std::set<int> srgbImages;
+  for(const tinygltf::Material& material : model.materials)
+  {
+    for(int texture : {material.pbrMetallicRoughness.baseColorTexture.index, material.emissiveTexture.index})
+    {
+      if(texture >= 0 && texture < static_cast<int>(model.textures.size()))
+      {
+        srgbImages.insert(model.textures[texture].source);
+      }
+    }
+  }
+
+  for(size_t i = 0; i < model.images.size(); ++i)
+  {
+    // The placeholders of decodeImages() and the 1x1 images have no chain to generate
+    tinygltf::Image& image = model.images[i];
+    if((image.width <= 1 && image.height <= 1) || image.component != 4 || image.bits != 8
+       || image.image.size() != size_t(image.width) * size_t(image.height) * 4)
+    {
+      continue;
+    }
+    TextureStreamer::SourceImage& source = images[i];
+    source.width                         = uint32_t(image.width);
+    source.height                        = uint32_t(image.height);
+    source.format = srgbImages.count(static_cast<int>(i)) ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+    source.mips.push_back(std::move(image.image));
+
+    // Never sampled: the TextureStreamer binds the generated texture instead
+    image.width  = 1;
+    image.height = 1;
+    image.image.assign(source.mips.front().begin(), source.mips.front().begin() + 4);
+  }
+}
+
+bool SceneLoader::deduplicateGeometry(tinygltf::Model& model, ThreadPool& threads)
+{
+  // The accessors holding the geometry of the primitives, the only ones merged
+  std::vector<int> accessors;
+  {
+    std::vector<bool> used(model.accessors.size(), false);
+    auto              addAccessor = [&](int accessor) {
+      if(accessor >= 0 && accessor < static_cast<int>(used.size()) && !used[accessor])
+      {
+        used[accessor] = true;
+        accessors.push_back(accessor);
+      }
+    };
+    for(const tinygltf::Mesh& mesh : model.meshes)
+    {
+      for(const tinygltf::Primitive& primitive : mesh.primitives)
+      {
+        addAccessor(primitive.indices);
+        for(const auto& attribute : primitive.attributes)
+        {
+          addAccessor(attribute.second);
+        }
+      }
+    }
+  }
+  std::sort(accessors.begin(), accessors.end());  // the first of the identical accessors is kept
+
+  const auto start = std::chrono::steady_clock::now();
+
+  std::vector<AccessorData> data(accessors.size());
+  std::vector<uint64_t>     hashes(accessors.size(), 0);
+  threads.parallelFor(
+      static_cast<uint32_t>(accessors.size()),
+      [&](uint32_t a) {
+        data[a] = getAccessorData(model, model.accessors[accessors[a]]);
+        if(data[a].data != nullptr)
+        {
+          hashes[a] = hashAccessor(data[a]);
+        }
+      });
+
+  // Accessors of the same type and content, checked byte by byte against hash collisions
+  std::unordered_map<int, int>                      remap;
+  std::unordered_map<uint64_t, std::vector<size_t>> candidates;
+  VkDeviceSize                                      savedBytes = 0;
+  for(size_t a = 0; a < accessors.size(); ++a)
+  {
+    if(data[a].data == nullptr)
+    {
+      continue;
+    }
+    const tinygltf::Accessor& accessor = model.accessors[accessors[a]];
+    std::vector<size_t>&      sameHash = candidates[hashes[a]];
+    auto                      original = std::find_if(sameHash.begin(), sameHash.end(), [&](size_t c) {
+      const tinygltf::Accessor& other = model.accessors[accessors[c]];
+      return other.componentType == accessor.componentType && other.type == accessor.type
+             && other.normalized == accessor.normalized && isSameData(data[c], data[a]);
+    });
+    if(original == sameHash.end())
+    {
+      sameHash.push_back(a);
+      continue;
+    }
+    remap[accessors[a]] = accessors[*original];
+    savedBytes += data[a].size();
+  }
+  if(remap.empty())
+  {
+    return false;
+  }
+
+  // Rewrite the primitives, and count those whose whole geometry was already found in another one
+  auto resolve = [&](int accessor) {
+    auto it = remap.find(accessor);
+    return it != remap.end() ? it->second : accessor;
+  };
+  std::set<std::vector<int>> geometries;
+  uint32_t                   primitives = 0;
+  uint32_t                   duplicates = 0;
+  for(tinygltf::Mesh& mesh : model.meshes)
+  {
+    for(tinygltf::Primitive& primitive : mesh.primitives)
+    {
+      std::vector<int> geometry{primitive.mode, resolve(primitive.indices)};
+      primitive.indices = geometry.back();
+      for(auto& attribute : primitive.attributes)  // sorted by name
+      {
+        attribute.second = resolve(attribute.second);
+        geometry.push_back(attribute.second);
+      }
+      duplicates += geometries.insert(std::move(geometry)).second ? 0 : 1;
+      ++primitives;
+    }
+  }
+
+  const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  LOGI("SceneLoader: %u of %u primitives duplicate the geometry of another, %zu accessors merged, %.1f MB saved (%.1f ms)\n",
+       duplicates, primitives, remap.size(), double(savedBytes) / (1 << 20), ms);
+  return true;
+}
+
+VkCommandBuffer SceneLoader::beginStep()
+{
+  NVVK_CHECK(vkResetCommandBuffer(m_cmd, 0));
+  VkCommandBufferBeginInfo beginInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  NVVK_CHECK(vkBeginCommandBuffer(m_cmd, &beginInfo));
+  if(m_hasTimestamps)
+  {
+    vkCmdResetQueryPool(m_cmd, m_queryPool, 0, 4);
+    vkCmdWriteTimestamp(m_cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_queryPool, 0);
+  }
+  return m_cmd;
+}
+
+void SceneLoader::submitStep(VkCommandBuffer cmd)
+{
+  if(m_hasTimestamps)
+  {
+    vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_queryPool, 1);
+  }
+  NVVK_CHECK(vkEndCommandBuffer(cmd));
+
+  // The staging buffers of this step are released once its fence is signaled, see completeStep()
+  m_alloc->finalizeStaging(m_fence);
+
+  NVVK_CHECK(vkResetFences(m_device, 1, &m_fence));
+  VkSubmitInfo submitInfo{VK_STRUCTURE_TYPE_SUBMIT_INFO};
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers    = &cmd;
+  NVVK_CHECK(vkQueueSubmit(m_queue, 1, &submitInfo, m_fence));
+  m_stepInFlight = true;
+}
+
+void SceneLoader::completeStep()
+{
+  m_stepInFlight = false;
+  m_alloc->releaseStaging();
+  m_mipGenerator->releaseViews();
+
+  if(m_mipTextures > 0)
+  {
+    uint64_t ticks[2] = {};
+    if(m_hasTimestamps
+       && vkGetQueryPoolResults(m_device, m_queryPool, 2, 2, sizeof(ticks), ticks, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS
+       && ticks[1] >= ticks[0])
+    {
+      LOGI("SceneLoader: generated the mip chains of %u embedded textures in %u dispatches, %.2f ms on the GPU\n",
+           m_mipTextures, m_mipDispatches, double(ticks[1] - ticks[0]) * m_timestampPeriod * 1e-6);
+    }
+    else
+    {
+      LOGI("SceneLoader: generated the mip chains of %u embedded textures in %u dispatches\n", m_mipTextures, m_mipDispatches);
+    }
+    m_mipTextures = 0;
+  }
+
+  // Size the next BLAS step so that it takes about the budget
+  if(m_stage == Stage::eBuildingBlas && m_hasTimestamps && m_stepTriangles > 0)
+  {
+    uint64_t ticks[2] = {};
+    if(vkGetQueryPoolResults(m_device, m_queryPool, 0, 2, sizeof(ticks), ticks, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS
+       && ticks[1] > ticks[0])
+    {
+      const double ms    = double(ticks[1] - ticks[0]) * m_timestampPeriod * 1e-6;
+      const double scale = std::clamp(m_stepBudgetMs / ms, 0.25, 2.0);
+      m_trianglesPerStep = std::max<uint64_t>(uint64_t(double(m_stepTriangles) * scale), 1024);
+    }
+  }
+}
+
+void SceneLoader::abandon()
+{
+  if(m_stepInFlight)
+  {
+    NVVK_CHECK(vkWaitForFences(m_device, 1, &m_fence, VK_TRUE, UINT64_MAX));
+    completeStep();
+  }
+  for(nvvk::Texture& texture : m_result.textures)
+  {
+    m_alloc->destroy(texture);
+  }
+  m_result = {};  // not used by any frame yet
+  m_cache.close();
+  m_stage = Stage::eIdle;
+}
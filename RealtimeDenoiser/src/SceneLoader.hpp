@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+
+#include <vulkan/vulkan_core.h>
+
+#include <nvh/gltfscene.hpp>
+#include <nvvk/resourceallocator_vk.hpp>
+#include <nvvkhl/gltf_scene_vk.hpp>
+
+#include "AccelCache.hpp"
+#include "MipGenerator.hpp"
+#include "SceneAccel.hpp"
+#include "TextureStreamer.hpp"
+#include "ThreadPool.hpp"
+#include "VertexQuantizer.hpp"
+
+/* Loads a glTF scene while the current one keeps rendering.
+ *
+ * The file is parsed from a memory mapping on a background thread, which then merges the
+ * duplicated geometry, optionally optimizes the meshes (see MeshOptimizer) and compresses their
+ * vertex attributes (see VertexQuantizer), and decodes the external JPG/PNG images on the workers
+ * of a ThreadPool, all in parallel. The GPU side is then created by a sequence of small
+ * submissions on the graphics queue, at most one in flight and none waited on: the upload of the
+ * scene buffers and textures, the BLAS builds in steps sized to a GPU time budget (measured with
+ * timestamps), and the TLAS.
+ * When the BLAS of the same file were built before on this device, they are deserialized from the
+ * AccelCache instead, and after a build they are written to it. The CPU copy of the buffers is
+ * freed once uploaded. The decoded images are handed over with their mip chains for the
+ * TextureStreamer, compressed to BC7 by the TextureCompressor when enabled, and SceneVk only
+ * uploads a 1x1 placeholder of them. The images embedded in the file, which tinygltf decodes,
+ * get placeholders too: their first level is uploaded along with the scene buffers, and the
+ * MipGenerator makes their mip chains on the GPU in the same submission.
+ * update() advances this sequence once per frame, and once it reports
+ * the scene as ready, take() hands the complete scene over at once.
+ */
+class SceneLoader
+{
+public:
+  enum class Stage
+  {
+    eIdle,
+    eParsing,
+    eUploading,
+    eBuildingBlas,
+    eBuildingTlas,
+    eCaching,
+    eReady,
+  };
+
+  struct Result
+  {
+    std::string                               filename;
+    std::unique_ptr<nvh::gltf::Scene>         scene;
+    std::unique_ptr<nvvkhl::SceneVk>          sceneVk;
+    std::unique_ptr<SceneAccel>               sceneAccel;
+    std::unique_ptr<VertexQuantizer>          vertexQuantizer;  // compressed attributes of the sceneVk primitives
+    std::vector<TextureStreamer::SourceImage> images;  // per model image, valid for those decoded by the loader
+    std::vector<nvvk::Texture>                textures;  // per model image, with a mip chain generated on the GPU
+  };
+
+  SceneLoader(VkDevice                 device,
+              VkPhysicalDevice         physicalDevice,
+              nvvk::ResourceAllocator* alloc,
+              VkQueue                  queue,
+              uint32_t                 queueFamilyIndex,
+              ThreadPool&              threads);
+  ~SceneLoader();  // waits for the submission in flight
+
+  /* Start loading 'filename'. A load in progress is abandoned. */
+  void load(const std::string& filename);
+
+  /* Advance the load without waiting: check the submission in flight, and submit the next step.
+   * Returns true once the scene is ready to be taken. To be called once per frame.
+   */
+  bool   update();
+  Result take();
+
+  Stage              getStage() const { return m_stage; }
+  bool               isBusy() const { return m_stage != Stage::eIdle; }
+  const std::string& getFilename() const { return m_filename; }
+  const SceneAccel*  getSceneAccel() const { return m_result.sceneAccel.get(); }  // of the scene being loaded
+  float              getProgress() const;  // in [0, 1]
+  static const char* getStageName(Stage stage);
+
+  /* GPU time targeted by each BLAS build step, in milliseconds */
+  void setStepBudget(float milliseconds) { m_stepBudgetMs = milliseconds; }
+  /* Scratch memory shared by the BLAS build steps, taking effect with the next load */
+  void setScratchBudget(VkDeviceSize bytes) { m_scratchBudget = bytes; }
+  /* Run the MeshOptimizer on the loaded meshes, taking effect with the next load */
+  void setOptimizeMeshes(bool optimize) { m_optimizeMeshes = optimize; }
+  /* Compress the vertex attributes with the VertexQuantizer, taking effect with the next load */
+  void setQuantizeVertices(bool quantize) { m_quantizeVertices = quantize; }
+  /* Compress the decoded textures to BC7 with the TextureCompressor, taking effect with the next load */
+  void setCompressTextures(bool compress) { m_compressTextures = compress; }
+  /* Generate the mip chains of the embedded images with the MipGenerator rather than nvvkhl::SceneVk's
+   * blits, taking effect with the next load
+   */
+  void setGenerateMips(bool generate) { m_generateMips = generate; }
+
+private:
+  VkCommandBuffer beginStep();
+  void            submitStep(VkCommandBuffer cmd);
+  void            completeStep();  // the fence of the step in flight is signaled
+  void            abandon();
+  bool            finish();  // the scene is complete
+
+  /* Load a .gltf or .glb into 'scene', parsing the file from a memory mapping and reading the
+   * external buffers from mappings too, so that the geometry is copied once to the heap instead of
+   * going through file reads. The copy stays: nvvkhl::SceneVk uploads from the buffers of the model.
+   * Other formats are loaded by nvh::gltf::Scene.
+   */
+  static bool loadScene(const std::string& filename, nvh::gltf::Scene& scene);
+
+  /* Drop from the buffers the views of the accessors flagged in 'geometryAccessors' that no primitive,
+   * skin or animation reads any more, after the MeshOptimizer or the VertexQuantizer replaced them.
+   * The buffers are compacted, and the number of bytes freed is returned.
+   */
+  static size_t releaseReplacedGeometry(tinygltf::Model& model, const std::vector<bool>& geometryAccessors);
+
+  /* Free the buffers and image pixels of the model, once they were uploaded: the geometry is then
+   * only in device memory, and the model keeps the description of the scene.
+   */
+  static void releaseCpuData(tinygltf::Model& model);
+
+  /* Decode the images referenced by file into 'sources', with their mip chain, and replace them
+   * in the model by their 1x1 level, as if they were embedded, so that nvvkhl::SceneVk only has
+   * placeholders to upload. Formats stb_image cannot decode are left to SceneVk.
+   * With 'compress', the chains are compressed to BC7, or read from the cache of the TextureCompressor.
+   */
+  static void decodeImages(tinygltf::Model&                           model,
+                           const std::string&                         basedir,
+                           ThreadPool&                                threads,
+                           bool                                       compress,
+                           std::vector<TextureStreamer::SourceImage>& sources);
+
+  /* Move the RGBA8 pixels of the images decoded by tinygltf into 'images', as their first level,
+   * in the format the materials sample them in, and replace them in the model by a 1x1
+   * placeholder. Their mip chain is then generated on the GPU.
+   */
+  static void takeEmbeddedImages(tinygltf::Model& model, std::vector<TextureStreamer::SourceImage>& images);
+
+  /* Point the primitives to a single accessor for each set of byte-identical vertex attribute or
+   * index accessors. nvh::gltf::Scene then makes one render primitive of the primitives with the
+   * same accessors, so that their geometry is uploaded once and shares one BLAS, referenced by
+   * the TLAS instances of all of them. Returns true if any primitive was changed.
+   */
+  static bool deduplicateGeometry(tinygltf::Model& model, ThreadPool& threads);
+
+  VkDevice                 m_device         = VK_NULL_HANDLE;
+  VkPhysicalDevice         m_physicalDevice = VK_NULL_HANDLE;
+  nvvk::ResourceAllocator* m_alloc          = nullptr;
+  VkQueue                  m_queue          = VK_NULL_HANDLE;
+  ThreadPool&              m_threads;
+
+  VkCommandPool   m_cmdPool   = VK_NULL_HANDLE;
+  VkCommandBuffer m_cmd       = VK_NULL_HANDLE;
+  VkFence         m_fence     = VK_NULL_HANDLE;
+  VkQueryPool     m_queryPool = VK_NULL_HANDLE;  // start and end timestamps of the step, then of its mip generation
+  bool            m_hasTimestamps{false};
+  float           m_timestampPeriod{1.F};  // nanoseconds per tick
+  bool            m_stepInFlight{false};
+
+  Stage                                          m_stage{Stage::eIdle};
+  std::string                                    m_filename;
+  std::string m_nextFilename;  // requested while the current file was parsing
+  Result      m_result;
+
+  std::unique_ptr<MipGenerator> m_mipGenerator;
+  uint32_t                      m_mipTextures{0};    // generated by the step in flight
+  uint32_t                      m_mipDispatches{0};  //
+
+  // Result of the background thread
+  struct Parsed
+  {
+    std::unique_ptr<nvh::gltf::Scene>         scene;
+    std::vector<TextureStreamer::SourceImage> images;
+    std::vector<TextureStreamer::SourceImage> embedded;  // first level of the images of takeEmbeddedImages()
+    uint64_t                                  cacheKey{0};
+    AccelCache                                cache;  // opened if there is a cache file for the scene
+  };
+  std::future<Parsed> m_parsing;
+
+  uint8_t                               m_deviceUUID[VK_UUID_SIZE]{};
+  uint64_t                              m_cacheKey{0};
+  AccelCache                            m_cache;
+  bool                                  m_fromCache{false};
+  std::future<bool>                     m_cacheWrite;
+  std::chrono::steady_clock::time_point m_loadStart;
+
+  float        m_stepBudgetMs{2.F};
+  VkDeviceSize m_scratchBudget{256ull << 20};
+  bool         m_optimizeMeshes{true};
+  bool         m_quantizeVertices{true};
+  bool         m_compressTextures{true};
+  bool         m_generateMips{true};
+  bool         m_supportsBC7{false};  // sampled with linear filtering by the device
+  uint64_t     m_trianglesPerStep{1 << 20};  // adjusted to the budget from the measured duration of the steps
+  uint64_t     m_stepTriangles{0};           // triangles of the step in flight
+};
@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "StagingRing.hpp"
+
+#include <nvvk/debug_util_vk.hpp>
+#include <nvvk/error_vk.hpp>
+
+StagingRing::StagingRing(VkDevice device, nvvk::ResourceAllocator* alloc, VkDeviceSize capacity)
+    : m_device(device)
+    , m_alloc(alloc)
+    , m_capacity(capacity)
+{
+  m_buffer = m_alloc->createBuffer(m_capacity, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  m_data   = static_cast<uint8_t*>(m_alloc->map(m_buffer));
+
+  nvvk::DebugUtil dutil(m_device);
+  dutil.setObjectName(m_buffer.buffer, "StagingRing");
+}
+
+StagingRing::~StagingRing()
+{
+  wait(m_serial);
+  for(VkFence fence : m_freeFences)
+  {
+    vkDestroyFence(m_device, fence, nullptr);
+  }
+  m_alloc->unmap(m_buffer);
+  m_alloc->destroy(m_buffer);
+}
+
+StagingRing::Region StagingRing::allocate(VkDeviceSize size, VkDeviceSize alignment)
+{
+  if(size > m_capacity)
+  {
+    return {};
+  }
+  reclaim();
+
+  // Regions are contiguous: one that would cross the end of the buffer starts over at its beginning
+  VkDeviceSize offset   = (m_head + alignment - 1) / alignment * alignment;
+  VkDeviceSize position = offset % m_capacity;
+  if(position + size > m_capacity)
+  {
+    offset += m_capacity - position;
+    position = 0;
+  }
+  if(offset + size - m_tail > m_capacity)
+  {
+    return {};  // overlaps regions still in use
+  }
+
+  m_head = offset + size;
+  return {m_buffer.buffer, position, m_data + position};
+}
+
+uint64_t StagingRing::submit(VkQueue queue, VkCommandBuffer cmd)
+{
+  VkFence fence = VK_NULL_HANDLE;
+  if(m_freeFences.empty())
+  {
+    VkFenceCreateInfo fenceInfo{VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
+    NVVK_CHECK(vkCreateFence(m_device, &fenceInfo, nullptr, &fence));
+  }
+  else
+  {
+    fence = m_freeFences.back();
+    m_freeFences.pop_back();
+  }
+
+  VkSubmitInfo submitInfo{VK_STRUCTURE_TYPE_SUBMIT_INFO};
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers    = &cmd;
+  NVVK_CHECK(vkQueueSubmit(queue, 1, &submitInfo, fence));
+
+  m_inFlight.push_back({++m_serial, fence, m_head});
+  return m_serial;
+}
+
+bool StagingRing::isComplete(uint64_t serial)
+{
+  reclaim();
+  return serial <= m_completed;
+}
+
+void StagingRing::wait(uint64_t serial)
+{
+  while(!m_inFlight.empty() && m_inFlight.front().serial <= serial)
+  {
+    NVVK_CHECK(vkWaitForFences(m_device, 1, &m_inFlight.front().fence, VK_TRUE, UINT64_MAX));
+    reclaim();
+  }
+}
+
+void StagingRing::reclaim()
+{
+  // The submissions may go to different queues: they are only reclaimed in order
+  while(!m_inFlight.empty() && vkGetFenceStatus(m_device, m_inFlight.front().fence) == VK_SUCCESS)
+  {
+    const Submission& submission = m_inFlight.front();
+    NVVK_CHECK(vkResetFences(m_device, 1, &submission.fence));
+    m_freeFences.push_back(submission.fence);
+    m_tail      = submission.end;
+    m_completed = submission.serial;
+    m_inFlight.pop_front();
+  }
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <deque>
+#include <stdint.h>
+#include <vector>
+
+#include <vulkan/vulkan_core.h>
+
+#include <nvvk/resourceallocator_vk.hpp>
+
+/* Persistent staging buffer for the uploads done while rendering, used as a ring.
+ *
+ * allocate() returns a region of the mapped buffer to write the data to, and the commands copying
+ * from it are submitted through submit(): the regions allocated since the previous submission are
+ * tracked by the fence of that submission, and given back to the ring once it is signaled. Nothing
+ * is created per upload, and no submission is waited on: when the ring is full, allocate() fails
+ * and the caller tries again later, once earlier uploads completed.
+ *
+ * All calls are made from the same thread.
+ */
+class StagingRing
+{
+public:
+  struct Region
+  {
+    VkBuffer     buffer{VK_NULL_HANDLE};
+    VkDeviceSize offset{0};
+    uint8_t*     data{nullptr};  // mapped, host coherent
+
+    bool isValid() const { return data != nullptr; }
+  };
+
+  StagingRing(VkDevice device, nvvk::ResourceAllocator* alloc, VkDeviceSize capacity);
+  ~StagingRing();  // waits for the submissions in flight
+
+  /* A region of 'size' bytes, or an invalid region if the ring has no room left before earlier
+   * submissions complete. Sizes beyond getCapacity() can never be allocated.
+   */
+  Region allocate(VkDeviceSize size, VkDeviceSize alignment = 16);
+
+  /* Submit 'cmd', which reads the regions allocated since the previous submission, to 'queue'.
+   * Returns the serial of the submission, for isComplete() and wait().
+   */
+  uint64_t submit(VkQueue queue, VkCommandBuffer cmd);
+  bool     isComplete(uint64_t serial);
+  void     wait(uint64_t serial);
+
+  VkDeviceSize getCapacity() const { return m_capacity; }
+  VkDeviceSize getUsed() const { return m_head - m_tail; }
+
+private:
+  void reclaim();  // give the regions of the completed submissions back
+
+  struct Submission
+  {
+    uint64_t     serial;
+    VkFence      fence;
+    VkDeviceSize end;  // m_head when it was submitted
+  };
+
+  VkDevice                 m_device = VK_NULL_HANDLE;
+  nvvk::ResourceAllocator* m_alloc  = nullptr;
+  nvvk::Buffer             m_buffer;
+  uint8_t*                 m_data{nullptr};
+  VkDeviceSize             m_capacity{0};
+
+  // Offsets counted from the creation of the ring, the position in the buffer is modulo m_capacity
+  VkDeviceSize m_head{0};  // end of the last allocation
+  VkDeviceSize m_tail{0};  // start of the oldest region in use
+
+  std::deque<Submission> m_inFlight;
+  std::vector<VkFence>   m_freeFences;
+  uint64_t               m_serial{0};     // of the last submission
+  uint64_t               m_completed{0};  // all submissions up to this one completed
+};
@@ -0,0 +1,455 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "TextureCompressor.hpp"
+
+#include <nvh/nvprint.hpp>
+
+#include "AccelCache.hpp"
+#include "MappedFile.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace {
+
+/* Cache file: CacheHeader, then the levels from the finest down */
+constexpr uint32_t kCacheMagic   = 0x37434256;  // "VBC7"
+constexpr uint32_t kCacheVersion = 1;
+
+struct CacheHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t key;
+  uint32_t width;
+  uint32_t height;
+  uint32_t levels;
+  uint8_t  placeholder[4];
+};
+
+// Interpolation weights of the 4-bit indices, in 1/64
+constexpr int kWeights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+// Error weights per channel, by usage
+constexpr float kColorWeights[4] = {0.299F, 0.587F, 0.114F, 0.5F};
+constexpr float kPlainWeights[4] = {1.F, 1.F, 1.F, 0.F};
+
+// Endpoint of mode 6: 7 bits per channel, and a p-bit as their lowest bit
+struct Endpoint
+{
+  uint8_t q[4]{};
+  uint8_t p{0};
+
+  int value(int c) const { return (q[c] << 1) | p; }
+};
+
+// Opaque endpoints need the p-bit for an alpha of 255
+Endpoint quantizeEndpoint(const float color[4], const float weights[4], bool opaque)
+{
+  Endpoint best;
+  float    bestError = FLT_MAX;
+  for(uint8_t p = opaque ? 1 : 0; p < 2; ++p)
+  {
+    Endpoint endpoint;
+    endpoint.p  = p;
+    float error = 0.F;
+    for(int c = 0; c < 4; ++c)
+    {
+      endpoint.q[c]    = static_cast<uint8_t>(std::clamp(static_cast<int>(std::lround((color[c] - p) * 0.5F)), 0, 127));
+      const float diff = float(endpoint.value(c)) - color[c];
+      error += weights[c] * diff * diff;
+    }
+    if(error < bestError)
+    {
+      bestError = error;
+      best      = endpoint;
+    }
+  }
+  return best;
+}
+
+// Best index of each pixel between the endpoints, returns the weighted error of the block
+float assignIndices(const float pixels[16][4], const Endpoint& e0, const Endpoint& e1, const float weights[4], uint8_t indices[16])
+{
+  float palette[16][4];
+  for(int i = 0; i < 16; ++i)
+  {
+    for(int c = 0; c < 4; ++c)
+    {
+      palette[i][c] = float(((64 - kWeights[i]) * e0.value(c) + kWeights[i] * e1.value(c) + 32) >> 6);
+    }
+  }
+
+  float total = 0.F;
+  for(int p = 0; p < 16; ++p)
+  {
+    float best = FLT_MAX;
+    for(int i = 0; i < 16; ++i)
+    {
+      float error = 0.F;
+      for(int c = 0; c < 4; ++c)
+      {
+        const float diff = palette[i][c] - pixels[p][c];
+        error += weights[c] * diff * diff;
+      }
+      if(error < best)
+      {
+        best       = error;
+        indices[p] = static_cast<uint8_t>(i);
+      }
+    }
+    total += best;
+  }
+  return total;
+}
+
+// Endpoints minimizing the squared error for the given indices, false if they are all the same
+bool fitEndpoints(const float pixels[16][4], const uint8_t indices[16], float e0[4], float e1[4])
+{
+  float a = 0.F, b = 0.F, c = 0.F;
+  float x0[4]{}, x1[4]{};
+  for(int p = 0; p < 16; ++p)
+  {
+    const float t = kWeights[indices[p]] / 64.F;
+    a += (1.F - t) * (1.F - t);
+    b += (1.F - t) * t;
+    c += t * t;
+    for(int k = 0; k < 4; ++k)
+    {
+      x0[k] += (1.F - t) * pixels[p][k];
+      x1[k] += t * pixels[p][k];
+    }
+  }
+  const float det = a * c - b * b;
+  if(std::abs(det) < 1e-6F)
+  {
+    return false;
+  }
+  for(int k = 0; k < 4; ++k)
+  {
+    e0[k] = std::clamp((c * x0[k] - b * x1[k]) / det, 0.F, 255.F);
+    e1[k] = std::clamp((a * x1[k] - b * x0[k]) / det, 0.F, 255.F);
+  }
+  return true;
+}
+
+void encodeBlock(const float pixels[16][4], const float weights[4], bool opaque, uint8_t out[16])
+{
+  // Principal axis of the pixels, in the space scaled by the error weights
+  float scale[4], mean[4]{};
+  for(int c = 0; c < 4; ++c)
+  {
+    scale[c] = std::sqrt(weights[c]);
+  }
+  for(int p = 0; p < 16; ++p)
+  {
+    for(int c = 0; c < 4; ++c)
+    {
+      mean[c] += pixels[p][c] * scale[c] / 16.F;
+    }
+  }
+  float covariance[4][4]{};
+  float lo[4] = {FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX}, hi[4] = {-FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX};
+  for(int p = 0; p < 16; ++p)
+  {
+    float d[4];
+    for(int c = 0; c < 4; ++c)
+    {
+      d[c]  = pixels[p][c] * scale[c] - mean[c];
+      lo[c] = std::min(lo[c], d[c]);
+      hi[c] = std::max(hi[c], d[c]);
+    }
+    for(int i = 0; i < 4; ++i)
+    {
+      for(int j = 0; j < 4; ++j)
+      {
+        covariance[i][j] += d[i] * d[j];
+      }
+    }
+  }
+  float axis[4];
+  for(int c = 0; c < 4; ++c)
+  {
+    axis[c] = hi[c] - lo[c];
+  }
+  for(int iteration = 0; iteration < 8; ++iteration)
+  {
+    float next[4]{}, length = 0.F;
+    for(int i = 0; i < 4; ++i)
+    {
+      for(int j = 0; j < 4; ++j)
+      {
+        next[i] += covariance[i][j] * axis[j];
+      }
+      length += next[i] * next[i];
+    }
+    if(length < 1e-12F)
+    {
+      break;  // flat block, or the axis is already converged to zero variance
+    }
+    length = 1.F / std::sqrt(length);
+    for(int c = 0; c < 4; ++c)
+    {
+      axis[c] = next[c] * length;
+    }
+  }
+
+  // Extent of the pixels along the axis
+  float tMin = 0.F, tMax = 0.F;
+  for(int p = 0; p < 16; ++p)
+  {
+    float t = 0.F;
+    for(int c = 0; c < 4; ++c)
+    {
+      t += (pixels[p][c] * scale[c] - mean[c]) * axis[c];
+    }
+    tMin = std::min(tMin, t);
+    tMax = std::max(tMax, t);
+  }
+  float e0[4], e1[4];
+  for(int c = 0; c < 4; ++c)
+  {
+    if(scale[c] > 0.F)
+    {
+      e0[c] = std::clamp((mean[c] + axis[c] * tMin) / scale[c], 0.F, 255.F);
+      e1[c] = std::clamp((mean[c] + axis[c] * tMax) / scale[c], 0.F, 255.F);
+    }
+    else
+    {
+      e0[c] = e1[c] = 255.F;  // alpha not encoded: opaque
+    }
+  }
+  if(opaque)
+  {
+    e0[3] = e1[3] = 255.F;
+  }
+
+  Endpoint q0 = quantizeEndpoint(e0, weights, opaque);
+  Endpoint q1 = quantizeEndpoint(e1, weights, opaque);
+  uint8_t  indices[16];
+  float    error = assignIndices(pixels, q0, q1, weights, indices);
+
+  // Least squares refinement, kept while it lowers the error
+  for(int iteration = 0; iteration < 2 && error > 0.F; ++iteration)
+  {
+    float f0[4], f1[4];
+    if(!fitEndpoints(pixels, indices, f0, f1))
+    {
+      break;
+    }
+    if(opaque)
+    {
+      f0[3] = f1[3] = 255.F;
+    }
+    const Endpoint r0 = quantizeEndpoint(f0, weights, opaque);
+    const Endpoint r1 = quantizeEndpoint(f1, weights, opaque);
+    uint8_t        refined[16];
+    const float    refinedError = assignIndices(pixels, r0, r1, weights, refined);
+    if(refinedError >= error)
+    {
+      break;
+    }
+    q0    = r0;
+    q1    = r1;
+    error = refinedError;
+    memcpy(indices, refined, sizeof(indices));
+  }
+
+  // The first index is stored with 3 bits: its highest bit must be 0
+  if(indices[0] & 8)
+  {
+    std::swap(q0, q1);
+    for(uint8_t& index : indices)
+    {
+      index = 15 - index;
+    }
+  }
+
+  uint64_t bits[2]  = {0, 0};
+  int      position = 0;
+  auto     put      = [&](uint32_t value, int count) {
+    for(int b = 0; b < count; ++b, ++position)
+    {
+      bits[position / 64] |= uint64_t((value >> b) & 1u) << (position % 64);
+    }
+  };
+  put(1u << 6, 7);  // mode 6
+  for(int c = 0; c < 4; ++c)
+  {
+    put(q0.q[c], 7);
+    put(q1.q[c], 7);
+  }
+  put(q0.p, 1);
+  put(q1.p, 1);
+  put(indices[0], 3);
+  for(int p = 1; p < 16; ++p)
+  {
+    put(indices[p], 4);
+  }
+  memcpy(out, bits, 16);
+}
+
+}  // namespace
+
+TextureStreamer::SourceImage TextureCompressor::compress(const TextureStreamer::SourceImage& image, Usage usage)
+{
+  const float* weights = usage == Usage::eColor ? kColorWeights : kPlainWeights;
+
+  // Alpha is only encoded where a color texture is not opaque
+  bool opaque = usage != Usage::eColor;
+  if(!opaque)
+  {
+    opaque                          = true;
+    const std::vector<uint8_t>& top = image.mips.front();
+    for(size_t i = 3; i < top.size() && opaque; i += 4)
+    {
+      opaque = top[i] == 255;
+    }
+  }
+
+  TextureStreamer::SourceImage compressed;
+  compressed.width  = image.width;
+  compressed.height = image.height;
+  compressed.format = VK_FORMAT_BC7_UNORM_BLOCK;
+  compressed.mips.resize(image.mips.size());
+  for(size_t l = 0; l < image.mips.size(); ++l)
+  {
+    const uint32_t              width  = std::max(image.width >> l, 1u);
+    const uint32_t              height = std::max(image.height >> l, 1u);
+    const std::vector<uint8_t>& src    = image.mips[l];
+    std::vector<uint8_t>&       dst    = compressed.mips[l];
+    dst.resize(getLevelSize(width, height));
+
+    uint8_t* block = dst.data();
+    for(uint32_t by = 0; by < height; by += 4)
+    {
+      for(uint32_t bx = 0; bx < width; bx += 4, block += 16)
+      {
+        // Blocks crossing the border repeat the last row and column
+        float pixels[16][4];
+        for(uint32_t p = 0; p < 16; ++p)
+        {
+          const uint32_t x = std::min(bx + p % 4, width - 1);
+          const uint32_t y = std::min(by + p / 4, height - 1);
+          for(uint32_t c = 0; c < 4; ++c)
+          {
+            pixels[p][c] = src[(size_t(y) * width + x) * 4 + c];
+          }
+        }
+        encodeBlock(pixels, weights, opaque, block);
+      }
+    }
+  }
+  return compressed;
+}
+
+uint64_t TextureCompressor::computeKey(const uint8_t* data, size_t size, Usage usage)
+{
+  const uint64_t options[] = {kCacheVersion, static_cast<uint64_t>(usage), size};
+  uint64_t       hash      = 0xCBF29CE484222325ull;
+  hash = AccelCache::hashData(reinterpret_cast<const uint8_t*>(options), sizeof(options), hash);
+  return AccelCache::hashData(data, size, hash);
+}
+
+bool TextureCompressor::readCache(uint64_t key, TextureStreamer::SourceImage& image, uint8_t placeholder[4])
+{
+  MappedFile file;
+  if(!file.open(AccelCache::getPath(key, "bc7")) || file.size() < sizeof(CacheHeader))
+  {
+    return false;
+  }
+
+  CacheHeader header{};
+  memcpy(&header, file.data(), sizeof(header));
+  if(header.magic != kCacheMagic || header.version != kCacheVersion || header.key != key || header.width == 0
+     || header.height == 0 || header.levels == 0 || header.levels > 32)
+  {
+    LOGW("TextureCompressor: ignoring %s, made for another file or version\n", AccelCache::getPath(key, "bc7").c_str());
+    return false;
+  }
+  size_t total = sizeof(CacheHeader);
+  for(uint32_t l = 0; l < header.levels; ++l)
+  {
+    total += getLevelSize(std::max(header.width >> l, 1u), std::max(header.height >> l, 1u));
+  }
+  if(file.size() != total)
+  {
+    LOGW("TextureCompressor: ignoring %s, truncated\n", AccelCache::getPath(key, "bc7").c_str());
+    return false;
+  }
+
+  image        = {};
+  image.width  = header.width;
+  image.height = header.height;
+  image.format = VK_FORMAT_BC7_UNORM_BLOCK;
+  image.mips.resize(header.levels);
+  const uint8_t* data = file.data() + sizeof(CacheHeader);
+  for(uint32_t l = 0; l < header.levels; ++l)
+  {
+    const size_t size = getLevelSize(std::max(header.width >> l, 1u), std::max(header.height >> l, 1u));
+    image.mips[l].assign(data, data + size);
+    data += size;
+  }
+  memcpy(placeholder, header.placeholder, sizeof(header.placeholder));
+  return true;
+}
+
+void TextureCompressor::writeCache(uint64_t key, const TextureStreamer::SourceImage& image, const uint8_t placeholder[4])
+{
+  namespace fs           = std::filesystem;
+  const std::string path = AccelCache::getPath(key, "bc7");
+  std::error_code   ec;
+  fs::create_directories(fs::path(path).parent_path(), ec);
+
+  CacheHeader header{};
+  header.magic   = kCacheMagic;
+  header.version = kCacheVersion;
+  header.key     = key;
+  header.width   = image.width;
+  header.height  = image.height;
+  header.levels  = static_cast<uint32_t>(image.mips.size());
+  memcpy(header.placeholder, placeholder, sizeof(header.placeholder));
+
+  // Written next to the final file and renamed, so that a reader never maps a partial file
+  const std::string tmpPath = path + ".tmp";
+  {
+    std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for(const std::vector<uint8_t>& level : image.mips)
+    {
+      out.write(reinterpret_cast<const char*>(level.data()), level.size());
+    }
+    if(!out)
+    {
+      LOGW("TextureCompressor: could not write %s\n", path.c_str());
+      fs::remove(tmpPath, ec);
+      return;
+    }
+  }
+  fs::rename(tmpPath, path, ec);
+  if(ec)
+  {
+    fs::remove(tmpPath, ec);
+  }
+}
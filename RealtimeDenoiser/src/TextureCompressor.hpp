@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vulkan/vulkan_core.h>
+
+#include "TextureStreamer.hpp"
+
+/* BC7 compression of the decoded scene textures, on the CPU, cached on disk.
+ *
+ * The blocks are encoded with mode 6 of BC7 (one subset, RGBA endpoints of 7 bits and a p-bit,
+ * 4-bit indices): endpoints along the principal axis of the block, refined by least squares.
+ * The error metric depends on how the material uses the texture: perceptual weights and alpha for
+ * the colors, and equal weights without alpha for the normal maps and the packed data
+ * (occlusion, roughness, metallic), whose alpha is not read.
+ * The compressed chain is cached under the hash of the image file and the usage, along with the
+ * 1x1 RGBA8 placeholder SceneVk uploads, so that later loads skip both decoding and compression.
+ */
+class TextureCompressor
+{
+public:
+  enum class Usage : uint32_t
+  {
+    eColor,   // base color and emissive, sampled as sRGB
+    eNormal,  // tangent space normals
+    eData,    // occlusion, roughness and metallic
+  };
+
+  /* The BC7 version of the RGBA8 mip chain of 'image' */
+  static TextureStreamer::SourceImage compress(const TextureStreamer::SourceImage& image, Usage usage);
+
+  /* Key of the compressed chain of the image file 'data' */
+  static uint64_t computeKey(const uint8_t* data, size_t size, Usage usage);
+
+  /* The compressed chain and the RGBA8 placeholder cached under 'key', if any */
+  static bool readCache(uint64_t key, TextureStreamer::SourceImage& image, uint8_t placeholder[4]);
+  static void writeCache(uint64_t key, const TextureStreamer::SourceImage& image, const uint8_t placeholder[4]);
+
+  /* Bytes of a BC7 level */
+  static size_t getLevelSize(uint32_t width, uint32_t height) { return size_t((width + 3) / 4) * ((height + 3) / 4) * 16; }
+};
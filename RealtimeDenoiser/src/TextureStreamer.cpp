@@ -0,0 +1,638 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "TextureStreamer.hpp"
+
+#include <nvh/nvprint.hpp>
+#include <nvvk/debug_util_vk.hpp>
+#include <nvvk/error_vk.hpp>
+#include <nvvk/images_vk.hpp>
+
+#include "shaders/host_device.h"
+#include "tiny_gltf.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <set>
+#include <utility>
+
+namespace {
+
+// Levels up to this size are uploaded before any feedback, and are always resident
+constexpr uint32_t kCoarseSize = 64;
+// Updates without a request for the wanted level before dropping one level
+constexpr uint32_t kRelaxUpdates = 120;
+// Staging memory of one upload submission, at least one image is uploaded anyway
+constexpr VkDeviceSize kMaxUploadSize = 64ull << 20;
+// Alignment of the levels in the staging memory, a multiple of the texel size
+constexpr VkDeviceSize kLevelAlignment = 16;
+
+VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+  return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// sRGB transfer functions, as toLinear() and toSrgb() of nvvkhl/shaders/dh_tonemap.h
+float srgbToLinear(float value)
+{
+  return value <= 0.04045F ? value / 12.92F : std::pow((value + 0.055F) / 1.055F, 2.4F);
+}
+
+uint8_t linearToSrgb8(float value)
+{
+  const float srgb = value <= 0.0031308F ? value * 12.92F : 1.055F * std::pow(value, 1.F / 2.4F) - 0.055F;
+  return uint8_t(std::clamp(srgb, 0.F, 1.F) * 255.F + 0.5F);
+}
+
+}  // namespace
+
+TextureStreamer::SourceImage TextureStreamer::makeSourceImage(std::vector<uint8_t>&& pixels, uint32_t width, uint32_t height, bool srgb)
+{
+  // Linear value of each 8-bit sRGB code
+  static const std::array<float, 256> kSrgbToLinear = [] {
+    std::array<float, 256> table{};
+    for(uint32_t i = 0; i < 256; ++i)
+    {
+      table[i] = srgbToLinear(float(i) / 255.F);
+    }
+    return table;
+  }();
+
+  SourceImage image;
+  image.width  = width;
+  image.height = height;
+  image.mips.push_back(std::move(pixels));
+
+  uint32_t w = width;
+  uint32_t h = height;
+  while(w > 1 || h > 1)
+  {
+    const uint32_t        nw  = std::max(w / 2, 1u);
+    const uint32_t        nh  = std::max(h / 2, 1u);
+    const uint8_t*        src = image.mips.back().data();
+    std::vector<uint8_t>  dst(size_t(nw) * nh * 4);
+    for(uint32_t y = 0; y < nh; ++y)
+    {
+      // Odd sizes: the last row and column are reused
+      const uint32_t y0 = std::min(y * 2, h - 1);
+      const uint32_t y1 = std::min(y * 2 + 1, h - 1);
+      for(uint32_t x = 0; x < nw; ++x)
+      {
+        const uint32_t x0 = std::min(x * 2, w - 1);
+        const uint32_t x1 = std::min(x * 2 + 1, w - 1);
+        const uint8_t* t00 = &src[(size_t(y0) * w + x0) * 4];
+        const uint8_t* t01 = &src[(size_t(y0) * w + x1) * 4];
+        const uint8_t* t10 = &src[(size_t(y1) * w + x0) * 4];
+        const uint8_t* t11 = &src[(size_t(y1) * w + x1) * 4];
+        for(uint32_t c = 0; c < 4; ++c)
+        {
+          // The color of sRGB images is averaged in linear space, alpha is linear
+          if(srgb && c < 3)
+          {
+            const float sum = kSrgbToLinear[t00[c]] + kSrgbToLinear[t01[c]] + kSrgbToLinear[t10[c]] + kSrgbToLinear[t11[c]];
+            dst[(size_t(y) * nw + x) * 4 + c] = linearToSrgb8(sum * 0.25F);
+          }
+          else
+          {
+            const uint32_t sum = t00[c] + t01[c] + t10[c] + t11[c];
+            dst[(size_t(y) * nw + x) * 4 + c] = uint8_t((sum + 2) / 4);
+          }
+        }
+      }
+    }
+    image.mips.push_back(std::move(dst));
+    w = nw;
+    h = nh;
+  }
+  return image;
+}
+
+TextureStreamer::TextureStreamer(VkDevice                 device,
+                                 nvvk::ResourceAllocator* alloc,
+                                 StagingRing&             stagingRing,
+                                 VkQueue                  uploadQueue,
+                                 uint32_t                 uploadFamilyIndex,
+                                 uint32_t                 graphicsFamilyIndex,
+                                 DeletionQueue&           deletionQueue,
+                                 uint32_t                 frameCycleSize)
+    : m_device(device)
+    , m_alloc(alloc)
+    , m_ring(stagingRing)
+    , m_queue(uploadQueue)
+    , m_deletionQueue(deletionQueue)
+{
+  // Images written by the upload queue and sampled by the graphics queue
+  m_queueFamilies.push_back(graphicsFamilyIndex);
+  if(uploadFamilyIndex != graphicsFamilyIndex)
+  {
+    m_queueFamilies.push_back(uploadFamilyIndex);
+  }
+
+  VkCommandPoolCreateInfo poolInfo{VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
+  poolInfo.flags            = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  poolInfo.queueFamilyIndex = uploadFamilyIndex;
+  NVVK_CHECK(vkCreateCommandPool(m_device, &poolInfo, nullptr, &m_cmdPool));
+
+  VkCommandBufferAllocateInfo allocInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+  allocInfo.commandPool        = m_cmdPool;
+  allocInfo.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  allocInfo.commandBufferCount = 1;
+  NVVK_CHECK(vkAllocateCommandBuffers(m_device, &allocInfo, &m_cmd));
+
+  m_readback.resize(frameCycleSize);
+  m_readbackData.resize(frameCycleSize, nullptr);
+}
+
+TextureStreamer::~TextureStreamer()
+{
+  if(m_uploadInFlight)
+  {
+    m_ring.wait(m_uploadSerial);
+  }
+  for(PendingImage& pending : m_pending)
+  {
+    m_alloc->destroy(pending.texture);
+  }
+  for(StreamedImage& image : m_images)
+  {
+    m_alloc->destroy(image.texture);
+  }
+  for(nvvk::Buffer& readback : m_readback)
+  {
+    if(readback.buffer != VK_NULL_HANDLE)
+    {
+      m_alloc->unmap(readback);
+    }
+    m_alloc->destroy(readback);
+  }
+  m_alloc->destroy(m_feedback);
+  m_alloc->destroy(m_oversized);
+  vkDestroyCommandPool(m_device, m_cmdPool, nullptr);
+}
+
+void TextureStreamer::setup(const tinygltf::Model&       model,
+                            const nvvkhl::SceneVk&       sceneVk,
+                            std::vector<SourceImage>&&   images,
+                            std::vector<nvvk::Texture>&& generatedTextures)
+{
+  const auto& sceneTextures = sceneVk.textures();
+
+  // The textures the shaders report (see requestMaterialTextures()), and those sampled as sRGB
+  std::set<int> fedBack;
+  std::set<int> srgbImages;
+  auto          sourceOf = [&](int texture) {
+    return texture >= 0 && texture < static_cast<int>(model.textures.size()) ? model.textures[texture].source : -1;
+  };
+  for(const tinygltf::Material& material : model.materials)
+  {
+    fedBack.insert(material.pbrMetallicRoughness.baseColorTexture.index);
+    fedBack.insert(material.pbrMetallicRoughness.metallicRoughnessTexture.index);
+    fedBack.insert(material.normalTexture.index);
+    fedBack.insert(material.emissiveTexture.index);
+    srgbImages.insert(sourceOf(material.pbrMetallicRoughness.baseColorTexture.index));
+    srgbImages.insert(sourceOf(material.emissiveTexture.index));
+  }
+
+  // Both lists are per source image, as model.images
+  m_images.resize(model.images.size());
+  for(size_t i = 0; i < m_images.size(); ++i)
+  {
+    StreamedImage& image = m_images[i];
+    if(i < generatedTextures.size())
+    {
+      image.texture = generatedTextures[i];
+    }
+    if(i >= images.size())
+    {
+      continue;
+    }
+    image.source = std::move(images[i]);
+    if(!image.source.isValid())
+    {
+      continue;
+    }
+    const uint32_t levels = static_cast<uint32_t>(image.source.mips.size());
+    image.chainSizes.resize(levels + 1, 0);
+    for(uint32_t l = levels; l-- > 0;)
+    {
+      image.chainSizes[l] = image.chainSizes[l + 1] + image.source.mips[l].size();
+    }
+    image.format = image.source.format;
+    if(srgbImages.count(static_cast<int>(i)))
+    {
+      image.format = image.format == VK_FORMAT_BC7_UNORM_BLOCK ? VK_FORMAT_BC7_SRGB_BLOCK : VK_FORMAT_R8G8B8A8_SRGB;
+    }
+    while(image.coarseMip + 1 < levels
+          && std::max(image.source.width >> image.coarseMip, image.source.height >> image.coarseMip) > kCoarseSize)
+    {
+      ++image.coarseMip;
+    }
+    image.wantedMip = image.targetMip = image.coarseMip;
+  }
+
+  // Textures without feedback keep their image at full resolution
+  m_textureImages.assign(sceneTextures.size(), -1);
+  m_descriptors.resize(sceneTextures.size());
+  m_samplers.resize(sceneTextures.size());
+  for(size_t t = 0; t < sceneTextures.size(); ++t)
+  {
+    m_descriptors[t] = sceneTextures[t].descriptor;
+    m_samplers[t]    = sceneTextures[t].descriptor.sampler;
+
+    const int source = sourceOf(static_cast<int>(t));
+    if(source >= 0 && source < static_cast<int>(m_images.size()) && m_images[source].source.isValid())
+    {
+      m_textureImages[t] = source;
+      if(!fedBack.count(static_cast<int>(t)))
+      {
+        m_images[source].pinned    = true;
+        m_images[source].wantedMip = m_images[source].targetMip = 0;
+      }
+    }
+    else if(source >= 0 && source < static_cast<int>(m_images.size()) && m_images[source].texture.image != VK_NULL_HANDLE)
+    {
+      m_descriptors[t].imageView   = m_images[source].texture.descriptor.imageView;
+      m_descriptors[t].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    }
+  }
+
+  // Feedback, read back by the frame cycle slots
+  const VkDeviceSize feedbackSize = std::max<size_t>(sceneTextures.size(), 1) * sizeof(int32_t);
+  m_feedback = m_alloc->createBuffer(feedbackSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT
+                                                       | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+  for(size_t s = 0; s < m_readback.size(); ++s)
+  {
+    m_readback[s] = m_alloc->createBuffer(feedbackSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    m_readbackData[s] = static_cast<int32_t*>(m_alloc->map(m_readback[s]));
+    std::fill_n(m_readbackData[s], feedbackSize / sizeof(int32_t), TEXTURE_FEEDBACK_NONE);
+  }
+  m_textureRequests.assign(sceneTextures.size(), TEXTURE_FEEDBACK_NONE);
+
+  nvvk::DebugUtil dutil(m_device);
+  dutil.setObjectName(m_feedback.buffer, "TextureFeedback");
+}
+
+void TextureStreamer::readFeedback(uint32_t frameCycleIndex)
+{
+  if(frameCycleIndex >= m_readbackData.size() || m_readbackData[frameCycleIndex] == nullptr)
+  {
+    return;
+  }
+  const int32_t* feedback = m_readbackData[frameCycleIndex];
+  for(size_t t = 0; t < m_textureRequests.size(); ++t)
+  {
+    m_textureRequests[t] = std::min(m_textureRequests[t], feedback[t]);
+  }
+}
+
+void TextureStreamer::cmdClearFeedback(VkCommandBuffer cmd)
+{
+  // After the copy of the previous frame, before this frame's shaders
+  VkMemoryBarrier before{VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_WRITE_BIT};
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &before, 0, nullptr, 0, nullptr);
+  vkCmdFillBuffer(cmd, m_feedback.buffer, 0, VK_WHOLE_SIZE, uint32_t(TEXTURE_FEEDBACK_NONE));
+  VkMemoryBarrier after{VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr, VK_ACCESS_TRANSFER_WRITE_BIT,
+                        VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT};
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, 0, 1, &after,
+                       0, nullptr, 0, nullptr);
+}
+
+void TextureStreamer::cmdCopyFeedback(VkCommandBuffer cmd, uint32_t frameCycleIndex)
+{
+  if(frameCycleIndex >= m_readback.size() || m_readback[frameCycleIndex].buffer == VK_NULL_HANDLE)
+  {
+    return;
+  }
+  VkMemoryBarrier before{VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT};
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1,
+                       &before, 0, nullptr, 0, nullptr);
+  VkBufferCopy region{0, 0, m_textureRequests.size() * sizeof(int32_t)};
+  if(region.size > 0)
+  {
+    vkCmdCopyBuffer(cmd, m_feedback.buffer, m_readback[frameCycleIndex].buffer, 1, &region);
+  }
+  VkMemoryBarrier after{VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT};
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &after, 0, nullptr, 0, nullptr);
+}
+
+bool TextureStreamer::update()
+{
+  bool replaced = false;
+  if(m_uploadInFlight)
+  {
+    if(!m_ring.isComplete(m_uploadSerial))
+    {
+      return false;
+    }
+    completeUploads();
+    replaced = true;
+  }
+
+  applyFeedback();
+  applyBudget();
+  submitUploads();
+  return replaced;
+}
+
+VkDeviceSize TextureStreamer::getStagingSize(const StreamedImage& image) const
+{
+  VkDeviceSize size = 0;
+  for(uint32_t l = image.targetMip; l < image.source.mips.size(); ++l)
+  {
+    size = alignUp(size + image.source.mips[l].size(), kLevelAlignment);
+  }
+  return size;
+}
+
+uint32_t TextureStreamer::getLevel(const StreamedImage& image, int32_t feedback) const
+{
+  // The feedback is the level of a 1x1 texture
+  const float size  = float(std::max(image.source.width, image.source.height));
+  const float level = float(feedback) / TEXTURE_FEEDBACK_SCALE + log2f(size);
+  return static_cast<uint32_t>(std::clamp(static_cast<int>(floorf(level)), 0, static_cast<int>(image.coarseMip)));
+}
+
+void TextureStreamer::applyFeedback()
+{
+  for(size_t t = 0; t < m_textureRequests.size(); ++t)
+  {
+    const int32_t image = m_textureImages[t];
+    if(image >= 0 && m_textureRequests[t] != TEXTURE_FEEDBACK_NONE)
+    {
+      StreamedImage& streamed = m_images[image];
+      streamed.requestedMip   = std::min<int32_t>(streamed.requestedMip, getLevel(streamed, m_textureRequests[t]));
+    }
+    m_textureRequests[t] = TEXTURE_FEEDBACK_NONE;
+  }
+
+  // Finer levels are wanted at once, coarser ones only once they were not requested for a while
+  for(StreamedImage& image : m_images)
+  {
+    if(!image.source.isValid() || image.pinned)
+    {
+      continue;
+    }
+    if(image.requestedMip <= static_cast<int32_t>(image.wantedMip))
+    {
+      image.wantedMip    = static_cast<uint32_t>(image.requestedMip);
+      image.relaxUpdates = 0;
+    }
+    else if(++image.relaxUpdates > kRelaxUpdates)
+    {
+      image.wantedMip    = std::min(image.wantedMip + 1, image.coarseMip);
+      image.relaxUpdates = 0;
+    }
+    image.requestedMip = INT32_MAX;
+  }
+}
+
+void TextureStreamer::applyBudget()
+{
+  VkDeviceSize total = 0;
+  for(StreamedImage& image : m_images)
+  {
+    if(image.source.isValid())
+    {
+      image.targetMip = image.wantedMip;
+      total += image.chainSizes[image.targetMip];
+    }
+  }
+
+  // The largest images give up a level until everything fits
+  while(total > m_budget)
+  {
+    StreamedImage* largest = nullptr;
+    for(StreamedImage& image : m_images)
+    {
+      if(image.source.isValid() && !image.pinned && image.targetMip < image.coarseMip
+         && (largest == nullptr || image.chainSizes[image.targetMip] > largest->chainSizes[largest->targetMip]))
+      {
+        largest = &image;
+      }
+    }
+    if(largest == nullptr)
+    {
+      break;
+    }
+    total -= largest->chainSizes[largest->targetMip] - largest->chainSizes[largest->targetMip + 1];
+    largest->targetMip++;
+  }
+}
+
+void TextureStreamer::submitUploads()
+{
+  if(m_uploadInFlight)
+  {
+    return;
+  }
+
+  // Placeholders first, then the images the furthest from their target
+  std::vector<uint32_t> candidates;
+  for(uint32_t i = 0; i < static_cast<uint32_t>(m_images.size()); ++i)
+  {
+    const StreamedImage& image = m_images[i];
+    if(image.source.isValid() && image.residentMip != static_cast<int32_t>(image.targetMip))
+    {
+      candidates.push_back(i);
+    }
+  }
+  if(candidates.empty())
+  {
+    return;
+  }
+  auto distance = [&](uint32_t i) {
+    const StreamedImage& image = m_images[i];
+    return image.residentMip < 0 ? INT32_MAX : std::abs(image.residentMip - static_cast<int32_t>(image.targetMip));
+  };
+  std::stable_sort(candidates.begin(), candidates.end(), [&](uint32_t a, uint32_t b) { return distance(a) > distance(b); });
+
+  // The selected images are staged in the ring, until it is full or the submission reaches its size
+  std::vector<std::pair<uint32_t, StagingRing::Region>> uploads;
+  VkDeviceSize                                          uploadSize = 0;
+  for(uint32_t index : candidates)
+  {
+    const VkDeviceSize  size = getStagingSize(m_images[index]);
+    StagingRing::Region region;
+    if(size > m_ring.getCapacity())
+    {
+      if(m_oversized.buffer != VK_NULL_HANDLE)
+      {
+        continue;  // one per submission
+      }
+      // A chain larger than the whole ring gets its own staging buffer
+      m_oversized = m_alloc->createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+      region = {m_oversized.buffer, 0, static_cast<uint8_t*>(m_alloc->map(m_oversized))};
+    }
+    else
+    {
+      if(!uploads.empty() && uploadSize + size > kMaxUploadSize)
+      {
+        continue;
+      }
+      region = m_ring.allocate(size, kLevelAlignment);
+      if(!region.isValid())
+      {
+        break;  // the next update tries again, once earlier uploads released their regions
+      }
+      uploadSize += size;
+    }
+    uploads.emplace_back(index, region);
+  }
+  if(uploads.empty())
+  {
+    return;
+  }
+
+  NVVK_CHECK(vkResetCommandBuffer(m_cmd, 0));
+  VkCommandBufferBeginInfo beginInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  NVVK_CHECK(vkBeginCommandBuffer(m_cmd, &beginInfo));
+
+  for(const auto& [index, region] : uploads)
+  {
+    const StreamedImage& image  = m_images[index];
+    const uint32_t       mip    = image.targetMip;
+    const uint32_t       levels = static_cast<uint32_t>(image.source.mips.size()) - mip;
+
+    const VkExtent2D  extent{std::max(image.source.width >> mip, 1u), std::max(image.source.height >> mip, 1u)};
+    VkImageCreateInfo imageInfo =
+        nvvk::makeImage2DCreateInfo(extent, image.format, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+    imageInfo.mipLevels = levels;
+    if(m_queueFamilies.size() > 1)
+    {
+      imageInfo.sharingMode           = VK_SHARING_MODE_CONCURRENT;
+      imageInfo.queueFamilyIndexCount = static_cast<uint32_t>(m_queueFamilies.size());
+      imageInfo.pQueueFamilyIndices   = m_queueFamilies.data();
+    }
+    nvvk::Image           vkImage  = m_alloc->createImage(imageInfo);
+    VkImageViewCreateInfo viewInfo = nvvk::makeImageViewCreateInfo(vkImage.image, imageInfo);
+    PendingImage          pending{index, mip, m_alloc->createTexture(vkImage, viewInfo)};
+
+    // Stages valid on a transfer queue: the graphics queue only samples the image once the host saw the upload complete
+    VkImageMemoryBarrier barrier{VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
+    barrier.srcAccessMask       = 0;
+    barrier.dstAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.oldLayout           = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout           = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image               = vkImage.image;
+    barrier.subresourceRange    = {VK_IMAGE_ASPECT_COLOR_BIT, 0, levels, 0, 1};
+    vkCmdPipelineBarrier(m_cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                         nullptr, 1, &barrier);
+
+    std::vector<VkBufferImageCopy> copies(levels);
+    VkDeviceSize                   offset = 0;
+    for(uint32_t l = 0; l < levels; ++l)
+    {
+      const std::vector<uint8_t>& data = image.source.mips[mip + l];
+      memcpy(region.data + offset, data.data(), data.size());
+
+      VkBufferImageCopy& copy = copies[l];
+      copy                    = {};
+      copy.bufferOffset       = region.offset + offset;
+      copy.imageSubresource   = {VK_IMAGE_ASPECT_COLOR_BIT, l, 0, 1};
+      copy.imageExtent        = {std::max(extent.width >> l, 1u), std::max(extent.height >> l, 1u), 1};
+      offset                  = alignUp(offset + data.size(), kLevelAlignment);
+    }
+    vkCmdCopyBufferToImage(m_cmd, region.buffer, vkImage.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                           static_cast<uint32_t>(copies.size()), copies.data());
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = 0;
+    barrier.oldLayout     = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout     = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    vkCmdPipelineBarrier(m_cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr,
+                         0, nullptr, 1, &barrier);
+
+    m_pending.push_back(pending);
+  }
+  if(m_oversized.buffer != VK_NULL_HANDLE)
+  {
+    m_alloc->unmap(m_oversized);
+  }
+
+  NVVK_CHECK(vkEndCommandBuffer(m_cmd));
+  m_uploadSerial   = m_ring.submit(m_queue, m_cmd);
+  m_uploadInFlight = true;
+}
+
+void TextureStreamer::completeUploads()
+{
+  m_uploadInFlight = false;
+  m_alloc->destroy(m_oversized);
+
+  for(PendingImage& pending : m_pending)
+  {
+    StreamedImage& image = m_images[pending.image];
+
+    // The frames in flight may still sample the previous image
+    if(image.texture.image != VK_NULL_HANDLE)
+    {
+      nvvk::ResourceAllocator* alloc = m_alloc;
+      m_deletionQueue.push([alloc, texture = image.texture]() mutable { alloc->destroy(texture); });
+    }
+    image.texture     = pending.texture;
+    image.residentMip = static_cast<int32_t>(pending.mip);
+    writeDescriptors(pending.image);
+  }
+  m_pending.clear();
+}
+
+void TextureStreamer::writeDescriptors(uint32_t image)
+{
+  for(size_t t = 0; t < m_textureImages.size(); ++t)
+  {
+    if(m_textureImages[t] == static_cast<int32_t>(image))
+    {
+      m_descriptors[t].sampler     = m_samplers[t];
+      m_descriptors[t].imageView   = m_images[image].texture.descriptor.imageView;
+      m_descriptors[t].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    }
+  }
+}
+
+TextureStreamer::Statistics TextureStreamer::getStatistics() const
+{
+  Statistics stats;
+  for(const StreamedImage& image : m_images)
+  {
+    if(!image.source.isValid())
+    {
+      continue;
+    }
+    stats.images++;
+    stats.fullSize += image.chainSizes[0];
+    stats.requestedSize += image.chainSizes[image.wantedMip];
+    if(image.residentMip >= 0)
+    {
+      stats.residentSize += image.chainSizes[image.residentMip];
+    }
+    if(image.residentMip != static_cast<int32_t>(image.targetMip))
+    {
+      stats.pendingImages++;
+    }
+  }
+  return stats;
+}
@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include <vulkan/vulkan_core.h>
+
+#include <nvvk/resourceallocator_vk.hpp>
+#include <nvvkhl/gltf_scene_vk.hpp>
+
+#include "DeletionQueue.hpp"
+#include "StagingRing.hpp"
+
+namespace tinygltf {
+class Model;
+}
+
+/* Streams the mip levels of the scene textures within a memory budget.
+ *
+ * The images decoded by the SceneLoader are kept on the CPU with their whole mip chain, in RGBA8
+ * or BC7 (see TextureCompressor), and nvvkhl::SceneVk only gets 1x1 placeholders of them. Those
+ * embedded in the file have their chain generated on the GPU instead, and are not streamed. The
+ * first update() uploads the coarse levels of all images. From then on, the hit shaders record the
+ * finest level each texture is sampled at in a feedback buffer, estimated from the ray cones (see
+ * shaders/texture_feedback.glsl). This is read back once the frame completed, and the images are
+ * moved to the requested levels: finer levels are uploaded, and the levels that are no longer
+ * requested are dropped. When the requests exceed the budget, the largest images are kept coarser.
+ *
+ * A resident image always holds the chain from its finest level down, so it is sampled with the
+ * same texture coordinates whatever its resolution. Without sparse residency, changing the finest
+ * level means creating a new image: the uploads are staged in a StagingRing and run on their own
+ * command buffer, on the upload queue (a transfer queue when the device has one), at most one
+ * in flight. The new images replace the old ones once it completed: update() then returns true,
+ * and the texture descriptors must be written again from getDescriptors().
+ */
+class TextureStreamer
+{
+public:
+  // Decoded image and its mip chain, from the full resolution down to 1x1
+  struct SourceImage
+  {
+    uint32_t                          width{0};
+    uint32_t                          height{0};
+    VkFormat                          format{VK_FORMAT_R8G8B8A8_UNORM};  // or BC7, see TextureCompressor
+    std::vector<std::vector<uint8_t>> mips;
+
+    bool isValid() const { return !mips.empty(); }
+  };
+
+  /* The mip chain of 'pixels' (RGBA8), by 2x2 box filtering. With 'srgb', the color is averaged
+   * in linear space.
+   */
+  static SourceImage makeSourceImage(std::vector<uint8_t>&& pixels, uint32_t width, uint32_t height, bool srgb);
+
+  TextureStreamer(VkDevice                 device,
+                  nvvk::ResourceAllocator* alloc,
+                  StagingRing&             stagingRing,
+                  VkQueue                  uploadQueue,
+                  uint32_t                 uploadFamilyIndex,
+                  uint32_t                 graphicsFamilyIndex,
+                  DeletionQueue&           deletionQueue,
+                  uint32_t                 frameCycleSize);
+  ~TextureStreamer();  // waits for the upload in flight, the ring must outlive the streamer
+
+  /* Take over the decoded 'images' and the complete 'generatedTextures', both indexed as
+   * model.images. The generated textures, whose mips were made on the GPU (see MipGenerator), are
+   * sampled as they are and destroyed with the streamer. The images with neither are left to
+   * 'sceneVk', which also provides the samplers of all textures.
+   */
+  void setup(const tinygltf::Model&       model,
+             const nvvkhl::SceneVk&       sceneVk,
+             std::vector<SourceImage>&&   images,
+             std::vector<nvvk::Texture>&& generatedTextures);
+
+  /* Memory of the resident images, including the textures that are kept at full resolution */
+  void setBudget(VkDeviceSize bytes) { m_budget = bytes; }
+
+  /* Feedback buffer of the hit shaders, one int per texture */
+  VkDescriptorBufferInfo getFeedbackBuffer() const { return {m_feedback.buffer, 0, VK_WHOLE_SIZE}; }
+
+  /* Fold the feedback of the frame that last used 'frameCycleIndex', once its fence was waited on */
+  void readFeedback(uint32_t frameCycleIndex);
+  /* Reset the feedback before the ray tracing, and copy it for readFeedback() after it */
+  void cmdClearFeedback(VkCommandBuffer cmd);
+  void cmdCopyFeedback(VkCommandBuffer cmd, uint32_t frameCycleIndex);
+
+  /* Check the upload in flight and start the next one. Returns true when images were replaced. */
+  bool update();
+
+  /* One per texture of SceneVk */
+  const std::vector<VkDescriptorImageInfo>& getDescriptors() const { return m_descriptors; }
+
+  struct Statistics
+  {
+    VkDeviceSize residentSize{0};   // of the streamed images
+    VkDeviceSize requestedSize{0};  // of the levels the feedback asks for
+    VkDeviceSize fullSize{0};       // of all levels of all streamed images
+    uint32_t     images{0};
+    uint32_t     pendingImages{0};  // not at their target level yet
+  };
+  Statistics getStatistics() const;
+
+private:
+  struct StreamedImage
+  {
+    SourceImage               source;
+    std::vector<VkDeviceSize> chainSizes;  // [level] bytes of the chain from that level down
+    VkFormat                  format{VK_FORMAT_R8G8B8A8_UNORM};
+    bool                      pinned{false};  // sampled without feedback: kept at full resolution
+    uint32_t                  coarseMip{0};   // uploaded first, and never dropped
+    int32_t                   residentMip{-1};  // finest level of 'texture', -1 while SceneVk's placeholder is used
+    uint32_t                  wantedMip{0};     // from the feedback, before the budget
+    uint32_t                  targetMip{0};     // within the budget
+    uint32_t                  relaxUpdates{0};  // updates since the feedback last asked for 'wantedMip'
+    int32_t                   requestedMip{INT32_MAX};  // finest level requested since the last update
+    nvvk::Texture             texture;  // of the resident levels, or complete when 'source' is not valid
+  };
+
+  // Upload of the images, in flight until the submission 'm_uploadSerial' of the ring completes
+  struct PendingImage
+  {
+    uint32_t      image;
+    uint32_t      mip;
+    nvvk::Texture texture;
+  };
+
+  void         applyFeedback();
+  void         applyBudget();
+  void         submitUploads();
+  void         completeUploads();
+  void         writeDescriptors(uint32_t image);
+  VkDeviceSize getStagingSize(const StreamedImage& image) const;  // of the levels from 'targetMip' down
+  uint32_t     getLevel(const StreamedImage& image, int32_t feedback) const;
+
+  VkDevice                 m_device = VK_NULL_HANDLE;
+  nvvk::ResourceAllocator* m_alloc  = nullptr;
+  StagingRing&             m_ring;
+  VkQueue                  m_queue  = VK_NULL_HANDLE;  // upload queue
+  DeletionQueue&           m_deletionQueue;
+  std::vector<uint32_t>    m_queueFamilies;  // sharing the streamed images
+
+  VkCommandPool   m_cmdPool = VK_NULL_HANDLE;
+  VkCommandBuffer m_cmd     = VK_NULL_HANDLE;
+
+  std::vector<StreamedImage>         m_images;         // per glTF image
+  std::vector<int32_t>               m_textureImages;  // image of each texture, -1 if not streamed
+  std::vector<VkDescriptorImageInfo> m_descriptors;    // per texture
+  std::vector<VkSampler>             m_samplers;       // per texture, owned by SceneVk
+
+  nvvk::Buffer              m_feedback;  // written by the shaders
+  std::vector<nvvk::Buffer> m_readback;  // per frame cycle slot
+  std::vector<int32_t*>     m_readbackData;
+  std::vector<int32_t>      m_textureRequests;  // finest level requested per texture, since the last update
+
+  std::vector<PendingImage> m_pending;
+  nvvk::Buffer              m_oversized;  // staging of an image chain larger than the ring
+  uint64_t                  m_uploadSerial{0};
+  bool                      m_uploadInFlight{false};
+  VkDeviceSize              m_budget{1024ull << 20};
+};
@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <stdint.h>
+
+/* Fixed set of worker threads executing queued tasks.
+ * submit() returns a future of the task's result; parallelFor() splits an index range over the
+ * workers and the calling thread, and returns once all indices were processed.
+ * Tasks are run in order of submission: a pool shared with long tasks delays the short ones, see
+ * parallelFor().
+ */
+class ThreadPool
+{
+public:
+  /* 'numThreads' workers, by default one per hardware thread besides the calling one */
+  explicit ThreadPool(uint32_t numThreads = std::max(std::thread::hardware_concurrency(), 2u) - 1)
+  {
+    for(uint32_t t = 0; t < std::max(numThreads, 1u); ++t)
+    {
+      m_workers.emplace_back([this]() { workerLoop(); });
+    }
+  }
+
+  /* Waits for the queued tasks to complete */
+  ~ThreadPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stop = true;
+    }
+    m_condition.notify_all();
+    for(auto& w : m_workers)
+    {
+      w.join();
+    }
+  }
+
+  uint32_t size() const { return static_cast<uint32_t>(m_workers.size()); }
+
+  template <typename F>
+  auto submit(F&& task) -> std::future<std::invoke_result_t<std::decay_t<F>>>
+  {
+    using R      = std::invoke_result_t<std::decay_t<F>>;
+    auto package = std::make_shared<std::packaged_task<R()>>(std::forward<F>(task));
+    auto future  = package->get_future();
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_tasks.emplace_back([package]() { (*package)(); });
+    }
+    m_condition.notify_one();
+    return future;
+  }
+
+  /* Call fn(i) for each i in [0, count), at most 'maxThreads' calls running at the same time.
+   * The calling thread processes indices too, and only waits for the calls already started: when
+   * the workers are busy with other tasks, it ends up processing all of them itself. A helper task
+   * starting after the return finds no index left and does not touch 'fn'.
+   */
+  void parallelFor(uint32_t count, const std::function<void(uint32_t)>& fn, uint32_t maxThreads = ~0u)
+  {
+    struct State
+    {
+      std::atomic<uint32_t>   next{0};
+      uint32_t                done{0};  // under 'mutex'
+      std::mutex              mutex;
+      std::condition_variable finished;
+    };
+    auto state = std::make_shared<State>();
+    auto loop  = [state, count, f = &fn]() {
+      for(uint32_t i = state->next++; i < count; i = state->next++)
+      {
+        (*f)(i);
+        std::lock_guard<std::mutex> lock(state->mutex);
+        if(++state->done == count)
+        {
+          state->finished.notify_all();
+        }
+      }
+    };
+
+    const uint32_t helpers = std::min({size(), count > 0 ? count - 1 : 0, maxThreads > 0 ? maxThreads - 1 : 0});
+    for(uint32_t h = 0; h < helpers; ++h)
+    {
+      submit(loop);
+    }
+    loop();
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->finished.wait(lock, [&]() { return state->done == count; });
+  }
+
+private:
+  void workerLoop()
+  {
+    for(;;)
+    {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_condition.wait(lock, [this]() { return m_stop || !m_tasks.empty(); });
+        if(m_tasks.empty())
+        {
+          return;  // stopping
+        }
+        task = std::move(m_tasks.front());
+        m_tasks.pop_front();
+      }
+      task();
+    }
+  }
+
+  std::vector<std::thread>          m_workers;
+  std::deque<std::function<void()>> m_tasks;
+  std::mutex                        m_mutex;
+  std::condition_variable           m_condition;
+  bool                              m_stop = false;
+};
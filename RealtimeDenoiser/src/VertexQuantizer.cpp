@@ -0,0 +1,368 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "VertexQuantizer.hpp"
+
+#include <nvvk/debug_util_vk.hpp>
+
+#include "shaders/host_device.h"
+#include "tiny_gltf.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Primitives with the same attribute accessors, and their quantized attributes
+struct Geometry
+{
+  int                               position{-1};
+  int                               normal{-1};
+  int                               tangent{-1};
+  int                               texCoord{-1};
+  std::vector<tinygltf::Primitive*> primitives;
+
+  std::vector<uint32_t> normalData;  // one word per vertex, empty if not quantized
+  std::vector<uint32_t> tangentData;
+  std::vector<uint32_t> texCoordData;
+  glm::vec2             texCoordMin{0.F};
+  glm::vec2             texCoordMax{0.F};
+  uint64_t              bytesBefore{0};
+};
+
+// The elements of a FLOAT accessor of 'components' components, in place, or nullptr if it cannot be read so
+const uint8_t* getFloats(const tinygltf::Model& model, int accessorIndex, int components, size_t& stride, size_t& count)
+{
+  if(accessorIndex < 0 || accessorIndex >= static_cast<int>(model.accessors.size()))
+  {
+    return nullptr;
+  }
+  const tinygltf::Accessor& accessor = model.accessors[accessorIndex];
+  if(accessor.componentType != TINYGLTF_COMPONENT_TYPE_FLOAT || tinygltf::GetNumComponentsInType(accessor.type) != components
+     || accessor.sparse.isSparse || accessor.bufferView < 0 || accessor.count == 0)
+  {
+    return nullptr;
+  }
+  const tinygltf::BufferView& view   = model.bufferViews[accessor.bufferView];
+  const tinygltf::Buffer&     buffer = model.buffers[view.buffer];
+  const size_t                size   = sizeof(float) * components;
+  stride                             = view.byteStride > 0 ? view.byteStride : size;
+  count                              = accessor.count;
+  const size_t offset                = view.byteOffset + accessor.byteOffset;
+  if(offset + stride * (count - 1) + size > buffer.data.size())
+  {
+    return nullptr;
+  }
+  return buffer.data.data() + offset;
+}
+
+int16_t toSnorm16(float value)
+{
+  return static_cast<int16_t>(std::lround(std::clamp(value, -1.F, 1.F) * 32767.F));
+}
+
+// Octahedral mapping of a direction to [-1, 1]^2, as snorm16x2 (unpackSnorm2x16 in the shaders)
+uint32_t encodeOctahedral(glm::vec3 n)
+{
+  const float sum = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+  if(!(sum > 0.F) || !std::isfinite(sum))
+  {
+    n = {0.F, 0.F, 1.F};
+  }
+  else
+  {
+    n /= sum;
+  }
+  glm::vec2 e{n.x, n.y};
+  if(n.z < 0.F)
+  {
+    e = {(1.F - std::abs(n.y)) * (n.x >= 0.F ? 1.F : -1.F), (1.F - std::abs(n.x)) * (n.y >= 0.F ? 1.F : -1.F)};
+  }
+  return uint32_t(uint16_t(toSnorm16(e.x))) | (uint32_t(uint16_t(toSnorm16(e.y))) << 16);
+}
+
+uint32_t encodeUnorm16x2(glm::vec2 value)
+{
+  const auto toUnorm16 = [](float v) { return uint32_t(std::lround(std::clamp(v, 0.F, 1.F) * 65535.F)); };
+  return toUnorm16(value.x) | (toUnorm16(value.y) << 16);
+}
+
+void quantizeGeometry(const tinygltf::Model& model, Geometry& geometry)
+{
+  size_t stride = 0;
+  size_t count  = 0;
+  if(getFloats(model, geometry.position, 3, stride, count) == nullptr)
+  {
+    return;
+  }
+  const size_t vertexCount = count;
+
+  if(const uint8_t* data = getFloats(model, geometry.normal, 3, stride, count); data && count == vertexCount)
+  {
+    geometry.normalData.resize(vertexCount);
+    for(size_t v = 0; v < vertexCount; ++v)
+    {
+      glm::vec3 normal;
+      memcpy(&normal, data + v * stride, sizeof(normal));
+      geometry.normalData[v] = encodeOctahedral(normal);
+    }
+    geometry.bytesBefore += vertexCount * sizeof(glm::vec3);
+  }
+
+  if(const uint8_t* data = getFloats(model, geometry.tangent, 4, stride, count); data && count == vertexCount)
+  {
+    geometry.tangentData.resize(vertexCount);
+    for(size_t v = 0; v < vertexCount; ++v)
+    {
+      glm::vec4 tangent;
+      memcpy(&tangent, data + v * stride, sizeof(tangent));
+      const uint32_t word     = encodeOctahedral(glm::vec3(tangent));
+      geometry.tangentData[v] = (word & ~1u) | (tangent.w < 0.F ? 1u : 0u);
+    }
+    geometry.bytesBefore += vertexCount * sizeof(glm::vec4);
+  }
+
+  if(const uint8_t* data = getFloats(model, geometry.texCoord, 2, stride, count); data && count == vertexCount)
+  {
+    glm::vec2 lo{FLT_MAX}, hi{-FLT_MAX};
+    for(size_t v = 0; v < vertexCount; ++v)
+    {
+      glm::vec2 uv;
+      memcpy(&uv, data + v * stride, sizeof(uv));
+      lo = glm::min(lo, uv);
+      hi = glm::max(hi, uv);
+    }
+    const glm::vec2 range = hi - lo;
+    if(std::isfinite(range.x) && std::isfinite(range.y) && std::max(range.x, range.y) <= VertexQuantizer::kMaxTexCoordRange)
+    {
+      const glm::vec2 scale{range.x > 0.F ? 1.F / range.x : 0.F, range.y > 0.F ? 1.F / range.y : 0.F};
+      geometry.texCoordData.resize(vertexCount);
+      for(size_t v = 0; v < vertexCount; ++v)
+      {
+        glm::vec2 uv;
+        memcpy(&uv, data + v * stride, sizeof(uv));
+        geometry.texCoordData[v] = encodeUnorm16x2((uv - lo) * scale);
+      }
+      geometry.texCoordMin = lo;
+      geometry.texCoordMax = hi;
+      geometry.bytesBefore += vertexCount * sizeof(glm::vec2);
+    }
+  }
+}
+
+// Append 'size' bytes as a new buffer view and a tightly packed accessor of them, 4-byte aligned
+int addAccessor(tinygltf::Model& model, int buffer, const void* data, size_t size, size_t count, int componentType, int type, bool normalized)
+{
+  std::vector<unsigned char>& bytes = model.buffers[buffer].data;
+  bytes.resize((bytes.size() + 3) & ~size_t(3));
+
+  tinygltf::BufferView view;
+  view.buffer     = buffer;
+  view.byteOffset = bytes.size();
+  view.byteLength = size;
+  bytes.insert(bytes.end(), static_cast<const uint8_t*>(data), static_cast<const uint8_t*>(data) + size);
+  model.bufferViews.push_back(view);
+
+  tinygltf::Accessor accessor;
+  accessor.bufferView    = static_cast<int>(model.bufferViews.size()) - 1;
+  accessor.componentType = componentType;
+  accessor.type          = type;
+  accessor.count         = count;
+  accessor.normalized    = normalized;
+  model.accessors.push_back(std::move(accessor));
+  return static_cast<int>(model.accessors.size()) - 1;
+}
+
+int findAttribute(const tinygltf::Primitive& primitive, const char* name)
+{
+  auto it = primitive.attributes.find(name);
+  return it != primitive.attributes.end() ? it->second : -1;
+}
+
+}  // namespace
+
+VertexQuantizer::VertexQuantizer(VkDevice device, nvvk::ResourceAllocator* alloc)
+    : m_device(device)
+    , m_alloc(alloc)
+{
+}
+
+VertexQuantizer::~VertexQuantizer()
+{
+  destroy();
+}
+
+bool VertexQuantizer::quantize(tinygltf::Model& model, ThreadPool& threads, Statistics& stats)
+{
+  // The distinct geometries, each quantized once for all the primitives using it
+  std::vector<Geometry>      geometries;
+  std::map<std::string, int> geometryOfKey;
+  for(tinygltf::Mesh& mesh : model.meshes)
+  {
+    for(tinygltf::Primitive& primitive : mesh.primitives)
+    {
+      if((primitive.mode != TINYGLTF_MODE_TRIANGLES && primitive.mode != -1) || !primitive.targets.empty())
+      {
+        continue;
+      }
+      Geometry geometry;
+      geometry.position = findAttribute(primitive, "POSITION");
+      geometry.normal   = findAttribute(primitive, "NORMAL");
+      geometry.tangent  = findAttribute(primitive, "TANGENT");
+      geometry.texCoord = findAttribute(primitive, "TEXCOORD_0");
+      if(geometry.position < 0)
+      {
+        continue;
+      }
+
+      const std::string key = std::to_string(geometry.position) + ";" + std::to_string(geometry.normal) + ";"
+                              + std::to_string(geometry.tangent) + ";" + std::to_string(geometry.texCoord);
+      auto [it, inserted] = geometryOfKey.emplace(key, static_cast<int>(geometries.size()));
+      if(inserted)
+      {
+        geometries.push_back(std::move(geometry));
+      }
+      geometries[it->second].primitives.push_back(&primitive);
+    }
+  }
+
+  threads.parallelFor(
+      static_cast<uint32_t>(geometries.size()), [&](uint32_t g) { quantizeGeometry(model, geometries[g]); });
+
+  // The results go to a new buffer, and replace the fp32 attributes in the primitives
+  int buffer = -1;
+  for(Geometry& geometry : geometries)
+  {
+    if(geometry.normalData.empty() && geometry.tangentData.empty() && geometry.texCoordData.empty())
+    {
+      continue;
+    }
+    if(buffer < 0)
+    {
+      tinygltf::Buffer quantized;
+      quantized.name = "VertexQuantizer";
+      model.buffers.push_back(std::move(quantized));
+      buffer = static_cast<int>(model.buffers.size()) - 1;
+    }
+
+    std::map<std::string, int> added;    // attribute name to accessor
+    std::vector<std::string>   removed;  // fp32 attributes replaced
+    if(!geometry.normalData.empty())
+    {
+      added["_NORMAL_OCT"] = addAccessor(model, buffer, geometry.normalData.data(), geometry.normalData.size() * sizeof(uint32_t),
+                                         geometry.normalData.size(), TINYGLTF_COMPONENT_TYPE_SHORT, TINYGLTF_TYPE_VEC2, true);
+      removed.push_back("NORMAL");
+    }
+    if(!geometry.tangentData.empty())
+    {
+      added["_TANGENT_OCT"] = addAccessor(model, buffer, geometry.tangentData.data(), geometry.tangentData.size() * sizeof(uint32_t),
+                                          geometry.tangentData.size(), TINYGLTF_COMPONENT_TYPE_SHORT, TINYGLTF_TYPE_VEC2, true);
+      removed.push_back("TANGENT");
+    }
+    if(!geometry.texCoordData.empty())
+    {
+      const int accessor = addAccessor(model, buffer, geometry.texCoordData.data(), geometry.texCoordData.size() * sizeof(uint32_t),
+                                       geometry.texCoordData.size(), TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT, TINYGLTF_TYPE_VEC2, true);
+      model.accessors[accessor].minValues = {geometry.texCoordMin.x, geometry.texCoordMin.y};
+      model.accessors[accessor].maxValues = {geometry.texCoordMax.x, geometry.texCoordMax.y};
+      added["_TEXCOORD_0_UNORM"]          = accessor;
+      removed.push_back("TEXCOORD_0");
+    }
+
+    for(tinygltf::Primitive* primitive : geometry.primitives)
+    {
+      for(const std::string& name : removed)
+      {
+        primitive->attributes.erase(name);
+      }
+      primitive->attributes.insert(added.begin(), added.end());
+    }
+
+    stats.primitives++;
+    stats.bytesBefore += geometry.bytesBefore;
+    stats.bytesAfter += (geometry.normalData.size() + geometry.tangentData.size() + geometry.texCoordData.size()) * sizeof(uint32_t);
+  }
+  return buffer >= 0;
+}
+
+void VertexQuantizer::create(VkCommandBuffer cmd, const nvh::gltf::Scene& scene)
+{
+  destroy();
+
+  const tinygltf::Model&          model = scene.getModel();
+  const auto&                     prims = scene.getRenderPrimitives();
+  std::vector<QuantizedPrimitive> primitives(std::max<size_t>(prims.size(), 1));
+  std::vector<uint32_t>           data;
+
+  // Copy of the data of an accessor added by quantize(), returns its offset in words
+  const auto append = [&](int accessorIndex) {
+    const tinygltf::Accessor&   accessor = model.accessors[accessorIndex];
+    const tinygltf::BufferView& view     = model.bufferViews[accessor.bufferView];
+    const size_t                offset   = data.size();
+    data.resize(offset + (view.byteLength + 3) / 4, 0u);
+    memcpy(data.data() + offset, model.buffers[view.buffer].data.data() + view.byteOffset, view.byteLength);
+    return static_cast<uint32_t>(offset);
+  };
+
+  for(size_t p = 0; p < prims.size(); ++p)
+  {
+    const tinygltf::Primitive& primitive = *prims[p].pPrimitive;
+    QuantizedPrimitive&        quantized = primitives[p];
+    quantized                            = {};
+    if(const int accessor = findAttribute(primitive, "_NORMAL_OCT"); accessor >= 0)
+    {
+      quantized.flags |= QUANTIZED_NORMAL;
+      quantized.normalOffset = append(accessor);
+    }
+    if(const int accessor = findAttribute(primitive, "_TANGENT_OCT"); accessor >= 0)
+    {
+      quantized.flags |= QUANTIZED_TANGENT;
+      quantized.tangentOffset = append(accessor);
+    }
+    if(const int accessor = findAttribute(primitive, "_TEXCOORD_0_UNORM"); accessor >= 0)
+    {
+      const tinygltf::Accessor& range = model.accessors[accessor];
+      quantized.flags |= QUANTIZED_TEXCOORD;
+      quantized.texCoordOffset = append(accessor);
+      quantized.uvOffset       = glm::vec2(range.minValues[0], range.minValues[1]);
+      quantized.uvScale        = glm::vec2(range.maxValues[0], range.maxValues[1]) - quantized.uvOffset;
+    }
+  }
+  m_dataSize = data.size() * sizeof(uint32_t);
+  data.resize(std::max<size_t>(data.size(), 1), 0u);  // no empty buffer
+
+  m_bPrimitives = m_alloc->createBuffer(cmd, primitives, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+  m_bData       = m_alloc->createBuffer(cmd, data, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+
+  nvvk::DebugUtil dutil(m_device);
+  dutil.setObjectName(m_bPrimitives.buffer, "QuantizedPrimitives");
+  dutil.setObjectName(m_bData.buffer, "QuantizedData");
+}
+
+void VertexQuantizer::destroy()
+{
+  m_alloc->destroy(m_bPrimitives);
+  m_alloc->destroy(m_bData);
+  m_dataSize = 0;
+}
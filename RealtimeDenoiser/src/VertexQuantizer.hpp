@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <vulkan/vulkan_core.h>
+
+#include <nvh/gltfscene.hpp>
+#include <nvvk/resourceallocator_vk.hpp>
+
+#include "ThreadPool.hpp"
+
+/* Compressed vertex attributes, decoded by the hit shaders (see shaders/quantized_vertex.glsl).
+ *
+ * quantize() replaces, in each triangle primitive of the model, the fp32 attributes by:
+ * - _NORMAL_OCT: octahedral snorm16x2 normals,
+ * - _TANGENT_OCT: octahedral snorm16x2 tangents, the bitangent sign in the lowest bit of x,
+ * - _TEXCOORD_0_UNORM: unorm16x2 texture coordinates over the range of the primitive, which the
+ *   accessor min/max hold, when that range is at most kMaxTexCoordRange.
+ * nvvkhl::SceneVk ignores these application specific attributes and no longer uploads the fp32
+ * ones; create() uploads them instead, all in one buffer, and a QuantizedPrimitive per render
+ * primitive telling the shaders which of its attributes are compressed, and where.
+ * The positions stay fp32, as the BLAS are built from them, and the indices are those of SceneVk,
+ * which the BLAS builds read too.
+ */
+class VertexQuantizer
+{
+public:
+  // Largest texture coordinate range quantized: a step of 1/16384, a quarter texel of a 4K texture
+  static constexpr float kMaxTexCoordRange = 4.F;
+
+  struct Statistics
+  {
+    uint64_t primitives{0};   // distinct geometries with at least one attribute quantized
+    uint64_t bytesBefore{0};  // of the fp32 attributes replaced
+    uint64_t bytesAfter{0};   // of the quantized attributes
+  };
+
+  VertexQuantizer(VkDevice device, nvvk::ResourceAllocator* alloc);
+  ~VertexQuantizer();
+
+  /* Returns true if any primitive was changed */
+  static bool quantize(tinygltf::Model& model, ThreadPool& threads, Statistics& stats);
+
+  /* Upload the quantized attributes of the render primitives, before the model data is released.
+   * The staging buffers are released with the other uploads of the submission.
+   */
+  void create(VkCommandBuffer cmd, const nvh::gltf::Scene& scene);
+
+  VkDescriptorBufferInfo getPrimitiveBuffer() const { return {m_bPrimitives.buffer, 0, VK_WHOLE_SIZE}; }
+  VkDescriptorBufferInfo getDataBuffer() const { return {m_bData.buffer, 0, VK_WHOLE_SIZE}; }
+  VkDeviceSize           getDataSize() const { return m_dataSize; }
+
+private:
+  void destroy();
+
+  VkDevice                 m_device = VK_NULL_HANDLE;
+  nvvk::ResourceAllocator* m_alloc  = nullptr;
+  nvvk::Buffer             m_bPrimitives;  // QuantizedPrimitive per render primitive
+  nvvk::Buffer             m_bData;        // attributes of all render primitives, 4-byte aligned
+  VkDeviceSize             m_dataSize{0};
+};